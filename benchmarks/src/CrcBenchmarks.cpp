@@ -0,0 +1,88 @@
+#include <peripheral/ClmulCrc.hpp>
+#include <peripheral/SoftwareCrc.hpp>
+#include <peripheral/TableCrc.hpp>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace DynaSoft;
+
+namespace
+{
+
+constexpr std::size_t bufferSize = 4096;
+
+struct Measurement
+{
+    std::uint64_t cycles;
+    std::uint64_t nanoseconds;
+};
+
+std::uint64_t readCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Returns best of several runs to limit influence of interrupts and frequency changes
+template<typename Crc>
+Measurement measure(const std::vector<std::uint8_t>& buffer, std::uint32_t& result)
+{
+    Measurement best{~std::uint64_t{0}, ~std::uint64_t{0}};
+    for(int run = 0; run < 20; ++run)
+    {
+        Crc crc{};
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t startCycles = readCycles();
+        crc.addWords(makeSpan(buffer.data(), buffer.size()));
+        result += crc.get();
+        std::uint64_t cycles = readCycles() - startCycles;
+        std::uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        best.cycles = std::min(best.cycles, cycles);
+        best.nanoseconds = std::min(best.nanoseconds, nanoseconds);
+    }
+    return best;
+}
+
+template<typename Crc>
+void report(const char* name, const std::vector<std::uint8_t>& buffer, std::uint32_t& result)
+{
+    Measurement m = measure<Crc>(buffer, result);
+    double bytesPerCycle = m.cycles > 0 ? static_cast<double>(buffer.size()) / m.cycles : 0.0;
+    double megabytesPerSecond = m.nanoseconds > 0 ? buffer.size() * 1000.0 / m.nanoseconds : 0.0;
+    std::printf("%-12s %8.3f bytes/cycle %10.1f MB/s\n", name, bytesPerCycle, megabytesPerSecond);
+}
+
+}
+
+/// Prints throughput of software CRC units over buffer of bufferSize bytes.
+/// Cycles are counted with TSC on x86 (so they are reference cycles) and are not available on other CPUs.
+int main(void)
+{
+    std::vector<std::uint8_t> buffer(bufferSize);
+    for(std::size_t i = 0; i < buffer.size(); ++i)
+    {
+        buffer[i] = static_cast<std::uint8_t>(i * 37 + 11);
+    }
+
+    std::uint32_t result = 0;
+    report<SoftwareCrc>("SoftwareCrc", buffer, result);
+    report<TableCrc<1>>("TableCrc<1>", buffer, result);
+    report<TableCrc<4>>("TableCrc<4>", buffer, result);
+    report<TableCrc<8>>("TableCrc<8>", buffer, result);
+    report<ClmulCrc>(ClmulCrc::isAccelerated() ? "ClmulCrc" : "ClmulCrc(*)", buffer, result);
+    if(!ClmulCrc::isAccelerated())
+    {
+        std::printf("(*) CPU doesn't support PCLMULQDQ, table fallback was measured\n");
+    }
+    // Keeps results used, so CRC computation is not optimized away
+    std::printf("checksum: %08x\n", static_cast<unsigned>(result));
+    return 0;
+}
@@ -53,7 +53,18 @@ constexpr std::uint8_t messageMaxSize = std::max({
 	ImcProtocol::controlMessageMaxSize
 });
 
-using Imc = InterMcuCommunicationModule<StmUart, StmCrc, messageMaxSize, isImcMaster>;
+struct ImcConfig : ImcDefaultConfig
+{
+    static constexpr std::uint8_t publishSourcesCount = 1;
+};
+
+using Imc = InterMcuCommunicationModule<StmUart, StmCrc, messageMaxSize, isImcMaster, ImcConfig>;
+
+struct PublishedState
+{
+    bool led1State = false;
+    bool buttonState = false;
+};
 
 class MainRecipient : public ImcRecipent<MainRecipient, mainRecipent, MessageToReceive>
 {
@@ -136,7 +147,17 @@ int main(void)
 
     constexpr std::uint32_t led1IntervalUs = 1000 * 1000;
     std::uint32_t led1Timer = 0;
-    bool led1State = false;
+    PublishedState state{};
+
+    // Message is sent every 1ms, from imc.update()
+    imc.registerPublisher<MessageToSend>(1000, 0, {[](CallbackContext ctx, Imc& imc)
+    {
+        const PublishedState& state = *static_cast<PublishedState*>(ctx);
+        MessageToSend m{};
+        m.data.led1State = state.led1State;
+        m.data.buttonState = state.buttonState;
+        return imc.sendMessage(m);
+    }, &state});
 
     while (true)
     {
@@ -151,19 +172,12 @@ int main(void)
             led1Timer += loopUs;
             if(led1Timer >= led1IntervalUs)
             {
-                led1State = !led1State;
+                state.led1State = !state.led1State;
                 led1Timer = 0;
             }
+            state.buttonState = button.isPressed();
 
             imc.update(loopUs);
-
-            if(imc.hasCommunicationEstablished() && imc.canEnqueueMessage())
-            {
-                MessageToSend m{};
-                m.data.led1State = led1State;
-                m.data.buttonState = button.isPressed();
-                imc.sendMessage(m);
-            }
         }
     }
 }
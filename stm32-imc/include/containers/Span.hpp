@@ -11,6 +11,11 @@ namespace DynaSoft
 template<typename T>
 struct Span
 {
+    /// Creates empty span
+    Span() : from{nullptr}, to{nullptr}
+    {
+    }
+
     Span(T* begin_, T* end_) : from{begin_}, to{end_}
     {
         dyna_assert(end_ >= begin_);
@@ -38,18 +43,18 @@ struct Span
 
     std::size_t size() const
     {
-        return from - to;
+        return to - from;
     }
 
     T& operator[](int idx)
     {
-        dyna_assert(idx < size());
+        dyna_assert(static_cast<std::size_t>(idx) < size());
         return *(from + idx);
     }
 
     const T& operator[](int idx) const
     {
-        dyna_assert(idx < size());
+        dyna_assert(static_cast<std::size_t>(idx) < size());
         return *(from + idx);
     }
 
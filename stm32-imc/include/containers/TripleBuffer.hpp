@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <type_traits>
 #include <atomic>
+#include <array>
 
 namespace DynaSoft
 {
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <imc/ImcProtocol.hpp>
+#include "../containers/StaticVector.hpp"
+
+namespace DynaSoft
+{
+
+/// Collects small user messages, so that they can be sent in a single frame.
+///
+/// Frame with batched messages starts with ImcProtocol header with id ImcProtocol::batchMessageId
+/// and size equal to size of all batched entries. Each entry is a message without its crc field
+/// (header followed by contents padded to 4 bytes), so entries are always 4-byte aligned within frame.
+/// Whole frame is protected by single crc placed after last entry.
+///
+/// \tparam maxMessageSize Maximum size of frame, including header and crc.
+template<std::uint8_t maxMessageSize>
+class ImcBatcher
+{
+public:
+    using FrameBuffer = StaticVector<std::uint8_t, maxMessageSize>;
+
+    /// Appends message to batch.
+    /// Returns false if batch is disabled or there is no space for message in batch.
+    template<typename MessageT>
+    bool add(const MessageT& msg, std::uint8_t maxBatchSize)
+    {
+        constexpr std::uint8_t entrySize = sizeof(MessageT) - ImcProtocol::crcSize;
+        const std::uint8_t* data = reinterpret_cast<const std::uint8_t*>(&msg);
+
+        if(entrySize + ImcProtocol::headerSize + ImcProtocol::crcSize > std::min(maxBatchSize, maxMessageSize))
+        {
+            return false;
+        }
+
+        if(isEmpty())
+        {
+            frame.clear();
+            for(std::uint8_t i = 0; i < ImcProtocol::headerSize; ++i)
+            {
+                frame.push_back(0);
+            }
+        }
+        else if(frame.size() + entrySize + ImcProtocol::crcSize > std::min(maxBatchSize, maxMessageSize))
+        {
+            return false;
+        }
+
+        for(std::uint8_t i = 0; i < entrySize; ++i)
+        {
+            frame.push_back(data[i]);
+        }
+        entriesCount++;
+        return true;
+    }
+
+    /// Overwrites entry with the same id (and extendedId) as given message, if there is one in batch.
+    /// Returns true if entry was replaced.
+    template<typename MessageT>
+    bool replace(const MessageT& msg)
+    {
+        constexpr std::uint8_t entrySize = sizeof(MessageT) - ImcProtocol::crcSize;
+        const std::uint8_t* data = reinterpret_cast<const std::uint8_t*>(&msg);
+
+        if(isEmpty())
+        {
+            return false;
+        }
+
+        for(std::uint8_t offset = ImcProtocol::headerSize; offset < frame.size(); )
+        {
+            std::uint8_t* entry = frame.data() + offset;
+            if(entry[0] == MessageT::myId &&
+               entry[1] == MessageT::dataSize &&
+               *reinterpret_cast<std::uint16_t*>(entry + ImcProtocol::extendedIdOffset) == MessageT::myExtendedId)
+            {
+                std::copy(data, data + entrySize, entry);
+                return true;
+            }
+            offset += ImcProtocol::headerSize + ImcProtocol::paddedDataSize(entry[1]);
+        }
+        return false;
+    }
+
+    /// Returns true if message of given type would fit in current batch.
+    template<typename MessageT>
+    bool canAdd(std::uint8_t maxBatchSize) const
+    {
+        constexpr std::uint8_t entrySize = sizeof(MessageT) - ImcProtocol::crcSize;
+        std::uint16_t currentSize = isEmpty() ? ImcProtocol::headerSize : frame.size();
+        return currentSize + entrySize + ImcProtocol::crcSize <= std::min(maxBatchSize, maxMessageSize);
+    }
+
+    /// Returns true if there are no messages in batch.
+    bool isEmpty() const
+    {
+        return entriesCount == 0;
+    }
+
+    /// Returns number of messages in batch.
+    std::uint8_t size() const
+    {
+        return entriesCount;
+    }
+
+    /// Updates time for which oldest message in batch is waiting.
+    void updateTimer(std::uint32_t loopUs)
+    {
+        if(!isEmpty())
+        {
+            holdTimer += loopUs;
+        }
+    }
+
+    /// Returns true if messages in batch waited for at least given time.
+    bool isHoldTimeExceeded(std::uint32_t maxHoldUs) const
+    {
+        return !isEmpty() && holdTimer >= maxHoldUs;
+    }
+
+    /// Finalizes frame using given sequence, acknowledged sequence and crc function and returns it.
+    /// Frame is valid until clear() is called.
+    ///
+    /// If there is only one message in batch, it is returned as ordinary message frame, without batch header.
+    template<typename CrcFunc>
+    Span<std::uint8_t> finalize(std::uint16_t sequence, std::uint16_t ackSequence, CrcFunc&& computeCrc)
+    {
+        std::uint8_t* data = frame.data();
+        std::uint8_t entriesSize = frame.size() - ImcProtocol::headerSize;
+
+        if(entriesCount == 1)
+        {
+            data += ImcProtocol::headerSize;
+        }
+        else
+        {
+            data[0] = ImcProtocol::batchMessageId;
+            data[1] = entriesSize;
+        }
+
+        // Each entry has sequence of whole frame
+        for(std::uint8_t offset = ImcProtocol::headerSize; offset < frame.size(); )
+        {
+            std::uint8_t* entry = frame.data() + offset;
+            *reinterpret_cast<std::uint16_t*>(entry + ImcProtocol::sequenceOffset) = sequence;
+            offset += ImcProtocol::headerSize + ImcProtocol::paddedDataSize(entry[1]);
+        }
+        *reinterpret_cast<std::uint16_t*>(data + ImcProtocol::sequenceOffset) = sequence;
+        *reinterpret_cast<std::uint16_t*>(data + ImcProtocol::ackSequenceOffset) = ackSequence;
+
+        std::uint8_t headerAndContentsSize = ImcProtocol::headerSize + data[1];
+        std::uint32_t crc = computeCrc(data, headerAndContentsSize);
+        std::uint8_t frameSize = entriesCount == 1 ?
+            ImcProtocol::headerSize + ImcProtocol::paddedDataSize(data[1]) :
+            frame.size();
+        std::uint8_t* crcBytes = reinterpret_cast<std::uint8_t*>(&crc);
+        std::copy(crcBytes, crcBytes + ImcProtocol::crcSize, data + frameSize);
+        frameSize += ImcProtocol::crcSize;
+
+        return makeSpan(data, frameSize);
+    }
+
+    /// Removes all messages from batch.
+    void clear()
+    {
+        frame.clear();
+        entriesCount = 0;
+        holdTimer = 0;
+    }
+
+private:
+    // Room for crc of last entry is reserved by add(), so finalize() may append it in place
+    FrameBuffer frame{};
+    std::uint8_t entriesCount = 0;
+    std::uint32_t holdTimer = 0;
+};
+
+}
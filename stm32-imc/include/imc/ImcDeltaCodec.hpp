@@ -0,0 +1,184 @@
+#pragma once
+
+#include <imc/ImcProtocol.hpp>
+#include <array>
+#include <cstring>
+
+namespace DynaSoft
+{
+
+/// Sends state snapshots (messages re-sent periodically with mostly unchanged contents) as deltas
+/// to last keyframe, so that steady-state traffic carries only bitmap of changed bytes and those bytes.
+///
+/// Keyframe with all contents is sent first and then every keyframeInterval frames, so receiver recovers
+/// from lost keyframe after at most that many frames. It is also sent when delta wouldn't be smaller.
+/// Deltas are relative to keyframe instead of previous frame, so loss of delta doesn't affect next ones.
+///
+/// \tparam DeltaMessageT ImcProtocol::DeltaMessage sent over the wire.
+/// \tparam keyframeInterval Count of frames after which keyframe is sent again.
+template<typename DeltaMessageT, std::uint16_t keyframeInterval>
+class ImcDeltaEncoder
+{
+    static_assert(ImcProtocol::isDeltaMessage<DeltaMessageT>, "DeltaMessageT needs to be instantiation of ImcProtocol::DeltaMessage");
+    static_assert(keyframeInterval > 0, "ImcDeltaEncoder requires positive keyframeInterval");
+
+    using DeltaContents = typename DeltaMessageT::Data;
+    static constexpr std::uint8_t contentsSize = DeltaContents::contentsSize;
+    static constexpr std::uint8_t keyframeSize = ImcProtocol::deltaHeaderSize + contentsSize;
+
+public:
+    using Contents = typename DeltaContents::Contents;
+
+    /// Sends given contents as keyframe or delta to last keyframe.
+    /// Returns true if message was enqueued (see InterMcuCommunicationModule::sendMessage()).
+    template<typename ImcModule>
+    bool send(ImcModule& imc, const Contents& contents)
+    {
+        const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(&contents);
+
+        bool isKeyframe = !hasKeyframe || framesSinceKeyframe >= keyframeInterval;
+        std::uint8_t size = isKeyframe ? keyframeSize : encodeDelta(bytes);
+        if(size >= keyframeSize)
+        {
+            isKeyframe = true;
+            size = keyframeSize;
+            encodeKeyframe(bytes);
+        }
+
+        if(!imc.sendMessage(message, size))
+        {
+            return false;
+        }
+
+        if(isKeyframe)
+        {
+            std::memcpy(keyframe.data(), bytes, contentsSize);
+            keyframeNumber++;
+            hasKeyframe = true;
+            framesSinceKeyframe = 0;
+        }
+        framesSinceKeyframe++;
+        return true;
+    }
+
+    /// Next frame will be keyframe, i.e. when other device was reset.
+    void requestKeyframe()
+    {
+        hasKeyframe = false;
+    }
+
+private:
+    void encodeKeyframe(const std::uint8_t* bytes)
+    {
+        message.data.keyframeNumber = keyframeNumber + 1;
+        message.data.isKeyframe = 1;
+        std::memcpy(message.data.encoded.data(), bytes, contentsSize);
+    }
+
+    std::uint8_t encodeDelta(const std::uint8_t* bytes)
+    {
+        message.data.keyframeNumber = keyframeNumber;
+        message.data.isKeyframe = 0;
+
+        std::uint8_t* bitmap = message.data.encoded.data();
+        std::uint8_t* changed = bitmap + DeltaContents::bitmapSize;
+        std::fill(bitmap, changed, 0);
+        for(std::uint8_t i = 0; i < contentsSize; ++i)
+        {
+            if(bytes[i] != keyframe[i])
+            {
+                bitmap[i / 8] |= 1 << (i % 8);
+                *changed++ = bytes[i];
+            }
+        }
+        return changed - reinterpret_cast<std::uint8_t*>(&message.data);
+    }
+
+    DeltaMessageT message{};
+    std::array<std::uint8_t, contentsSize> keyframe{};
+    std::uint16_t framesSinceKeyframe = 0;
+    std::uint8_t keyframeNumber = 0;
+    bool hasKeyframe = false;
+};
+
+/// Rebuilds contents of MessageT from frames sent by ImcDeltaEncoder, using last received keyframe.
+template<typename MessageT>
+class ImcDeltaDecoder
+{
+    using DeltaContents = ImcProtocol::DeltaContents<MessageT>;
+    static constexpr std::uint8_t contentsSize = DeltaContents::contentsSize;
+
+public:
+    using Contents = typename MessageT::Data;
+
+    enum class Result
+    {
+        Decoded,
+        /// Delta refers to keyframe which wasn't received - it should be dropped until next keyframe
+        MissingKeyframe,
+        Invalid
+    };
+
+    /// Decodes delta contents of given size (as received in frame) to contents.
+    Result decode(const DeltaContents& delta, std::uint8_t size, Contents& contents)
+    {
+        std::uint8_t* output = reinterpret_cast<std::uint8_t*>(&contents);
+        const std::uint8_t* encoded = delta.encoded.data();
+        std::uint8_t encodedSize = size - ImcProtocol::deltaHeaderSize;
+
+        if(delta.isKeyframe)
+        {
+            if(encodedSize != contentsSize)
+            {
+                return Result::Invalid;
+            }
+            std::memcpy(keyframe.data(), encoded, contentsSize);
+            std::memcpy(output, encoded, contentsSize);
+            keyframeNumber = delta.keyframeNumber;
+            hasKeyframe = true;
+            return Result::Decoded;
+        }
+
+        if(encodedSize < DeltaContents::bitmapSize)
+        {
+            return Result::Invalid;
+        }
+        if(!hasKeyframe || delta.keyframeNumber != keyframeNumber)
+        {
+            return Result::MissingKeyframe;
+        }
+
+        const std::uint8_t* changed = encoded + DeltaContents::bitmapSize;
+        const std::uint8_t* end = encoded + encodedSize;
+        for(std::uint8_t i = 0; i < contentsSize; ++i)
+        {
+            bool isChanged = encoded[i / 8] & (1 << (i % 8));
+            if(isChanged && changed == end)
+            {
+                return Result::Invalid;
+            }
+            output[i] = isChanged ? *changed++ : keyframe[i];
+        }
+        return changed == end ? Result::Decoded : Result::Invalid;
+    }
+
+private:
+    std::array<std::uint8_t, contentsSize> keyframe{};
+    std::uint8_t keyframeNumber = 0;
+    bool hasKeyframe = false;
+};
+
+/// Has member type with ImcDeltaDecoder of Message if it is ImcProtocol::DeltaMessage, empty type otherwise.
+template<typename Message, bool = ImcProtocol::isDeltaMessage<Message>>
+struct ImcDeltaDecoderOf
+{
+    struct type {};
+};
+
+template<typename Message>
+struct ImcDeltaDecoderOf<Message, true>
+{
+    using type = ImcDeltaDecoder<typename Message::Data::Decoded>;
+};
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <imc/ImcProtocol.hpp>
+#include <misc/Callback.hpp>
+#include "../containers/Span.hpp"
+
+namespace DynaSoft
+{
+
+/// Splits message larger than single frame into fragments, which are transmitted in place from caller's memory.
+///
+/// Only one fragment is in flight at the time - next one is available after previous was transmitted,
+/// so other user messages wait for at most one fragment frame during transfer.
+///
+/// \tparam maxFragmentSize Maximum size of fragment data in single frame, multiple of 4.
+template<std::uint8_t maxFragmentSize>
+class ImcFragmenter
+{
+    static_assert(maxFragmentSize % 4 == 0, "ImcFragmenter requires fragment size to be multiple of 4");
+
+public:
+    /// Called from UART interrupt when last fragment is transmitted and message memory may be reused.
+    using SentCallback = Callback<void(CallbackContext)>;
+
+    /// Starts transfer of given message. Message must stay unchanged until onSent is called.
+    /// Returns false if other transfer is in progress or message is empty or larger than 65535 bytes.
+    bool start(std::uint16_t messageId_, Span<const std::uint8_t> message_, SentCallback onSent_)
+    {
+        if(isBusy() || message_.size() == 0 || message_.size() > 0xFFFF)
+        {
+            return false;
+        }
+
+        messageId = messageId_;
+        message = message_;
+        onSent = onSent_;
+        offset = 0;
+        isActive = true;
+        return true;
+    }
+
+    /// Returns true if transfer is in progress or its last fragment is still being transmitted.
+    bool isBusy() const
+    {
+        return isActive || isFragmentInFlight;
+    }
+
+    /// Returns true if next fragment may be enqueued.
+    bool hasNextFragment() const
+    {
+        return isActive && !isFragmentInFlight && offset < message.size();
+    }
+
+    /// Fills header of next fragment and returns its data.
+    Span<const std::uint8_t> nextFragment(ImcProtocol::FragmentHeader& header) const
+    {
+        std::uint16_t size = std::min<std::uint16_t>(maxFragmentSize, message.size() - offset);
+        header.messageId = messageId;
+        header.totalSize = message.size();
+        header.offset = offset;
+        return makeSpan(message.begin() + offset, size);
+    }
+
+    /// Should be called before fragment returned by nextFragment() is enqueued for sending,
+    /// as it may be transmitted (and onFragmentSent() called) before enqueueing returns.
+    void onFragmentEnqueued(std::uint8_t size)
+    {
+        offset = offset + size;
+        isFragmentInFlight = true;
+    }
+
+    /// Reverts onFragmentEnqueued() if fragment couldn't be enqueued.
+    void onFragmentEnqueueFailed(std::uint8_t size)
+    {
+        offset = offset - size;
+        isFragmentInFlight = false;
+    }
+
+    /// Should be called from UART interrupt when enqueued fragment was transmitted.
+    void onFragmentSent()
+    {
+        isFragmentInFlight = false;
+        if(isActive && offset == message.size())
+        {
+            isActive = false;
+            onSent();
+        }
+    }
+
+    /// Aborts transfer in progress, without calling its onSent.
+    void cancel()
+    {
+        isActive = false;
+    }
+
+private:
+    Span<const std::uint8_t> message{};
+    SentCallback onSent{};
+    std::uint16_t messageId = 0;
+    volatile std::uint16_t offset = 0;
+    volatile bool isActive = false;
+    volatile bool isFragmentInFlight = false;
+};
+
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <imc/ImcProtocol.hpp>
+#include <imc/ImcSettings.hpp>
+#include <peripheral/UartBase.hpp>
+#include <algorithm>
+#include <optional>
+
+namespace DynaSoft
+{
+
+/// Negotiates parameters of link with other device and switches UART to the highest baud rate supported by both.
+///
+/// After communication is established at base baud rate (the one UART is initialized with), slave sends ImcProtocol::Capabilities
+/// (repeated every ImcSettings::slaveHandshakeIntervalUs until response) and master responds with its own ones
+/// and selected baud rate. Both devices switch UART as soon as their queued frames are transmitted (new user frames
+/// are not accepted meanwhile) and then communication is established again at new rate.
+///
+/// If it isn't established in ImcSettings::baudSwitchTimeoutUs, base rate is restored and failed rate is not
+/// advertised again until communication is lost. When established communication is lost, base rate is restored
+/// and negotiation starts over, as other device might have been reset.
+///
+/// Baud rate is not changed if framing or crc feed of devices differ.
+/// Idle line times of UART are scaled with baud rate, so that they last the same count of characters.
+///
+/// Master also adapts baud rate to quality of link (see ImcSettings::linkQualityWindowUs). It counts received frames
+/// and link errors (frames dropped by either device) in consecutive windows. If errors exceed
+/// ImcSettings::maxLinkErrorPermille of frames in window, it steps down to next lower common baud rate, which also
+/// becomes the highest one selected by negotiation. After ImcSettings::cleanWindowsToStepUp windows without errors,
+/// it tries next higher rate - count of required windows is doubled after each step down, so that unstable rate
+/// is not retried too often. Master sends selected rate in Capabilities and both devices switch as after negotiation.
+///
+/// \tparam Uart Concrete implementation of UartBase class.
+template<typename Uart>
+class ImcLinkNegotiator
+{
+public:
+    ImcLinkNegotiator(Uart& uart_, ImcSettings& settings_, const ImcProtocol::CapabilitiesContents& ownCapabilities_) :
+        uart{uart_},
+        settings{settings_},
+        ownCapabilities{ownCapabilities_},
+        baseBaudRate{uart.getBaudRate()},
+        baseCheckForIdleTimeUs{uart.getCheckForIdleTimeUs()},
+        baseGenerateIdleTimeUs{uart.getGenerateIdleTimeUs()}
+    {
+    }
+
+    void updateTimers(std::uint32_t loopUs)
+    {
+        requestTimer += loopUs;
+        qualityTimer += loopUs;
+        if(isWaitingForCommunication)
+        {
+            switchTimer += loopUs;
+            if(switchTimer >= settings.baudSwitchTimeoutUs)
+            {
+                // Link doesn't work at this rate
+                failedBaudRates |= 1 << baudRateIndex;
+                isWaitingForCommunication = false;
+                isNegotiated = false;
+                requestSwitch(ImcProtocol::baseBaudRateIndex);
+            }
+        }
+    }
+
+    /// Returns capabilities of this device with given selected baud rate.
+    ImcProtocol::CapabilitiesContents getCapabilities(std::uint8_t selectedBaudRate = ImcProtocol::baseBaudRateIndex) const
+    {
+        ImcProtocol::CapabilitiesContents capabilities = ownCapabilities;
+        capabilities.baudRates = getSupportedBaudRates();
+        capabilities.selectedBaudRate = selectedBaudRate;
+        return capabilities;
+    }
+
+    /// Returns capabilities received from other device (all zeros if they weren't received).
+    const ImcProtocol::CapabilitiesContents& getPeerCapabilities() const
+    {
+        return peerCapabilities;
+    }
+
+    /// Returns current baud rate of UART.
+    std::uint32_t getBaudRate() const
+    {
+        return getBaudRate(baudRateIndex);
+    }
+
+    /// Returns ratio of link errors to frames in last finished window, in permille.
+    std::uint16_t getLinkErrorPermille() const
+    {
+        return linkErrorPermille;
+    }
+
+    void onFrameReceived()
+    {
+        receivedFrames++;
+    }
+
+    /// Called when received frame is dropped or other device reports dropped frame.
+    void onLinkError()
+    {
+        linkErrors++;
+    }
+
+    /// Evaluates link quality when window passes (on master, while communication is established).
+    /// Returns baud rate which should be switched to, if it should be changed.
+    std::optional<std::uint8_t> adaptBaudRate()
+    {
+        if(settings.linkQualityWindowUs == 0 || !isNegotiated || isSwitchPending || qualityTimer < settings.linkQualityWindowUs)
+        {
+            return std::nullopt;
+        }
+
+        std::uint32_t frames = receivedFrames + linkErrors;
+        linkErrorPermille = frames > 0 ? static_cast<std::uint64_t>(linkErrors) * 1000 / frames : 0;
+        bool isClean = receivedFrames > 0 && linkErrors == 0;
+        resetLinkQuality();
+
+        if(linkErrorPermille > settings.maxLinkErrorPermille)
+        {
+            cleanWindows = 0;
+            stepUpBackoff = std::min<std::uint8_t>(stepUpBackoff + 1, maxStepUpBackoff);
+            std::uint8_t lower = findLowerBaudRate();
+            allowedBaudRates = ratesUpTo(lower);
+            return lower != baudRateIndex ? std::optional<std::uint8_t>{lower} : std::nullopt;
+        }
+
+        cleanWindows = isClean ? cleanWindows + 1 : 0;
+        if(cleanWindows >= (static_cast<std::uint32_t>(settings.cleanWindowsToStepUp) << stepUpBackoff))
+        {
+            cleanWindows = 0;
+            std::uint8_t higher = findHigherBaudRate();
+            allowedBaudRates = ratesUpTo(higher);
+            return higher != baudRateIndex ? std::optional<std::uint8_t>{higher} : std::nullopt;
+        }
+        return std::nullopt;
+    }
+
+    /// Returns true if slave should send its Capabilities.
+    bool shouldSendRequest(std::uint32_t intervalUs) const
+    {
+        return settings.supportedBaudRates != 0 && !isNegotiated && !isSwitchPending &&
+               (!isRequestSent || requestTimer >= intervalUs);
+    }
+
+    void onRequestSent()
+    {
+        isRequestSent = true;
+        requestTimer = 0;
+    }
+
+    /// Handles response of master - switches to selected baud rate.
+    void onResponseReceived(const ImcProtocol::CapabilitiesContents& response)
+    {
+        peerCapabilities = response;
+        isNegotiated = true;
+        requestSwitch(response.selectedBaudRate);
+    }
+
+    /// Handles request of slave - returns highest baud rate supported by both devices.
+    /// Returned rate should be switched to with requestSwitch() after response is sent.
+    std::uint8_t selectBaudRate(const ImcProtocol::CapabilitiesContents& request)
+    {
+        peerCapabilities = request;
+        isNegotiated = true;
+
+        if(request.framing != ownCapabilities.framing || request.crcFeed != ownCapabilities.crcFeed)
+        {
+            return ImcProtocol::baseBaudRateIndex;
+        }
+
+        std::uint8_t common = getSupportedBaudRates() & allowedBaudRates & request.baudRates;
+        for(std::uint8_t i = ImcProtocol::negotiatedBaudRates.size(); i > 0; --i)
+        {
+            if(common & (1 << (i - 1)))
+            {
+                return i - 1;
+            }
+        }
+        return ImcProtocol::baseBaudRateIndex;
+    }
+
+    /// Schedules switch to given baud rate (index in ImcProtocol::negotiatedBaudRates or baseBaudRateIndex).
+    void requestSwitch(std::uint8_t index)
+    {
+        pendingBaudRateIndex = index;
+        isSwitchPending = index != baudRateIndex;
+    }
+
+    /// Returns true if UART should switch baud rate as soon as all frames are transmitted.
+    bool hasPendingSwitch() const
+    {
+        return isSwitchPending;
+    }
+
+    /// Changes baud rate of UART - should be called when there is no ongoing transmission.
+    /// Communication should be established again afterwards.
+    void applyPendingSwitch()
+    {
+        baudRateIndex = pendingBaudRateIndex;
+        isSwitchPending = false;
+
+        std::uint32_t baudRate = getBaudRate(baudRateIndex);
+        uart.setBaudRate(
+            baudRate,
+            scaleIdleTime(baseCheckForIdleTimeUs, baudRate),
+            scaleIdleTime(baseGenerateIdleTimeUs, baudRate)
+        );
+
+        // Base rate is assumed to always work
+        isWaitingForCommunication = baudRateIndex != ImcProtocol::baseBaudRateIndex;
+        switchTimer = 0;
+        resetLinkQuality();
+    }
+
+    void onCommunicationEstablished()
+    {
+        isWaitingForCommunication = false;
+        isRequestSent = false;
+    }
+
+    void onCommunicationLost()
+    {
+        peerCapabilities = {};
+        failedBaudRates = 0;
+        allowedBaudRates = 0xFF;
+        stepUpBackoff = 0;
+        cleanWindows = 0;
+        isNegotiated = false;
+        isWaitingForCommunication = false;
+        requestSwitch(ImcProtocol::baseBaudRateIndex);
+    }
+
+private:
+    static constexpr std::uint8_t maxStepUpBackoff = 4;
+
+    static std::uint8_t ratesUpTo(std::uint8_t index)
+    {
+        return index == ImcProtocol::baseBaudRateIndex ? 0 : static_cast<std::uint8_t>((2u << index) - 1);
+    }
+
+    std::uint8_t getCommonBaudRates() const
+    {
+        return getSupportedBaudRates() & peerCapabilities.baudRates;
+    }
+
+    std::uint8_t findLowerBaudRate() const
+    {
+        std::uint8_t common = getCommonBaudRates();
+        for(std::uint8_t i = baudRateIndex == ImcProtocol::baseBaudRateIndex ? 0 : baudRateIndex; i > 0; --i)
+        {
+            if(common & (1 << (i - 1)))
+            {
+                return i - 1;
+            }
+        }
+        return ImcProtocol::baseBaudRateIndex;
+    }
+
+    std::uint8_t findHigherBaudRate() const
+    {
+        std::uint8_t common = getCommonBaudRates();
+        std::uint8_t first = baudRateIndex == ImcProtocol::baseBaudRateIndex ? 0 : baudRateIndex + 1;
+        for(std::uint8_t i = first; i < ImcProtocol::negotiatedBaudRates.size(); ++i)
+        {
+            if(common & (1 << i))
+            {
+                return i;
+            }
+        }
+        return baudRateIndex;
+    }
+
+    void resetLinkQuality()
+    {
+        receivedFrames = 0;
+        linkErrors = 0;
+        qualityTimer = 0;
+    }
+
+    std::uint8_t getSupportedBaudRates() const
+    {
+        return settings.supportedBaudRates & ~failedBaudRates;
+    }
+
+    std::uint32_t getBaudRate(std::uint8_t index) const
+    {
+        return index == ImcProtocol::baseBaudRateIndex ? baseBaudRate : ImcProtocol::negotiatedBaudRates[index];
+    }
+
+    std::uint32_t scaleIdleTime(std::uint32_t baseTimeUs, std::uint32_t baudRate) const
+    {
+        std::uint32_t timeUs = static_cast<std::uint64_t>(baseTimeUs) * baseBaudRate / baudRate;
+        return timeUs > 0 ? timeUs : 1;
+    }
+
+    Uart& uart;
+    ImcSettings& settings;
+    ImcProtocol::CapabilitiesContents ownCapabilities;
+    ImcProtocol::CapabilitiesContents peerCapabilities{};
+    std::uint32_t baseBaudRate;
+    std::uint32_t baseCheckForIdleTimeUs;
+    std::uint32_t baseGenerateIdleTimeUs;
+
+    std::uint8_t baudRateIndex = ImcProtocol::baseBaudRateIndex;
+    std::uint8_t pendingBaudRateIndex = ImcProtocol::baseBaudRateIndex;
+    std::uint8_t failedBaudRates = 0;
+    bool isSwitchPending = false;
+    bool isNegotiated = false;
+    bool isWaitingForCommunication = false;
+    bool isRequestSent = false;
+    std::uint32_t requestTimer = 0;
+    std::uint32_t switchTimer = 0;
+
+    // Adaptation to link quality
+    std::uint8_t allowedBaudRates = 0xFF;
+    std::uint8_t stepUpBackoff = 0;
+    std::uint16_t linkErrorPermille = 0;
+    std::uint32_t cleanWindows = 0;
+    std::uint32_t receivedFrames = 0;
+    std::uint32_t linkErrors = 0;
+    std::uint32_t qualityTimer = 0;
+};
+
+}
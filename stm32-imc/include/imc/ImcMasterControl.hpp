@@ -18,28 +18,34 @@ namespace DynaSoft
 ///
 /// Then checks if any message was received in some period (ImcSettings::masterCommunicationTimeoutUs).
 /// If not then assumes slave device was reset and moves to reset state itself.
-/// Responds to KeepAlive messages with Acknowledge.
+/// Responds to KeepAlive messages with Acknowledge, unless some other message was sent to slave
+/// in last ImcSettings::slaveKeepAliveIntervalUs - it already acknowledged received data in its header.
 ///
-/// Should handle receiver errors but for now they are just ignored - no application requires it.
-template<typename Uart, std::uint8_t maxMessageSize>
+/// Received ReceiveErrors are passed to ImcModule, which retransmits lost frames in reliable mode.
+///
+/// Responds to Capabilities with its own ones and selected baud rate, which is switched to after response
+/// is transmitted (see ImcLinkNegotiator). When baud rate is adapted to link quality, sends Capabilities
+/// with new selected baud rate on its own.
+template<typename Uart, typename Receiver, typename Sender>
 class ImcMasterControl : public ImcRecipent<
-        ImcMasterControl<Uart, maxMessageSize>,
+        ImcMasterControl<Uart, Receiver, Sender>,
         ImcProtocol::controlMessageRecipient,
         ImcProtocol::Handshake,
         ImcProtocol::KeepAlive,
-        ImcProtocol::ReceiveError
+        ImcProtocol::ReceiveError,
+        ImcProtocol::Capabilities
     >
 {
     template<typename, std::uint8_t, typename...>
     friend class ImcRecipent; // for handleMessage to be private
 
 public:
-    using ReceivedMessage = typename ImcReceiver<Uart, maxMessageSize>::MessageBuffer;
+    using ReceivedMessage = typename Receiver::MessageBuffer;
 
     ImcMasterControl(
         Uart& uart_,
-        ImcReceiver<Uart, maxMessageSize>& receiver_,
-        ImcSender<Uart, maxMessageSize>& sender_,
+        Receiver& receiver_,
+        Sender& sender_,
         ImcSettings& settings_
     ) :
         uart{uart_},
@@ -52,14 +58,20 @@ public:
     void updateTimers(std::uint32_t loopUs)
     {
         communicationTimeoutTimer += loopUs;
+        lastSentTimer += loopUs;
     }
 
     template<typename ImcModule>
-    void updateStatus(ImcModule&)
+    void updateStatus(ImcModule& imc)
     {
-        if(communicationTimeoutTimer >= settings.masterCommunicationTimeoutUs)
+        if(communicationIsEstablished && communicationTimeoutTimer >= settings.masterCommunicationTimeoutUs)
         {
             communicationIsEstablished = false;
+            imc.getLinkNegotiator().onCommunicationLost();
+        }
+        if(communicationIsEstablished)
+        {
+            adaptBaudRate(imc);
         }
     }
 
@@ -70,6 +82,7 @@ public:
 
     void onMessageSent()
     {
+        lastSentTimer = 0;
     }
 
     void onMessageReceived()
@@ -77,6 +90,12 @@ public:
         communicationTimeoutTimer = 0;
     }
 
+    /// Moves to reset state, so that slave needs to establish communication again.
+    void resetCommunication()
+    {
+        communicationIsEstablished = false;
+    }
+
 private:
     template<typename ImcModule>
     bool handleMessage(ImcProtocol::Handshake& m, ImcModule& imc)
@@ -87,6 +106,7 @@ private:
         imc.sendMessage(ack);
 
         communicationIsEstablished = true;
+        imc.getLinkNegotiator().onCommunicationEstablished();
 
         return true;
     }
@@ -94,7 +114,7 @@ private:
     template<typename ImcModule>
     bool handleMessage(ImcProtocol::KeepAlive& m, ImcModule& imc)
     {
-        if(communicationIsEstablished)
+        if(communicationIsEstablished && lastSentTimer >= settings.slaveKeepAliveIntervalUs)
         {
             ImcProtocol::Acknowledge ack{};
             ack.data.ackId = ImcProtocol::KeepAlive::myId;
@@ -107,15 +127,54 @@ private:
     template<typename ImcModule>
     bool handleMessage(ImcProtocol::ReceiveError& m, ImcModule& imc)
     {
+        if(communicationIsEstablished)
+        {
+            imc.onReceiveErrorReceived(m.data.lastOkSequence, m.data.reason);
+        }
         return true;
     }
 
+    template<typename ImcModule>
+    bool handleMessage(ImcProtocol::Capabilities& m, ImcModule& imc)
+    {
+        if(communicationIsEstablished)
+        {
+            auto& negotiator = imc.getLinkNegotiator();
+            std::uint8_t selectedBaudRate = negotiator.selectBaudRate(m.data);
+
+            ImcProtocol::Capabilities response{};
+            response.data = negotiator.getCapabilities(selectedBaudRate);
+            if(imc.sendMessage(response))
+            {
+                negotiator.requestSwitch(selectedBaudRate);
+            }
+        }
+        return true;
+    }
+
+    template<typename ImcModule>
+    void adaptBaudRate(ImcModule& imc)
+    {
+        auto& negotiator = imc.getLinkNegotiator();
+        if(auto selectedBaudRate = negotiator.adaptBaudRate())
+        {
+            // Slave switches when it receives Capabilities, same as after negotiation
+            ImcProtocol::Capabilities command{};
+            command.data = negotiator.getCapabilities(*selectedBaudRate);
+            if(imc.sendMessage(command))
+            {
+                negotiator.requestSwitch(*selectedBaudRate);
+            }
+        }
+    }
+
     Uart& uart;
-    ImcReceiver<Uart, maxMessageSize>& receiver;
-    ImcSender<Uart, maxMessageSize>& sender;
+    Receiver& receiver;
+    Sender& sender;
 
     ImcSettings& settings;
     std::uint32_t communicationTimeoutTimer = 0;
+    std::uint32_t lastSentTimer = 0;
     bool communicationIsEstablished = false;
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <misc/Meta.hpp>
+#include <array>
 #include <cstdint>
 #include <type_traits>
 #include <algorithm>
@@ -9,14 +11,69 @@ namespace DynaSoft
 namespace ImcProtocol
 {
 
+/// Priority class of message. When UART finishes frame, ImcSender starts oldest frame with highest priority.
+/// Control messages have normal priority.
+enum class Priority : std::uint8_t
+{
+    High,
+    Normal,
+    Low
+};
+
+constexpr std::uint8_t priorityClassesCount = 3;
+
+namespace detail
+{
+template<typename Id, typename = void>
+struct ExtendedId
+{
+    static constexpr std::uint16_t value = 0;
+};
+
+template<typename Id>
+struct ExtendedId<Id, std::void_t<decltype(Id::extended)>>
+{
+    static constexpr std::uint16_t value = Id::extended;
+};
+
+template<typename Id, typename = void>
+struct PriorityOfId
+{
+    static constexpr Priority value = Priority::Normal;
+};
+
+template<typename Id>
+struct PriorityOfId<Id, std::void_t<decltype(Id::priority)>>
+{
+    static constexpr Priority value = Id::priority;
+};
+
+template<typename Id, typename = void>
+struct IsLatestValueId
+{
+    static constexpr bool value = false;
+};
+
+template<typename Id>
+struct IsLatestValueId<Id, std::void_t<decltype(Id::isLatestValue)>>
+{
+    static constexpr bool value = Id::isLatestValue;
+};
+}
+
 /// Base type for all messages sent between MCUs via UART.
 ///
 /// Contains unique id with 2 MSB being recipient (application module) number.
 /// Recipient 0 is for control messages.
+/// extendedId is 16-bit id of wide messages (see WideMessage) and 0 for other ones.
+/// myPriority is priority class of user message (see PriorityMessage), it is not sent.
+/// isLatestValue indicates that only newest unsent instance of message is kept (see StateMessage).
 /// size indicates size of MessageContents (0 if empty).
 /// sequence defines order in which messages where sent.
+/// ackSequence is sequence of last message received from other device (cumulative acknowledgement),
+/// so any message serves as proof that other device receives data.
 /// crc is used to validate contents of received message and is computed byte by byte
-/// over first 4 + dataSize bytes.
+/// over first headerSize + dataSize bytes.
 ///
 /// All those field are set by ImcModule.
 ///
@@ -27,17 +84,22 @@ namespace ImcProtocol
 template<typename MessageContents, typename Id>
 struct MessageBase
 {
-    // 244 - so that type std::uint8_t can hold size of whole message including possible paddings after 'data'
-    static_assert(sizeof(MessageContents) <= 244, "sizeof(MessageContents) must be <= 244");
+    // 240 - so that type std::uint8_t can hold size of whole message including possible paddings after 'data'
+    static_assert(sizeof(MessageContents) <= 240, "sizeof(MessageContents) must be <= 240");
 
     using Data = MessageContents;
 
     static constexpr std::uint8_t myId = Id::value;
+    static constexpr std::uint16_t myExtendedId = detail::ExtendedId<Id>::value;
+    static constexpr Priority myPriority = detail::PriorityOfId<Id>::value;
+    static constexpr bool isLatestValue = detail::IsLatestValueId<Id>::value;
     static constexpr std::uint8_t dataSize = std::is_empty_v<MessageContents> ? 0 : sizeof(MessageContents);
 
     std::uint8_t id = myId;
     std::uint8_t size = dataSize;
     std::uint16_t sequence = 0;
+    std::uint16_t ackSequence = 0;
+    std::uint16_t extendedId = myExtendedId;
 
     MessageContents data;
 
@@ -47,6 +109,32 @@ struct MessageBase
 template<typename MessageContents, std::uint8_t myId>
 using Message = MessageBase<MessageContents, std::integral_constant<std::uint8_t, myId>>;
 
+template<std::uint8_t id, Priority priority_>
+struct PriorityId
+{
+    static constexpr std::uint8_t value = id;
+    static constexpr Priority priority = priority_;
+};
+
+/// User message with priority class other than Priority::Normal.
+template<typename MessageContents, std::uint8_t myId, Priority priority>
+using PriorityMessage = MessageBase<MessageContents, PriorityId<myId, priority>>;
+
+template<std::uint8_t id, Priority priority_>
+struct StateId
+{
+    static constexpr std::uint8_t value = id;
+    static constexpr Priority priority = priority_;
+    static constexpr bool isLatestValue = true;
+};
+
+/// User message carrying state, of which only latest value is relevant (latest-value mailbox).
+/// If instance of such message is still waiting in batch or send queue when next one is sent,
+/// its contents are overwritten in place instead of enqueuing new frame, so fresher data is never
+/// rejected or sent after stale one.
+template<typename MessageContents, std::uint8_t myId, Priority priority = Priority::Normal>
+using StateMessage = MessageBase<MessageContents, StateId<myId, priority>>;
+
 template<typename T>
 inline std::uint8_t* encode(T& message)
 {
@@ -77,19 +165,91 @@ struct AckMessageContents
     {}
 };
 
+/// Cause of ReceiveError. Only LinkError is counted as error of the link (see ImcLinkNegotiator).
+enum class ReceiveErrorReason : std::uint8_t
+{
+    /// Frame was corrupted or lost
+    LinkError,
+    /// Frame was received correctly, but its recipient rejected it
+    Rejected
+};
+
 struct ReceiveErrorContents
 {
     std::uint16_t lastOkSequence = 0;
-    std::uint16_t _ = 0;
+    ReceiveErrorReason reason = ReceiveErrorReason::LinkError;
+    std::uint8_t _ = 0;
 
     ReceiveErrorContents() = default;
 
-    ReceiveErrorContents(std::uint16_t lastOkSequence_) :
-        lastOkSequence{lastOkSequence_}
+    ReceiveErrorContents(std::uint16_t lastOkSequence_, ReceiveErrorReason reason_ = ReceiveErrorReason::LinkError) :
+        lastOkSequence{lastOkSequence_},
+        reason{reason_}
     {}
 };
 
+/// Baud rates which may be negotiated by devices. Supported ones are given as bit mask of indices in this array.
+constexpr std::array<std::uint32_t, 8> negotiatedBaudRates = {
+    115200, 230400, 460800, 921600, 1000000, 1500000, 2000000, 2250000
+};
+
+/// Index of baud rate used when no other one is selected (the one UART is initialized with).
+constexpr std::uint8_t baseBaudRateIndex = 0xFF;
+
+/// Parameters of link supported by device, exchanged after communication is established (see ImcLinkNegotiator).
+struct CapabilitiesContents
+{
+    /// Bit mask of indices in negotiatedBaudRates
+    std::uint8_t baudRates = 0;
+    /// Maximum size of received frame
+    std::uint8_t maxMessageSize = 0;
+    /// Count of received frames which may wait for processing
+    std::uint8_t receiveQueueSize = 0;
+    /// UartFraming used by device
+    std::uint8_t framing = 0;
+    /// CrcFeed used by device
+    std::uint8_t crcFeed = 0;
+    /// Index of baud rate selected by master or baseBaudRateIndex (in Capabilities sent by slave it is ignored)
+    std::uint8_t selectedBaudRate = baseBaudRateIndex;
+    std::uint16_t _ = 0;
+};
+
+/// Size of fields preceding MessageContents in MessageBase.
+constexpr std::uint8_t headerSize = 8;
+
+/// Offset of sequence field in MessageBase.
+constexpr std::uint8_t sequenceOffset = 2;
+
+/// Offset of ackSequence field in MessageBase.
+constexpr std::uint8_t ackSequenceOffset = 4;
+
+/// Offset of extendedId field in MessageBase.
+constexpr std::uint8_t extendedIdOffset = 6;
+
+/// Fields preceding MessageContents in MessageBase.
+/// Used when message is sent in parts, without whole MessageBase object.
+struct Header
+{
+    std::uint8_t id = 0;
+    std::uint8_t size = 0;
+    std::uint16_t sequence = 0;
+    std::uint16_t ackSequence = 0;
+    std::uint16_t extendedId = 0;
+};
+static_assert(sizeof(Header) == headerSize, "Header must have same layout as fields in MessageBase");
+
+/// Size of crc field in MessageBase.
+constexpr std::uint8_t crcSize = 4;
+
+/// Returns size of MessageContents with padding added before crc.
+/// As crc is 4-byte aligned, message contents are padded to 4 bytes (empty contents still take 4 bytes).
+constexpr std::uint8_t paddedDataSize(std::uint8_t dataSize)
+{
+    return dataSize > 4 ? dataSize + 3 - ((dataSize + 3) % 4) : 4;
+}
+
 constexpr std::uint8_t messageRecipientMask = 0xC0;
+constexpr std::uint8_t messageNumberMask = 0x3F;
 
 constexpr std::uint8_t makeRecipientId(std::uint8_t recipientNumber)
 {
@@ -98,7 +258,12 @@ constexpr std::uint8_t makeRecipientId(std::uint8_t recipientNumber)
 
 constexpr std::uint8_t makeMessageId(std::uint8_t recipientNumber, std::uint8_t messageNumber)
 {
-    return (recipientNumber << 6) | (messageNumber & 0x3F);
+    return (recipientNumber << 6) | (messageNumber & messageNumberMask);
+}
+
+constexpr std::uint8_t getMessageNumber(std::uint8_t messageId)
+{
+    return messageId & messageNumberMask;
 }
 
 constexpr std::uint8_t getRecipientNumber(std::uint8_t messageId)
@@ -114,17 +279,127 @@ using Handshake = Message<EmptyMessageContents, makeMessageId(controlMessageReci
 /// Acknowledge is used to respond to Handshake and KeepAlive messages sent by Slave (sent by Master only)
 using Acknowledge = Message<AckMessageContents, makeMessageId(controlMessageRecipient, 0x02)>;
 
-/// ReceiveError is used to respond when received data is corrupted and dropped (sent by both sides)
+/// ReceiveError is used to respond when received data is corrupted and dropped or rejected by recipient (sent by both sides)
 using ReceiveError = Message<ReceiveErrorContents, makeMessageId(controlMessageRecipient, 0x03)>;
 
 /// KeepAlive is used to keep communication alive by Slave (sent by Slave only)
 using KeepAlive = Message<EmptyMessageContents, makeMessageId(controlMessageRecipient, 0x04)>;
 
+/// Id of frame which contains several batched user messages (sent by both sides).
+/// It is not a Message type, as its size depends on batched messages - see ImcBatcher.
+constexpr std::uint8_t batchMessageId = makeMessageId(controlMessageRecipient, 0x05);
+
+/// Id of user message with 16-bit id kept in extendedId field (sent by both sides), see WideMessage.
+constexpr std::uint8_t wideMessageId = makeMessageId(controlMessageRecipient, 0x06);
+
+/// Id of user message carrying fragment of message larger than single frame (sent by both sides).
+/// Its contents start with FragmentHeader, followed by fragment data.
+constexpr std::uint8_t fragmentMessageId = makeMessageId(controlMessageRecipient, 0x07);
+
+/// Capabilities are sent by Slave after communication is established and by Master in response, with selected baud rate
+using Capabilities = Message<CapabilitiesContents, makeMessageId(controlMessageRecipient, 0x08)>;
+
+/// Returns true if id is of control message (not of batch, wide message or fragment, which carry user messages).
+constexpr bool isControlMessageId(std::uint8_t messageId)
+{
+    return getRecipientNumber(messageId) == controlMessageRecipient &&
+           messageId != batchMessageId && messageId != wideMessageId && messageId != fragmentMessageId;
+}
+
+struct FragmentHeader
+{
+    /// User defined id of whole message
+    std::uint16_t messageId = 0;
+    /// Size of whole message
+    std::uint16_t totalSize = 0;
+    /// Offset of fragment data in whole message
+    std::uint16_t offset = 0;
+    std::uint16_t _ = 0;
+};
+
+constexpr std::uint8_t fragmentHeaderSize = sizeof(FragmentHeader);
+static_assert(fragmentHeaderSize % 4 == 0, "FragmentHeader size should be multiple of 4");
+
+/// Split of 16-bit id of wide messages into recipient number (high bits) and message number (low bits).
+///
+/// Recipients table of InterMcuCommunicationModule has entry for each recipient number,
+/// so recipientBits should be kept small.
+template<std::uint8_t recipientBits>
+struct WideIdLayout
+{
+    static_assert(recipientBits > 0 && recipientBits < 16, "WideIdLayout requires 1-15 recipient bits");
+
+    static constexpr std::uint8_t messageBits = 16 - recipientBits;
+    static constexpr std::uint16_t recipientsCount = 1 << recipientBits;
+    static constexpr std::uint16_t messageNumberMask = (1 << messageBits) - 1;
+
+    static constexpr std::uint16_t makeId(std::uint16_t recipientNumber, std::uint16_t messageNumber)
+    {
+        return (recipientNumber << messageBits) | (messageNumber & messageNumberMask);
+    }
+
+    static constexpr std::uint16_t getRecipientNumber(std::uint16_t wideId)
+    {
+        return wideId >> messageBits;
+    }
+
+    static constexpr std::uint16_t getMessageNumber(std::uint16_t wideId)
+    {
+        return wideId & messageNumberMask;
+    }
+};
+
+template<std::uint16_t wideId, Priority priority_>
+struct WideId
+{
+    static constexpr std::uint8_t value = wideMessageId;
+    static constexpr std::uint16_t extended = wideId;
+    static constexpr Priority priority = priority_;
+};
+
+/// Message with 16-bit id (made with WideIdLayout::makeId()). It is sent with id wideMessageId
+/// and its own id in extendedId field, so it has the same header as other messages.
+template<typename MessageContents, std::uint16_t wideId, Priority priority = Priority::Normal>
+using WideMessage = MessageBase<MessageContents, WideId<wideId, priority>>;
+
+template<typename MessageT>
+constexpr bool isWideMessage = MessageT::myId == wideMessageId;
+
+/// Contents of delta encoded MessageT (see ImcDeltaEncoder).
+///
+/// Keyframe carries all bytes of MessageT contents. Other frames carry bitmap of bytes which differ
+/// from keyframe with given number (one bit per byte, LSB first), followed by those bytes,
+/// so only part of encoded array is sent.
+template<typename MessageT>
+struct DeltaContents
+{
+    using Decoded = MessageT;
+    using Contents = typename MessageT::Data;
+
+    static constexpr std::uint8_t contentsSize = sizeof(Contents);
+    static constexpr std::uint8_t bitmapSize = (contentsSize + 7) / 8;
+
+    std::uint8_t keyframeNumber = 0;
+    std::uint8_t isKeyframe = 0;
+    std::array<std::uint8_t, bitmapSize + contentsSize> encoded{};
+};
+
+/// Size of DeltaContents fields preceding encoded bytes.
+constexpr std::uint8_t deltaHeaderSize = 2;
+
+/// Message carrying delta encoded MessageT, which is decoded back to MessageT by ImcRecipent.
+template<typename MessageT, std::uint8_t myId>
+using DeltaMessage = Message<DeltaContents<MessageT>, myId>;
+
+template<typename MessageT>
+constexpr bool isDeltaMessage = mp::is_instantiation_of<DeltaContents, typename MessageT::Data>::value;
+
 constexpr auto controlMessageMaxSize = std::max({
     sizeof(Handshake),
     sizeof(Acknowledge),
     sizeof(ReceiveError),
     sizeof(KeepAlive),
+    sizeof(Capabilities),
 });
 
 }
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <misc/Callback.hpp>
+#include <misc/Assert.hpp>
+#include <array>
+#include <cstdint>
+
+namespace DynaSoft
+{
+
+/// Publishes messages periodically, instead of application polling whether they may be enqueued.
+///
+/// Each source has period and phase (offset of its first publish), so that sources with equal periods
+/// may be spread over link timeline. Publish times are derived from period, not from time of previous publish,
+/// so they don't drift. If source couldn't be published (i.e. send queue was full) it is retried on each update()
+/// until its next period starts, when missed period is counted. Periods which passed entirely between updates
+/// (i.e. when main loop stalled) are counted as missed too.
+///
+/// \tparam ImcModule InterMcuCommunicationModule which sends messages.
+/// \tparam maxSources Maximum count of registered sources.
+template<typename ImcModule, std::uint8_t maxSources>
+class ImcPublishScheduler
+{
+public:
+    /// Function signature of publish callbacks
+    /// \param context Context passed to register function
+    /// \param imc Module which should be used to send message
+    /// \return true if message was enqueued
+    using PublishFunc = bool(*)(CallbackContext, ImcModule&);
+    using Publisher = Callback<PublishFunc>;
+
+    /// Registers source with given period and phase. Returns false if there are already maxSources sources.
+    ///
+    /// \param frameSize Size of frame sent by publisher, used only to compute link load.
+    bool addSource(std::uint32_t periodUs, std::uint32_t phaseUs, std::uint8_t frameSize, Publisher publisher)
+    {
+        dyna_assert(periodUs > 0);
+        if(sourcesCount == maxSources)
+        {
+            return false;
+        }
+
+        Source& source = sources[sourcesCount++];
+        source.periodUs = periodUs;
+        source.phaseUs = phaseUs;
+        source.frameSize = frameSize;
+        source.publisher = publisher;
+        restart(source);
+        return true;
+    }
+
+    /// Advances timeline by given time and publishes due sources.
+    void update(ImcModule& imc, std::uint32_t loopUs)
+    {
+        for(std::uint8_t i = 0; i < sourcesCount; ++i)
+        {
+            Source& source = sources[i];
+            source.untilDueUs -= static_cast<std::int32_t>(loopUs);
+
+            // Update may span several periods, only the last one is published
+            while(source.untilDueUs <= 0)
+            {
+                if(source.isPending)
+                {
+                    // Next period started before message was published
+                    source.missedPeriods++;
+                }
+                source.isPending = true;
+                source.untilDueUs += source.periodUs;
+            }
+
+            if(source.isPending && source.publisher(imc))
+            {
+                source.isPending = false;
+            }
+        }
+    }
+
+    /// Starts timeline of all sources from the beginning, i.e. when communication is established.
+    void restart()
+    {
+        for(std::uint8_t i = 0; i < sourcesCount; ++i)
+        {
+            restart(sources[i]);
+        }
+    }
+
+    /// Returns count of periods in which source with given index (in order of registration) wasn't published.
+    std::uint32_t getMissedPeriods(std::uint8_t index) const
+    {
+        return sources[index].missedPeriods;
+    }
+
+    /// Returns count of bytes per second sent by all sources (without idle lines).
+    std::uint32_t getScheduledBytesPerSecond() const
+    {
+        std::uint32_t bytesPerSecond = 0;
+        for(std::uint8_t i = 0; i < sourcesCount; ++i)
+        {
+            bytesPerSecond += static_cast<std::uint64_t>(sources[i].frameSize) * 1000000 / sources[i].periodUs;
+        }
+        return bytesPerSecond;
+    }
+
+private:
+    struct Source
+    {
+        Publisher publisher{};
+        std::uint32_t periodUs = 0;
+        std::uint32_t phaseUs = 0;
+        std::int32_t untilDueUs = 0;
+        std::uint32_t missedPeriods = 0;
+        std::uint8_t frameSize = 0;
+        bool isPending = false;
+    };
+
+    void restart(Source& source)
+    {
+        source.untilDueUs = source.phaseUs;
+        source.isPending = false;
+    }
+
+    std::array<Source, maxSources> sources{};
+    std::uint8_t sourcesCount = 0;
+};
+
+}
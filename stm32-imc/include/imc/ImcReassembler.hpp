@@ -0,0 +1,96 @@
+#pragma once
+
+#include <imc/ImcProtocol.hpp>
+#include "../containers/Span.hpp"
+#include <cstring>
+
+namespace DynaSoft
+{
+
+/// Reassembles fragmented message (see ImcFragmenter) directly in buffer provided by user.
+///
+/// Fragments have to arrive in order. If one of them is missing, whole message is dropped
+/// and following fragments are ignored until first fragment of next message arrives.
+class ImcReassembler
+{
+public:
+    /// Sets buffer where messages are reassembled. Messages larger than buffer are rejected.
+    void setBuffer(Span<std::uint8_t> buffer_)
+    {
+        buffer = buffer_;
+        clear();
+    }
+
+    /// Copies fragment data to buffer.
+    /// Returns false if fragment is invalid or doesn't follow previous one.
+    bool add(const ImcProtocol::FragmentHeader& header, const std::uint8_t* data, std::uint8_t size)
+    {
+        if(header.offset == 0)
+        {
+            if(header.totalSize > buffer.size())
+            {
+                clear();
+                return false;
+            }
+            messageId = header.messageId;
+            totalSize = header.totalSize;
+            receivedSize = 0;
+            state = State::Receiving;
+        }
+        else if(state == State::Dropped)
+        {
+            return true;
+        }
+
+        if(state != State::Receiving || header.messageId != messageId || header.totalSize != totalSize ||
+           header.offset != receivedSize || size == 0 || receivedSize + size > totalSize)
+        {
+            state = State::Dropped;
+            return false;
+        }
+
+        std::memcpy(buffer.begin() + receivedSize, data, size);
+        receivedSize += size;
+        return true;
+    }
+
+    /// Returns true if all fragments of message were received.
+    bool isComplete() const
+    {
+        return state == State::Receiving && receivedSize == totalSize;
+    }
+
+    std::uint16_t getMessageId() const
+    {
+        return messageId;
+    }
+
+    /// Returns reassembled message, valid until next fragment is added.
+    Span<std::uint8_t> getMessage()
+    {
+        return makeSpan(buffer.begin(), receivedSize);
+    }
+
+    /// Drops partially received message.
+    void clear()
+    {
+        state = State::Idle;
+        receivedSize = 0;
+    }
+
+private:
+    enum class State
+    {
+        Idle,
+        Receiving,
+        Dropped
+    };
+
+    Span<std::uint8_t> buffer{};
+    State state = State::Idle;
+    std::uint16_t messageId = 0;
+    std::uint16_t totalSize = 0;
+    std::uint16_t receivedSize = 0;
+};
+
+}
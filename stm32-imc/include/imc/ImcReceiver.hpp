@@ -1,22 +1,42 @@
 #pragma once
 
 #include <imc/ImcProtocol.hpp>
-#include <imc/UartLock.hpp>
-#include <containers/TripleBuffer.hpp>
+#include <peripheral/CrcBase.hpp>
 #include <peripheral/UartBase.hpp>
+#include <array>
+#include <atomic>
 #include <optional>
+#include <type_traits>
 #include "../containers/StaticVector.hpp"
 
 namespace DynaSoft
 {
 
-/// Wraps UART peripheral and buffers up to 2 received messages.
+/// Wraps UART peripheral and buffers up to queueSize received messages.
+///
+/// Messages are stored in ring of (queueSize + 1) slots - one is kept by reader for the message
+/// returned from last getNextMessage(), rest holds received messages and the one being received.
+/// UART interrupt is the only writer and main loop the only reader, so ring is lock-free: slot indices
+/// are owned by one side each and only count of received messages is shared between them.
+///
+/// If StreamCrc is given, crc of message header and contents is computed in UART interrupt as bytes are received,
+/// and is available with getMessageCrc().
 ///
 /// \tparam Uart Concrete implementation of UartBase class.
 /// \tparam bufferSize Size of message buffers - should be equal to at least maximum expected message size.
-template<typename Uart, std::uint8_t bufferSize>
+/// \tparam queueSize Count of received messages that may wait for reading.
+/// \tparam detectEndFromSize If true message is complete as soon as all bytes announced by size field
+///         in its header are received. Idle line still ends message, so corrupted size field is resynchronized.
+/// \tparam StreamCrc Concrete implementation of CrcBase class used only by this object or void.
+/// \tparam crcFeed Method of feeding received bytes to StreamCrc.
+template<typename Uart, std::uint8_t bufferSize, std::uint8_t queueSize = 2, bool detectEndFromSize = false,
+         typename StreamCrc = void, CrcFeed crcFeed = CrcFeed::Bytes>
 class ImcReceiver
 {
+    static_assert(queueSize >= 1, "ImcReceiver requires queueSize of at least 1");
+
+    static constexpr bool isCrcStreamed = !std::is_void_v<StreamCrc>;
+
 public:
     using MessageBuffer = StaticVector<std::uint8_t, bufferSize>;
 
@@ -24,7 +44,7 @@ public:
     /// Registers Uart callbacks related to receiving data.
     ImcReceiver(Uart& uart_) :
         uart{uart_},
-        messageBuffer{}
+        slots{}
     {
         uart.setIdleLineDetectedCallback({[](CallbackContext ctx)
         {
@@ -40,23 +60,19 @@ public:
         }, this});
     }
 
-    /// Retrieves next message from queue (up to two messages may be queued) if one is available.
+    /// Retrieves next message from queue (up to queueSize messages may be queued) if one is available.
     /// It is then removed from queue.
     /// Returned pointer is valid only until next call to 'getNextMessage()'.
     std::optional<MessageBuffer*> getNextMessage()
     {
-        if(newMessagesCount > 0)
+        if(newMessagesCount.load(std::memory_order_acquire) > 0)
         {
-            UartReceiveLock lock{uart};
-            messageBuffer.read().clear();
-            messageBuffer.swapRead();
-            newMessagesCount--;
-            if(newMessagesCount > 0)
-            {
-                messageBuffer.swapWrite();
-            }
+            // Previously read slot is released only after it is cleared, as it may become write slot right away
+            slots[readIndex].clear();
+            readIndex = nextIndex(readIndex);
+            newMessagesCount.fetch_sub(1, std::memory_order_release);
 
-            MessageBuffer& message = messageBuffer.read();
+            MessageBuffer& message = slots[readIndex];
             return &message;
         }
         else
@@ -65,6 +81,14 @@ public:
         }
     }
 
+    /// Returns crc of header and contents of message returned by last getNextMessage(), computed while it was received.
+    /// Valid only with StreamCrc and only if whole header and contents were received.
+    std::uint32_t getMessageCrc() const
+    {
+        static_assert(isCrcStreamed, "ImcReceiver::getMessageCrc requires StreamCrc");
+        return crcs[readIndex];
+    }
+
     /// Returns true if UART detected an error or there was no space in buffer to store received message.
     /// If true no further messages are received until error is cleared.
     bool hasError() const
@@ -81,26 +105,43 @@ public:
 private:
     void onIdleLineDetected()
     {
-        if(isReceiveReady && !hasReceiveError)
+        if(!isWriteSlotFree())
+        {
+            // Queue is full - write slot is kept by reader, nothing was written to it
+        }
+        else if(isReceiveReady && !hasReceiveError)
         {
-            if(messageBuffer.write().size() > 0)
+            if(slots[writeIndex].size() > 0)
             {
-                if(newMessagesCount == 0)
-                {
-                    // Intermediate buffer should be cleared in getNextMessage(), so after this call
-                    // in write() we have clean buffer for next message and just received message in read()
-                    messageBuffer.swapWrite();
-                }
-                newMessagesCount++;
+                completeMessage();
             }
         }
-        else if(hasReceiveError && newMessagesCount < 2)
+        else
         {
-            messageBuffer.write().clear();
+            // Drop partial message received with error or before first idle
+            slots[writeIndex].clear();
         }
         isReceiveReady = true;
     }
 
+    void completeMessage()
+    {
+        // When queue becomes full write slot is the one kept by reader, but it is not written to
+        // until reader takes next message (and clears it), as data received meanwhile rises error
+        writeIndex = nextIndex(writeIndex);
+        newMessagesCount.fetch_add(1, std::memory_order_release);
+    }
+
+    static bool isMessageComplete(const MessageBuffer& message)
+    {
+        if(message.size() < 2)
+        {
+            return false;
+        }
+        std::uint16_t expectedSize = ImcProtocol::headerSize + ImcProtocol::paddedDataSize(message[1]) + ImcProtocol::crcSize;
+        return message.size() == expectedSize;
+    }
+
     void onDataReceived()
     {
         if(hasReceiveError)
@@ -108,16 +149,30 @@ private:
             return;
         }
 
-        if(newMessagesCount >= 2)
+        if(!isWriteSlotFree())
         {
             hasReceiveError = true;
             return;
         }
 
-        if(messageBuffer.write().size() < bufferSize)
+        MessageBuffer& message = slots[writeIndex];
+        if(message.size() < bufferSize)
         {
             std::uint8_t x = uart.read();
-            messageBuffer.write().push_back(x);
+            message.push_back(x);
+
+            if constexpr(isCrcStreamed)
+            {
+                addToCrc(message, x);
+            }
+
+            if constexpr(detectEndFromSize)
+            {
+                if(isReceiveReady && isMessageComplete(message))
+                {
+                    completeMessage();
+                }
+            }
         }
         else
         {
@@ -125,18 +180,84 @@ private:
         }
     }
 
+    /// Feeds bytes of header and contents to crc (size of contents is known after 2nd byte).
+    void addToCrc(const MessageBuffer& message, std::uint8_t x)
+    {
+        std::uint8_t index = message.size() - 1;
+        if(index == 0)
+        {
+            crc.reset();
+            pendingWord = 0;
+            pendingBytesCount = 0;
+        }
+
+        std::uint16_t headerAndContentsSize = ImcProtocol::headerSize + (message.size() > 1 ? message[1] : 0);
+        if(index >= headerAndContentsSize)
+        {
+            return;
+        }
+
+        if constexpr(crcFeed == CrcFeed::Words)
+        {
+            pendingWord |= std::uint32_t{x} << (8 * pendingBytesCount);
+            pendingBytesCount++;
+            if(pendingBytesCount == 4)
+            {
+                crc.add(pendingWord);
+                pendingWord = 0;
+                pendingBytesCount = 0;
+            }
+        }
+        else
+        {
+            crc.add(std::uint32_t{x});
+        }
+
+        if(index + 1 == headerAndContentsSize)
+        {
+            // Remaining 1-3 bytes are added separately
+            for(std::uint8_t i = 0; i < pendingBytesCount; ++i)
+            {
+                crc.add((pendingWord >> (8 * i)) & 0xFF);
+            }
+            crcs[writeIndex] = crc.get();
+        }
+    }
+
     void onReceiveError(std::uint8_t)
     {
         hasReceiveError = true;
     }
 
+    bool isWriteSlotFree() const
+    {
+        return newMessagesCount.load(std::memory_order_acquire) < queueSize;
+    }
+
+    static std::uint8_t nextIndex(std::uint8_t i)
+    {
+        return i + 1 < slotsCount ? i + 1 : 0;
+    }
+
 private:
+    static constexpr std::uint8_t slotsCount = queueSize + 1;
+
     Uart& uart;
-    TripleBuffer<MessageBuffer> messageBuffer;
+    std::array<MessageBuffer, slotsCount> slots;
+
+    std::uint8_t readIndex = 0;  // Owned by reader
+    std::uint8_t writeIndex = 1; // Owned by UART interrupt
 
     bool isReceiveReady = false; // Receive is not ready until 1st idle after reset
     volatile bool hasReceiveError = false;
-    volatile std::uint8_t newMessagesCount = 0;
+    std::atomic<std::uint8_t> newMessagesCount = 0;
+
+    // Streamed crc state, owned by UART interrupt (apart from crcs of received messages)
+    struct NoCrc {};
+    std::conditional_t<isCrcStreamed, StreamCrc, NoCrc> crc{};
+    std::array<std::uint32_t, isCrcStreamed ? slotsCount : 0> crcs{};
+    std::uint32_t pendingWord = 0;
+    std::uint8_t pendingBytesCount = 0;
 };
 
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <imc/ImcDeltaCodec.hpp>
 #include <imc/ImcProtocol.hpp>
 #include <misc/Meta.hpp>
+#include <array>
+#include <tuple>
 
 namespace DynaSoft
 {
@@ -14,6 +17,12 @@ namespace DynaSoft
 /// It will be called when message with corresponding id is received.
 /// handleMessage should return true if received message is valid.
 ///
+/// Received messages are dispatched with a table of handlers indexed by message number (6 lower bits of id),
+/// built at compile time, so dispatch takes the same time regardless of number of Messages.
+///
+/// Messages may also contain ImcProtocol::DeltaMessage<MessageT, id> types. They are decoded to MessageT,
+/// which is then passed to handleMessage. Deltas received without their keyframe are dropped silently.
+///
 /// \tparam Derived Actual recipient implementation.
 /// \tparam recipentNumber_ Unique number of this recipient.
 /// \tparam Messages List of all Message types that are expected by this recipient.
@@ -24,6 +33,9 @@ public:
     static constexpr auto maxMessageSize = std::max({ sizeof(Messages)... });
     static constexpr std::uint8_t recipentNumber = recipentNumber_;
 
+    static_assert(((ImcProtocol::getRecipientNumber(Messages::myId) == recipentNumber) && ...),
+                  "All Messages should have recipient number of ImcRecipent");
+
     /// Registers itself in ImcModule
     template<typename ImcModule>
     void registerRecipient(ImcModule& imc)
@@ -50,41 +62,241 @@ public:
         std::uint8_t dataSize,
         std::uint8_t* data)
     {
-        return dispatchImpl(imc, id, dataSize, data, std::integral_constant<int, 0>{});
+        if(ImcProtocol::getRecipientNumber(id) != recipentNumber)
+        {
+            return false;
+        }
+        return handlers<ImcModule>[ImcProtocol::getMessageNumber(id)](*this, imc, dataSize, data);
     }
 
 private:
-    template<typename ImcModule, int i>
-    bool dispatchImpl(
-        ImcModule& imc,
-        [[maybe_unused]] std::uint8_t id,
-        [[maybe_unused]] std::uint8_t dataSize,
-        [[maybe_unused]] std::uint8_t* data,
-        std::integral_constant<int, i>)
+    template<typename ImcModule>
+    using Handler = bool(*)(ImcRecipent&, ImcModule&, std::uint8_t, std::uint8_t*);
+
+    template<typename ImcModule>
+    using HandlersTable = std::array<Handler<ImcModule>, ImcProtocol::messageNumberMask + 1>;
+
+    static constexpr bool hasUniqueMessageNumbers()
     {
-        // There is possibility for iterative version using fold expression, but it seems
-        // arm-gcc 9.2 handles inlining of recursive version better if 'handleMessage' does some complex work
-        // For simple function it generates identical code, same as chained if/else
-        if constexpr(i < sizeof...(Messages))
+        constexpr std::uint8_t numbers[] = { ImcProtocol::getMessageNumber(Messages::myId)... };
+        for(std::size_t i = 0; i < sizeof...(Messages); ++i)
         {
-            using Message = mp::type_at<i, Messages...>;
-            if(id == Message::myId)
+            for(std::size_t j = i + 1; j < sizeof...(Messages); ++j)
             {
-                return dispatchKnownMessage<Message>(imc, dataSize, data);
+                if(numbers[i] == numbers[j])
+                {
+                    return false;
+                }
             }
-            else
+        }
+        return true;
+    }
+
+    static_assert(hasUniqueMessageNumbers(), "Each of Messages should have unique id");
+
+    template<typename ImcModule>
+    static constexpr HandlersTable<ImcModule> makeHandlers()
+    {
+        HandlersTable<ImcModule> table{};
+        for(auto& handler: table)
+        {
+            handler = &rejectMessage<ImcModule>;
+        }
+        ((table[ImcProtocol::getMessageNumber(Messages::myId)] = &dispatchKnownMessage<Messages, ImcModule>), ...);
+        return table;
+    }
+
+    template<typename ImcModule>
+    static constexpr HandlersTable<ImcModule> handlers = makeHandlers<ImcModule>();
+
+    template<typename ImcModule>
+    static bool rejectMessage(ImcRecipent&, ImcModule&, std::uint8_t, std::uint8_t*)
+    {
+        return false;
+    }
+
+    template<typename Message, typename ImcModule>
+    static bool dispatchKnownMessage(
+        ImcRecipent& self,
+        ImcModule& imc,
+        std::uint8_t dataSize,
+        std::uint8_t* data)
+    {
+        if constexpr(ImcProtocol::isDeltaMessage<Message>)
+        {
+            return dispatchDeltaMessage<Message>(self, imc, dataSize, data);
+        }
+        else if(dataSize == Message::dataSize)
+        {
+            Message& m = ImcProtocol::decode<Message>(data);
+            return static_cast<Derived&>(self).handleMessage(m, imc);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    template<typename Message, typename ImcModule>
+    static bool dispatchDeltaMessage(
+        ImcRecipent& self,
+        ImcModule& imc,
+        std::uint8_t dataSize,
+        std::uint8_t* data)
+    {
+        if(dataSize < ImcProtocol::deltaHeaderSize || dataSize > Message::dataSize)
+        {
+            return false;
+        }
+
+        Message& m = ImcProtocol::decode<Message>(data);
+        typename Message::Data::Decoded decoded{};
+        decoded.sequence = m.sequence;
+        decoded.ackSequence = m.ackSequence;
+
+        auto& decoder = std::get<indexOf<Message>()>(self.deltaDecoders);
+        switch(decoder.decode(m.data, dataSize, decoded.data))
+        {
+        case DeltaDecoderResult<Message>::Decoded:
+            return static_cast<Derived&>(self).handleMessage(decoded, imc);
+        case DeltaDecoderResult<Message>::MissingKeyframe:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    template<typename Message>
+    static constexpr std::size_t indexOf()
+    {
+        constexpr bool isSame[] = { std::is_same_v<Message, Messages>... };
+        for(std::size_t i = 0; i < sizeof...(Messages); ++i)
+        {
+            if(isSame[i])
             {
-                return dispatchImpl(imc, id, dataSize, data, std::integral_constant<int, i+1>{});
+                return i;
             }
         }
-        else
+        return sizeof...(Messages);
+    }
+
+    template<typename Message>
+    using DeltaDecoderFor = typename ImcDeltaDecoderOf<Message>::type;
+
+    template<typename Message>
+    using DeltaDecoderResult = typename DeltaDecoderFor<Message>::Result;
+
+    // Keyframes of delta encoded Messages
+    std::tuple<DeltaDecoderFor<Messages>...> deltaDecoders{};
+};
+
+/// Base class for recipients of wide messages (see ImcProtocol::WideMessage), which works as ImcRecipent,
+/// but with recipient and message numbers taken from 16-bit id split with Layout.
+///
+/// Table of handlers has entry for each message number up to largest one in Messages,
+/// so message numbers should be kept dense.
+///
+/// \tparam Derived Actual recipient implementation.
+/// \tparam Layout ImcProtocol::WideIdLayout used by ImcModule.
+/// \tparam recipentNumber_ Unique number of this recipient.
+/// \tparam Messages List of all WideMessage types that are expected by this recipient.
+template<typename Derived, typename Layout, std::uint16_t recipentNumber_, typename ... Messages>
+class ImcWideRecipent
+{
+public:
+    static constexpr auto maxMessageSize = std::max({ sizeof(Messages)... });
+    static constexpr std::uint16_t recipentNumber = recipentNumber_;
+
+    static_assert(recipentNumber < Layout::recipientsCount, "Recipient number should fit in Layout");
+    static_assert((ImcProtocol::isWideMessage<Messages> && ...), "All Messages should be wide messages");
+    static_assert(((Layout::getRecipientNumber(Messages::myExtendedId) == recipentNumber) && ...),
+                  "All Messages should have recipient number of ImcWideRecipent");
+
+    /// Registers itself in ImcModule
+    template<typename ImcModule>
+    void registerRecipient(ImcModule& imc)
+    {
+        imc.registerWideMessageRecipient(
+            recipentNumber,
+            typename ImcModule::WideMessageRecipient
+            {
+                [](CallbackContext ctx, ImcModule& imc, std::uint16_t wideId, std::uint8_t dataSize, std::uint8_t* data)
+                {
+                    return reinterpret_cast<ImcWideRecipent*>(ctx)->dispatch(imc, wideId, dataSize, data);
+                },
+                this
+            }
+        );
+    }
+
+    /// Calls handleMessage(MessageContents&, ImcModule&) with MessageContents type that matches received wide id
+    /// If there's no such id in any of Messages... or derived class doesn't implement handler returns false.
+    template<typename ImcModule>
+    bool dispatch(
+        ImcModule& imc,
+        std::uint16_t wideId,
+        std::uint8_t dataSize,
+        std::uint8_t* data)
+    {
+        std::uint16_t messageNumber = Layout::getMessageNumber(wideId);
+        if(Layout::getRecipientNumber(wideId) != recipentNumber || messageNumber >= handlersCount)
         {
             return false;
         }
+        return handlers<ImcModule>[messageNumber](*this, imc, dataSize, data);
+    }
+
+private:
+    static constexpr std::size_t handlersCount = std::max({ std::size_t{Layout::getMessageNumber(Messages::myExtendedId)}... }) + 1;
+
+    template<typename ImcModule>
+    using Handler = bool(*)(ImcWideRecipent&, ImcModule&, std::uint8_t, std::uint8_t*);
+
+    template<typename ImcModule>
+    using HandlersTable = std::array<Handler<ImcModule>, handlersCount>;
+
+    static constexpr bool hasUniqueMessageNumbers()
+    {
+        constexpr std::uint16_t numbers[] = { Layout::getMessageNumber(Messages::myExtendedId)... };
+        for(std::size_t i = 0; i < sizeof...(Messages); ++i)
+        {
+            for(std::size_t j = i + 1; j < sizeof...(Messages); ++j)
+            {
+                if(numbers[i] == numbers[j])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static_assert(hasUniqueMessageNumbers(), "Each of Messages should have unique id");
+
+    template<typename ImcModule>
+    static constexpr HandlersTable<ImcModule> makeHandlers()
+    {
+        HandlersTable<ImcModule> table{};
+        for(auto& handler: table)
+        {
+            handler = &rejectMessage<ImcModule>;
+        }
+        ((table[Layout::getMessageNumber(Messages::myExtendedId)] = &dispatchKnownMessage<Messages, ImcModule>), ...);
+        return table;
+    }
+
+    template<typename ImcModule>
+    static constexpr HandlersTable<ImcModule> handlers = makeHandlers<ImcModule>();
+
+    template<typename ImcModule>
+    static bool rejectMessage(ImcWideRecipent&, ImcModule&, std::uint8_t, std::uint8_t*)
+    {
+        return false;
     }
 
     template<typename Message, typename ImcModule>
-    bool dispatchKnownMessage(
+    static bool dispatchKnownMessage(
+        ImcWideRecipent& self,
         ImcModule& imc,
         std::uint8_t dataSize,
         std::uint8_t* data)
@@ -92,7 +304,7 @@ private:
         if(dataSize == Message::dataSize)
         {
             Message& m = ImcProtocol::decode<Message>(data);
-            return static_cast<Derived*>(this)->handleMessage(m, imc);
+            return static_cast<Derived&>(self).handleMessage(m, imc);
         }
         else
         {
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <imc/ImcProtocol.hpp>
+#include "../containers/StaticVector.hpp"
+#include <array>
+
+namespace DynaSoft
+{
+
+/// Keeps copies of last sent user frames, so that they may be sent again when other device
+/// reports that it didn't receive them (go-back-N retransmission).
+///
+/// Frames are stored in order of sending. When window is full oldest frame is overwritten,
+/// so frames may be retransmitted only as long as at most windowSize frames were sent after them.
+///
+/// \tparam maxMessageSize Maximum size of frame, including header and crc.
+/// \tparam windowSize Count of frames kept for retransmission.
+template<std::uint8_t maxMessageSize, std::uint8_t windowSize>
+class ImcRetransmitWindow
+{
+public:
+    using FrameBuffer = StaticVector<std::uint8_t, maxMessageSize>;
+
+    /// Stores copy of sent frame. Frame should have its sequence and crc already set.
+    void push(const std::uint8_t* data, std::uint8_t size)
+    {
+        frames[nextIndex].assign(data, data + size);
+        nextIndex = nextIndex + 1 < windowSize ? nextIndex + 1 : 0;
+        if(count < windowSize)
+        {
+            count++;
+        }
+    }
+
+    /// Stores copy of sent frame given in parts.
+    void push(Span<const std::uint8_t> header, Span<const std::uint8_t> payload, Span<const std::uint8_t> trailer)
+    {
+        FrameBuffer& frame = frames[nextIndex];
+        frame.assign(header.begin(), header.end());
+        for(std::uint8_t x: payload)
+        {
+            frame.push_back(x);
+        }
+        for(std::uint8_t x: trailer)
+        {
+            frame.push_back(x);
+        }
+        nextIndex = nextIndex + 1 < windowSize ? nextIndex + 1 : 0;
+        if(count < windowSize)
+        {
+            count++;
+        }
+    }
+
+    /// Returns frame with given sequence or nullptr if it is not in window.
+    FrameBuffer* find(std::uint16_t sequence)
+    {
+        for(std::uint8_t i = 0; i < count; ++i)
+        {
+            FrameBuffer& frame = frames[i];
+            if(*reinterpret_cast<std::uint16_t*>(frame.data() + ImcProtocol::sequenceOffset) == sequence)
+            {
+                return &frame;
+            }
+        }
+        return nullptr;
+    }
+
+    /// Removes all frames from window.
+    void clear()
+    {
+        nextIndex = 0;
+        count = 0;
+    }
+
+private:
+    std::array<FrameBuffer, windowSize> frames{};
+    std::uint8_t nextIndex = 0;
+    std::uint8_t count = 0;
+};
+
+}
@@ -2,83 +2,346 @@
 
 #include <imc/ImcProtocol.hpp>
 #include <imc/UartLock.hpp>
+#include <peripheral/CrcBase.hpp>
 #include <peripheral/UartBase.hpp>
 #include "../containers/StaticVector.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
 
 namespace DynaSoft
 {
 
-/// Wraps UART peripheral and buffers an additional message for transmission.
+/// Stages of user frame transmission (see InterMcuCommunicationModule::setTransmitCallback()).
+enum class TransmitEvent : std::uint8_t
+{
+    Queued,
+    Started,
+    Sent,
+    Acknowledged
+};
+
+/// Wraps UART peripheral and buffers additional messages for transmission.
+///
+/// Each enqueued message occupies one slot until it is fully transmitted. Frames are sent directly
+/// from slots memory (UART send buffer is not used), next one is started from UART transmit complete
+/// interrupt right after idle line following previous one (or right away with UartFraming::Cobs),
+/// without waiting for main loop.
+///
+/// Each message is enqueued with priority class (see ImcProtocol::Priority), each class has its own queue.
+/// Next started frame is the oldest one from highest priority queue, so urgent message waits at most for
+/// frame which is already being transmitted. For each class longest queueing delay is measured in count
+/// of bytes transmitted between enqueuing frame and starting it (idle lines are not counted).
+///
+/// Message may be also enqueued with its payload kept in caller's memory, in which case only
+/// small header and trailer are copied to the slot and payload is transmitted in place.
+///
+/// If StreamCrc is given, crc of each frame is computed from UART interrupt, when its header and contents
+/// are already being transmitted, and written to frame right before crc segment starts. Crc field of enqueued
+/// frames is then ignored.
 ///
 /// Type Uart should be have UartBase interface
-template<typename Uart, std::uint8_t maxMessageSize>
+///
+/// \tparam Uart Concrete implementation of UartBase class.
+/// \tparam maxMessageSize Maximum size of sent messages.
+/// \tparam queueSize Count of messages that may be enqueued, including one currently transmitted by UART.
+/// \tparam StreamCrc Concrete implementation of CrcBase class used only by this object or void.
+/// \tparam crcFeed Method of feeding frame bytes to StreamCrc.
+template<typename Uart, std::uint8_t maxMessageSize, std::uint8_t queueSize = 2, typename StreamCrc = void, CrcFeed crcFeed = CrcFeed::Bytes>
 class ImcSender
 {
+    static_assert(queueSize >= 2, "ImcSender requires queueSize of at least 2");
+
+    static constexpr bool isCrcStreamed = !std::is_void_v<StreamCrc>;
+
 public:
     using MessageBuffer = StaticVector<std::uint8_t, maxMessageSize>;
+    using Segment = typename Uart::Segment;
+    using Priority = ImcProtocol::Priority;
+
+    /// Called from UART interrupt when message is transmitted and its memory may be reused.
+    using SentCallback = Callback<void(CallbackContext)>;
+
+    /// Called with TransmitEvent::Queued when frame is enqueued and from UART interrupt with TransmitEvent::Started
+    /// when its first byte is sent (after idle line following previous frame) and with TransmitEvent::Sent
+    /// when its last byte is transmitted.
+    /// \param header First bytes of frame, including whole ImcProtocol header.
+    using FrameEventCallback = Callback<void(*)(CallbackContext, TransmitEvent event, const std::uint8_t* header)>;
 
     ImcSender(Uart& uart_) :
         uart{uart_},
-        messageBuffer{}
+        slots{}
     {
         uart.setDataSentCallback({[](CallbackContext ctx)
         {
             static_cast<ImcSender*>(ctx)->onDataSent();
         }, this});
+        uart.setSegmentStartCallback({[](CallbackContext ctx, std::uint8_t segment)
+        {
+            static_cast<ImcSender*>(ctx)->onSegmentStart(segment);
+        }, this});
     }
 
-    /// Enqueues given message for sending - up to two messages may be queued
+    /// Enqueues given message for sending - up to queueSize messages may be queued
     /// Returns true if there was space in queue
     template<typename MessageT>
-    bool sendMessage(MessageT& msg)
+    bool sendMessage(MessageT& msg, Priority priority = Priority::Normal)
     {
         std::uint8_t* data = reinterpret_cast<std::uint8_t*>(&msg);
-        return sendMessage(data, sizeof(MessageT));
+        return sendMessage(data, sizeof(MessageT), priority);
     }
 
-    bool sendMessage(std::uint8_t* data, std::uint8_t size)
+    bool sendMessage(const std::uint8_t* data, std::uint8_t size, Priority priority = Priority::Normal)
     {
-        UartSendLock lock{uart};
-        if(uart.send(data, size))
+        if constexpr(isCrcStreamed)
         {
-            capacity = 1;
-            return true;
+            // Crc needs to be in separate segment, so that it may be written after rest of frame is started
+            std::uint8_t crcOffset = size - ImcProtocol::crcSize;
+            return sendMessage(makeSpan(data, crcOffset), Segment{}, makeSpan(data + crcOffset, ImcProtocol::crcSize), SentCallback{}, priority);
         }
-        else if(capacity > 0)
+        else
         {
-            messageBuffer.assign(data, data + size);
-            hasMessageInBuffer = true;;
-            capacity = 0;
-            return true;
+            return sendMessage(makeSpan(data, size), Segment{}, Segment{}, SentCallback{}, priority);
         }
-        else
+    }
+
+    /// Enqueues message composed of three parts. Header and trailer are copied, payload is sent in place,
+    /// so it must stay unchanged until onSent is called. With StreamCrc trailer has to end with crc field.
+    /// Returns true if there was space in queue
+    bool sendMessage(Segment header, Segment payload, Segment trailer, SentCallback onSent, Priority priority = Priority::Normal)
+    {
+        UartSendLock lock{uart};
+        if(count == queueSize)
         {
             return false;
         }
+
+        std::uint8_t index = findFreeSlot();
+        Slot& slot = slots[index];
+        slot.buffer.assign(header.begin(), header.end());
+        for(std::uint8_t x: trailer)
+        {
+            slot.buffer.push_back(x);
+        }
+        slot.headerSize = header.size();
+        slot.payload = payload;
+        slot.onSent = onSent;
+        slot.isUsed = true;
+        slot.enqueuedAtBytes = transmittedBytes;
+
+        queues[static_cast<std::uint8_t>(priority)].push(index);
+        count = count + 1;
+        onFrameEvent(TransmitEvent::Queued, slot.buffer.data());
+        if(current == noSlot)
+        {
+            startNextTransmission();
+        }
+        return true;
+    }
+
+    /// Calls update(frame, size) with frames which are waiting in queue (not started yet) and were copied
+    /// whole (not sent in place), oldest first, until it returns true. Frame may be modified by update(),
+    /// but its size can't change. Interrupts are disabled meanwhile.
+    /// Returns true if some frame was updated.
+    template<typename UpdateFunc>
+    bool updateQueuedMessage(UpdateFunc&& update)
+    {
+        UartSendLock lock{uart};
+        for(SlotsQueue& queue: queues)
+        {
+            for(std::uint8_t i = 0; i < queue.count; ++i)
+            {
+                Slot& slot = slots[queue.indices[(queue.head + i) % queueSize]];
+                if(slot.payload.size() == 0 && update(slot.buffer.data(), static_cast<std::uint8_t>(slot.buffer.size())))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void setFrameEventCallback(FrameEventCallback callback)
+    {
+        UartSendLock lock{uart};
+        onFrameEvent = callback;
     }
 
     std::uint8_t queueCapacity()
     {
-        return capacity;
+        return queueSize - count;
+    }
+
+    /// Returns true if all enqueued messages are transmitted.
+    bool isIdle() const
+    {
+        return count == 0;
+    }
+
+    /// Returns longest queueing delay of frames with given priority, in bytes (see class description).
+    std::uint32_t getMaxQueueingDelay(Priority priority) const
+    {
+        return maxQueueingDelays[static_cast<std::uint8_t>(priority)];
+    }
+
+    void resetQueueingDelays()
+    {
+        UartSendLock lock{uart};
+        maxQueueingDelays = {};
     }
 
 private:
+    struct Slot
+    {
+        // Header followed by trailer (or whole message if it was copied)
+        MessageBuffer buffer{};
+        std::uint8_t headerSize = 0;
+        Segment payload{};
+        SentCallback onSent{};
+        bool isUsed = false;
+        std::uint32_t enqueuedAtBytes = 0;
+    };
+
+    // Fifo of indices of slots with the same priority
+    struct SlotsQueue
+    {
+        void push(std::uint8_t index)
+        {
+            indices[(head + count) % queueSize] = index;
+            count++;
+        }
+
+        std::uint8_t pop()
+        {
+            std::uint8_t index = indices[head];
+            head = nextIndex(head);
+            count--;
+            return index;
+        }
+
+        std::array<std::uint8_t, queueSize> indices{};
+        std::uint8_t head = 0;
+        std::uint8_t count = 0;
+    };
+
+    static constexpr std::uint8_t noSlot = queueSize;
+
+    std::uint8_t findFreeSlot() const
+    {
+        std::uint8_t index = 0;
+        while(slots[index].isUsed)
+        {
+            index++;
+        }
+        return index;
+    }
+
+    void startNextTransmission()
+    {
+        for(std::uint8_t priority = 0; priority < queues.size(); ++priority)
+        {
+            SlotsQueue& queue = queues[priority];
+            if(queue.count > 0)
+            {
+                current = queue.pop();
+                Slot& slot = slots[current];
+                std::uint32_t delay = transmittedBytes - slot.enqueuedAtBytes;
+                maxQueueingDelays[priority] = std::max(maxQueueingDelays[priority], delay);
+                startTransmission(slot);
+                return;
+            }
+        }
+        current = noSlot;
+    }
+
+    void startTransmission(Slot& slot)
+    {
+        const std::uint8_t* buffer = slot.buffer.data();
+        uart.sendSegments({
+            Segment{buffer, buffer + slot.headerSize},
+            slot.payload,
+            Segment{buffer + slot.headerSize, buffer + slot.buffer.size()}
+        });
+    }
+
+    void onSegmentStart(std::uint8_t segment)
+    {
+        // Data may be also sent directly through UART
+        if(current == noSlot)
+        {
+            return;
+        }
+
+        if(segment == 0)
+        {
+            onFrameEvent(TransmitEvent::Started, slots[current].buffer.data());
+        }
+        if constexpr(isCrcStreamed)
+        {
+            // Trailer is the last of 3 segments
+            if(segment == 2)
+            {
+                writeCrc(slots[current]);
+            }
+        }
+    }
+
+    void writeCrc(Slot& slot)
+    {
+        std::uint8_t* buffer = slot.buffer.data();
+        std::uint8_t headerAndContentsSize = ImcProtocol::headerSize + buffer[1];
+        std::uint8_t headerSize = std::min(slot.headerSize, headerAndContentsSize);
+        std::uint8_t payloadSize = std::min<std::uint8_t>(slot.payload.size(), headerAndContentsSize - headerSize);
+
+        // Header size is multiple of 4, so with CrcFeed::Words result is the same as for whole message
+        crc.reset();
+        crc.add(makeSpan<const std::uint8_t>(buffer, headerSize), crcFeed);
+        crc.add(makeSpan(slot.payload.begin(), payloadSize), crcFeed);
+        std::uint32_t value = crc.get();
+        std::memcpy(buffer + slot.buffer.size() - ImcProtocol::crcSize, &value, ImcProtocol::crcSize);
+    }
+
     void onDataSent()
     {
-        uart.generateIdleLine();
-        if(hasMessageInBuffer)
+        if(uart.isIdleLineFraming())
+        {
+            uart.generateIdleLine();
+        }
+
+        // Data may be also sent directly through UART
+        if(current == noSlot)
         {
-            std::uint8_t* data = reinterpret_cast<std::uint8_t*>(messageBuffer.data());
-            uart.send(data, messageBuffer.size());
-            hasMessageInBuffer = false;
+            return;
         }
-        capacity += 1;
+
+        Slot& sent = slots[current];
+        transmittedBytes += sent.buffer.size() + sent.payload.size();
+        sent.isUsed = false;
+        count = count - 1;
+        onFrameEvent(TransmitEvent::Sent, sent.buffer.data());
+        sent.onSent();
+
+        startNextTransmission();
+    }
+
+    static std::uint8_t nextIndex(std::uint8_t i)
+    {
+        return i + 1 < queueSize ? i + 1 : 0;
     }
 
     Uart& uart;
-    MessageBuffer messageBuffer{};
-    volatile std::uint8_t capacity = 2;
-    volatile bool hasMessageInBuffer = false;
+    std::array<Slot, queueSize> slots{};
+    std::array<SlotsQueue, ImcProtocol::priorityClassesCount> queues{};
+    volatile std::uint8_t current = noSlot;
+    volatile std::uint8_t count = 0;
+
+    std::uint32_t transmittedBytes = 0;
+    std::array<std::uint32_t, ImcProtocol::priorityClassesCount> maxQueueingDelays{};
+    FrameEventCallback onFrameEvent{};
+
+    struct NoCrc {};
+    std::conditional_t<isCrcStreamed, StreamCrc, NoCrc> crc{};
 };
 
 }
@@ -1,10 +1,57 @@
 #pragma once
 
+#include <peripheral/CrcBase.hpp>
 #include <cstdint>
 
 namespace DynaSoft
 {
 
+/// Compile-time configuration of InterMcuCommunicationModule.
+///
+/// To change some of options derive from ImcDefaultConfig and redefine chosen members:
+/// \code
+/// struct MyImcConfig : ImcDefaultConfig
+/// {
+///     static constexpr std::uint8_t sendQueueSize = 4;
+/// };
+/// \endcode
+struct ImcDefaultConfig
+{
+    /// Count of messages that may be enqueued for sending, including one currently transmitted.
+    /// One slot is always reserved for control messages, so (sendQueueSize - 1) user messages may wait for transmission.
+    static constexpr std::uint8_t sendQueueSize = 2;
+
+    /// Count of received messages that may wait for processing in update().
+    /// When more messages arrive before update() is called, they are dropped and ReceiveError is sent.
+    static constexpr std::uint8_t receiveQueueSize = 2;
+
+    /// If true received message is complete right after its last byte (computed from size in header) arrives,
+    /// instead of after idle line, which removes idle detection time from latency of each message.
+    /// Idle line still ends message, so receiver resynchronizes after corrupted size.
+    static constexpr bool detectReceivedMessageEndFromSize = false;
+
+    /// Method of feeding message bytes to CRC unit. Words is faster, but both devices need to use the same one.
+    static constexpr CrcFeed crcFeed = CrcFeed::Bytes;
+
+    /// If true CRC is computed in UART interrupts, as bytes are received and transmitted, instead of
+    /// in sendMessage() and update(). Receiver and sender use their own default-constructed Crc objects,
+    /// so Crc needs to be a software implementation (i.e. TableCrc) - shared CRC hardware can't be used.
+    static constexpr bool streamingCrc = false;
+
+    /// Count of last sent user frames kept for retransmission.
+    /// If greater than 0 reliable mode is enabled - frames reported as lost in ReceiveError are sent again
+    /// and received frames are dispatched only in order of their sequences.
+    static constexpr std::uint8_t retransmitWindowSize = 0;
+
+    /// Count of high bits of 16-bit id of wide messages (see ImcProtocol::WideMessage) used as recipient number,
+    /// rest of them is message number. If 0 wide messages are disabled.
+    /// Module keeps recipient callback for each number, so table size grows with 2^wideIdRecipientBits.
+    static constexpr std::uint8_t wideIdRecipientBits = 0;
+
+    /// Maximum count of periodic message sources registered with InterMcuCommunicationModule::registerPublisher().
+    static constexpr std::uint8_t publishSourcesCount = 0;
+};
+
 struct ImcSettings
 {
     std::uint32_t slaveHandshakeIntervalUs = 100 * 1000;
@@ -12,6 +59,32 @@ struct ImcSettings
     std::uint32_t slaveAckTimeoutUs = 300 * 1000;
 
     std::uint32_t masterCommunicationTimeoutUs = 300 * 1000;
+
+    /// Maximum size of frame with batched user messages (including header and crc).
+    /// If 0 batching is disabled and every message is sent in its own frame.
+    std::uint8_t batchMaxSize = 0;
+    /// Maximum time for which user message may wait in batch for other messages.
+    /// Batch is sent on first update() after this time, so 0 means that all messages
+    /// enqueued between two update() calls are sent together.
+    std::uint32_t batchMaxHoldUs = 0;
+
+    /// In reliable mode, minimum time between consecutive ReceiveErrors requesting retransmission
+    /// of the same frame, in case first request or retransmitted frames were lost.
+    std::uint32_t retransmitRequestIntervalUs = 10 * 1000;
+
+    /// Bit mask of ImcProtocol::negotiatedBaudRates supported by this device (see ImcLinkNegotiator).
+    /// If 0 on slave, link is not negotiated and UART stays at baud rate it was initialized with.
+    std::uint8_t supportedBaudRates = 0;
+    /// Time in which communication has to be established again after baud rate is switched.
+    std::uint32_t baudSwitchTimeoutUs = 50 * 1000;
+
+    /// Length of window in which master counts link errors to adapt negotiated baud rate (see ImcLinkNegotiator).
+    /// If 0 baud rate is not adapted.
+    std::uint32_t linkQualityWindowUs = 0;
+    /// Maximum ratio of link errors to frames in window, in permille - above it baud rate is lowered.
+    std::uint16_t maxLinkErrorPermille = 20;
+    /// Count of windows without errors after which higher baud rate is tried.
+    std::uint8_t cleanWindowsToStepUp = 10;
 };
 
 }
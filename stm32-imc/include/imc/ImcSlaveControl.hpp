@@ -20,28 +20,32 @@ namespace DynaSoft
 /// so that master know it is alive. It does that by sending KeepAlive message if other message wasn't sent
 /// for this period.
 ///
-/// If Acknowledge is not received for too long (ImcSettings::slaveAckTimeoutUs) assumes master was
-/// reset and goes back to reset state.
+/// If no message is received from master for too long (ImcSettings::slaveAckTimeoutUs) assumes master was
+/// reset and goes back to reset state. Any message counts, as each one acknowledges received data in its header,
+/// so master needs to send Acknowledge only when it has nothing else to send.
 ///
-/// Should handle receiver errors but for now they are just ignored - no application requires it.
-template<typename Uart, std::uint8_t maxMessageSize>
+/// Received ReceiveErrors are passed to ImcModule, which retransmits lost frames in reliable mode.
+///
+/// If baud rate negotiation is enabled, sends Capabilities after communication is established (see ImcLinkNegotiator).
+template<typename Uart, typename Receiver, typename Sender>
 class ImcSlaveControl : public ImcRecipent<
-        ImcSlaveControl<Uart, maxMessageSize>,
+        ImcSlaveControl<Uart, Receiver, Sender>,
         ImcProtocol::controlMessageRecipient,
         ImcProtocol::Acknowledge,
-        ImcProtocol::ReceiveError
+        ImcProtocol::ReceiveError,
+        ImcProtocol::Capabilities
     >
 {
     template<typename, std::uint8_t, typename...>
     friend class ImcRecipent; // for handleMessage to be private
 
 public:
-    using ReceivedMessage = typename ImcReceiver<Uart, maxMessageSize>::MessageBuffer;
+    using ReceivedMessage = typename Receiver::MessageBuffer;
 
     ImcSlaveControl(
         Uart& uart_,
-        ImcReceiver<Uart, maxMessageSize>& receiver_,
-        ImcSender<Uart, maxMessageSize>& sender_,
+        Receiver& receiver_,
+        Sender& sender_,
         ImcSettings& settings_
     ) :
         uart{uart_},
@@ -61,7 +65,7 @@ public:
     template<typename ImcModule>
     void updateStatus(ImcModule& imc)
     {
-        checkKeepAliveAckTimeout();
+        checkKeepAliveAckTimeout(imc);
         sendNotification(imc);
     }
 
@@ -77,6 +81,17 @@ public:
 
     void onMessageReceived()
     {
+        if(communicationIsEstablished)
+        {
+            keepAliveAckTimeout = 0;
+        }
+    }
+
+    /// Moves to reset state and sends Handshake on next update.
+    void resetCommunication()
+    {
+        communicationIsEstablished = false;
+        notificationTimer = settings.slaveHandshakeIntervalUs;
     }
 
 private:
@@ -89,10 +104,26 @@ private:
         }
         else
         {
+            sendCapabilities(imc);
             sendNotificationMessage<ImcProtocol::KeepAlive>(imc, settings.slaveKeepAliveIntervalUs);
         }
     }
 
+    template<typename ImcModule>
+    void sendCapabilities(ImcModule& imc)
+    {
+        auto& negotiator = imc.getLinkNegotiator();
+        if(negotiator.shouldSendRequest(settings.slaveHandshakeIntervalUs))
+        {
+            ImcProtocol::Capabilities request{};
+            request.data = negotiator.getCapabilities();
+            if(imc.sendMessage(request))
+            {
+                negotiator.onRequestSent();
+            }
+        }
+    }
+
     template<typename Message, typename ImcModule>
     void sendNotificationMessage(ImcModule& imc, std::uint32_t interval)
     {
@@ -103,19 +134,21 @@ private:
         }
     }
 
-    void checkKeepAliveAckTimeout()
+    template<typename ImcModule>
+    void checkKeepAliveAckTimeout(ImcModule& imc)
     {
         if(communicationIsEstablished)
         {
             if(keepAliveAckTimeout >= settings.slaveAckTimeoutUs)
             {
                 communicationIsEstablished = false;
+                imc.getLinkNegotiator().onCommunicationLost();
             }
         }
     }
 
     template<typename ImcModule>
-    bool handleMessage(ImcProtocol::Acknowledge& m, ImcModule&)
+    bool handleMessage(ImcProtocol::Acknowledge& m, ImcModule& imc)
     {
         if(!communicationIsEstablished)
         {
@@ -123,6 +156,7 @@ private:
             {
                 communicationIsEstablished = true;
                 keepAliveAckTimeout = 0;
+                imc.getLinkNegotiator().onCommunicationEstablished();
             }
         }
         else
@@ -136,14 +170,28 @@ private:
     }
 
     template<typename ImcModule>
-    bool handleMessage(ImcProtocol::ReceiveError&, ImcModule&)
+    bool handleMessage(ImcProtocol::ReceiveError& m, ImcModule& imc)
     {
+        if(communicationIsEstablished)
+        {
+            imc.onReceiveErrorReceived(m.data.lastOkSequence, m.data.reason);
+        }
+        return true;
+    }
+
+    template<typename ImcModule>
+    bool handleMessage(ImcProtocol::Capabilities& m, ImcModule& imc)
+    {
+        if(communicationIsEstablished)
+        {
+            imc.getLinkNegotiator().onResponseReceived(m.data);
+        }
         return true;
     }
 
     Uart& uart;
-    ImcReceiver<Uart, maxMessageSize>& receiver;
-    ImcSender<Uart, maxMessageSize>& sender;
+    Receiver& receiver;
+    Sender& sender;
 
     ImcSettings& settings;
     std::uint32_t notificationTimer = 0;
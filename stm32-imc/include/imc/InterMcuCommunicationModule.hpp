@@ -1,7 +1,13 @@
 #pragma once
 
+#include <imc/ImcBatcher.hpp>
+#include <imc/ImcFragmenter.hpp>
+#include <imc/ImcLinkNegotiator.hpp>
 #include <imc/ImcProtocol.hpp>
+#include <imc/ImcPublishScheduler.hpp>
+#include <imc/ImcReassembler.hpp>
 #include <imc/ImcReceiver.hpp>
+#include <imc/ImcRetransmitWindow.hpp>
 #include <imc/ImcSender.hpp>
 #include <imc/ImcSettings.hpp>
 #include <imc/ImcSlaveControl.hpp>
@@ -9,9 +15,12 @@
 #include <imc/ImcRecipient.hpp>
 #include <peripheral/UartBase.hpp>
 #include <peripheral/CrcBase.hpp>
+#include <peripheral/UsTimerBase.hpp>
 #include <misc/Callback.hpp>
 #include <misc/Meta.hpp>
 #include <misc/Assert.hpp>
+#include <cstring>
+#include <tuple>
 
 namespace DynaSoft
 {
@@ -28,6 +37,9 @@ namespace DynaSoft
 /// KeepAlive and should receive Acknowledge for each. If no Acknowledge is received for specified interval
 /// it resets connection state and start sending Handshakes again.
 ///
+/// Every message carries sequence of last message received from other device, so both devices treat any
+/// received message as a proof of life - KeepAlive and Acknowledge are sent only when link is otherwise silent.
+///
 /// This procedure is handled by ImcSlaveControl and ImcMasterControl classes.
 ///
 /// Once connection is established user may send messages to other device.
@@ -37,20 +49,99 @@ namespace DynaSoft
 /// If message id is unexpected, received data size differs from expected, or crc differs from expected
 /// receiver error is raised. This error is also raised when UART hardware detects a transmission error.
 /// Message received with error is not dispatched to recipients and ReceiveError message is sent
-/// to other device. However, for now they are ignored on the other side.
+/// to other device. ReceiveErrors are ignored on the other side, unless reliable mode is enabled.
+/// ReceiveError with ReceiveErrorReason::Rejected is sent when recipient rejects valid message.
+///
+/// In reliable mode (see ImcDefaultConfig::retransmitWindowSize) last sent user frames are kept
+/// in retransmit window. When ReceiveError arrives all frames sent after its lastOkSequence are sent again
+/// (go-back-N), before any new user message. Receiver dispatches user frames only in order of sequences:
+/// duplicates are dropped and frame after a gap is dropped and reported with ReceiveError. Control messages
+/// don't consume sequence numbers - they carry sequence of next user frame instead, so they also reveal
+/// lost frames on otherwise silent link. If lost frame is no longer in the window, communication is reset.
+///
+/// User messages may be also sent with sendMessageInPlace(), which transmits their contents directly
+/// from caller's memory and notifies when it may be reused.
+///
+/// User messages may be batched (see ImcSettings::batchMaxSize), so that several small messages enqueued
+/// between update() calls are sent in single frame, which saves idle line and crc for each of them.
+/// Batch is sent on update() after ImcSettings::batchMaxHoldUs or when next message doesn't fit in it.
+/// Received batches are unpacked and each message is dispatched as it would be received separately.
+///
+/// Recipients may be registered at runtime with registerMessageRecipient() or given as Recipients, in which case
+/// messages are routed to them with direct calls to their dispatch(). Both may be mixed, as long as
+/// each recipient number is used once.
+///
+/// If more recipients or messages are needed, wide messages may be enabled (see ImcDefaultConfig::wideIdRecipientBits).
+/// They carry 16-bit id in header field unused by other messages and are routed to recipients registered
+/// with registerWideMessageRecipient() (see ImcWideRecipent). Otherwise they are handled as user messages.
+///
+/// Messages larger than single frame may be sent with sendFragmentedMessage(). They are split into fragments,
+/// transmitted in place from caller's memory one at the time from update(), so other user messages may be sent
+/// between them. Receiver reassembles them in buffer given to setFragmentedMessageReceiver() and passes whole
+/// message to its callback. Lost fragment drops whole message, so reliable mode should be used for transfers.
+///
+/// User messages may have priority class declared on their type (see ImcProtocol::PriorityMessage). Frames are
+/// transmitted from highest priority queue first, so that urgent messages don't wait behind large ones.
+/// High priority messages are never batched and fragments of large messages have low priority.
+/// In reliable mode user frames need to be sent in order of sequences, so their priorities are ignored.
+///
+/// Messages sent periodically may be registered with registerPublisher(), so that they are sent from update()
+/// at fixed times, instead of polling canEnqueueMessage() in application loop (see ImcPublishScheduler).
+///
+/// Devices may switch to higher baud rate after communication is established (see ImcSettings::supportedBaudRates).
+/// Slave sends its capabilities, master selects highest baud rate supported by both and both switch UART once
+/// their frames are transmitted. If communication isn't established again at new rate, base rate is restored
+/// (see ImcLinkNegotiator).
+///
+/// CRC may be also computed in UART interrupts (see ImcDefaultConfig::streamingCrc), so that neither sending
+/// nor validation of received message needs a pass over whole frame in main loop.
 ///
 /// \tparam Uart Concrete implementation of UartBase class.
 /// \tparam Crc Concrete implementation of CrcBase class.
 /// \tparam maxMessageSize Maximum size of received and sent messages, should include fields in ImcProtocol::MessageBase.
 /// \tparam isMaster Indicates whether device serves as master or slave.
-///
-/// \todo Do something with received ReceiverError
-template<typename Uart, typename Crc, std::uint8_t maxMessageSize, bool isMaster = true>
+/// \tparam Config Compile-time configuration, see ImcDefaultConfig.
+/// \tparam Recipients Types derived from ImcRecipent, with unique recipient numbers - objects are passed to constructor.
+template<typename Uart, typename Crc, std::uint8_t maxMessageSize, bool isMaster = true, typename Config = ImcDefaultConfig, typename... Recipients>
 class InterMcuCommunicationModule
 {
 private:
-    using ReceivedMessage = typename ImcReceiver<Uart, maxMessageSize>::MessageBuffer;
-    using ImcControl = std::conditional_t<isMaster, ImcMasterControl<Uart, maxMessageSize>, ImcSlaveControl<Uart, maxMessageSize>>;
+    using StreamCrc = std::conditional_t<Config::streamingCrc, Crc, void>;
+    using Receiver = ImcReceiver<Uart, maxMessageSize, Config::receiveQueueSize, Config::detectReceivedMessageEndFromSize, StreamCrc, Config::crcFeed>;
+    using Sender = ImcSender<Uart, maxMessageSize, Config::sendQueueSize, StreamCrc, Config::crcFeed>;
+    using ReceivedMessage = typename Receiver::MessageBuffer;
+    using ImcControl = std::conditional_t<isMaster, ImcMasterControl<Uart, Receiver, Sender>, ImcSlaveControl<Uart, Receiver, Sender>>;
+
+    static constexpr bool isReliable = Config::retransmitWindowSize > 0;
+    static constexpr bool hasWideIds = Config::wideIdRecipientBits > 0;
+
+    // In reliable mode user frames have to be sent in order of their sequences
+    template<typename MessageT>
+    static constexpr ImcProtocol::Priority sendPriority = isReliable ? ImcProtocol::Priority::Normal : MessageT::myPriority;
+
+    static_assert(!Config::streamingCrc || std::is_default_constructible_v<Crc>, "Streaming CRC requires default constructible Crc");
+
+    static constexpr std::uint8_t staticRecipientsMask = (0 | ... | (1 << Recipients::recipentNumber));
+    static_assert(((Recipients::recipentNumber > 0 && Recipients::recipentNumber < 4) && ...), "Recipient number should be one of {1, 2, 3}");
+    static_assert(sizeof...(Recipients) == ((staticRecipientsMask >> 1) & 1) + ((staticRecipientsMask >> 2) & 1) + ((staticRecipientsMask >> 3) & 1),
+                  "Each of Recipients should have unique recipient number");
+
+public:
+    /// True if Recipients handle all recipient numbers, so no recipient may be registered at runtime.
+    static constexpr bool hasStaticRecipientForEachNumber = staticRecipientsMask == 0x0E;
+
+    /// Split of id of wide messages, valid only if wide messages are enabled.
+    using WideIdLayout = std::conditional_t<hasWideIds, ImcProtocol::WideIdLayout<Config::wideIdRecipientBits>, void>;
+
+private:
+    friend ImcControl; // for onReceiveErrorReceived() and getLinkNegotiator()
+
+    using LinkNegotiator = ImcLinkNegotiator<Uart>;
+
+    static constexpr std::size_t wideRecipientsCount = hasWideIds ? (std::size_t{1} << Config::wideIdRecipientBits) : 0;
+
+    static constexpr int fragmentFrameOverhead = ImcProtocol::headerSize + ImcProtocol::fragmentHeaderSize + ImcProtocol::crcSize;
+    static constexpr std::uint8_t maxFragmentSize = maxMessageSize > fragmentFrameOverhead ? (maxMessageSize - fragmentFrameOverhead) / 4 * 4 : 0;
 
 public:
     /// Function signature for message recipients callbacks
@@ -69,31 +160,132 @@ public:
     );
     using MessageRecipient = Callback<MessageRecipientFunc>;
 
-    InterMcuCommunicationModule(Uart& uart_, Crc& crc_, ImcSettings& settings_) :
+    /// Function signature for wide message recipients callbacks, same as MessageRecipientFunc,
+    /// but with 16-bit id of received wide message.
+    using WideMessageRecipientFunc = bool(*)(
+        CallbackContext,
+        InterMcuCommunicationModule&,
+        std::uint16_t,
+        std::uint8_t,
+        std::uint8_t*
+    );
+    using WideMessageRecipient = Callback<WideMessageRecipientFunc>;
+
+    /// Called from UART interrupt when message sent with sendMessageInPlace() is transmitted.
+    using SentCallback = typename Sender::SentCallback;
+
+    /// Function signature for callback receiving reassembled fragmented messages
+    /// \param context Context passed to register function
+    /// \param imc Reference to this ImcModule object
+    /// \param messageId User defined id given to sendFragmentedMessage()
+    /// \param message Reassembled message in buffer given to setFragmentedMessageReceiver()
+    /// \return true if message is supported and has valid contents
+    using FragmentedMessageRecipientFunc = bool(*)(
+        CallbackContext,
+        InterMcuCommunicationModule&,
+        std::uint16_t,
+        Span<std::uint8_t>
+    );
+    using FragmentedMessageRecipient = Callback<FragmentedMessageRecipientFunc>;
+
+    using PublishScheduler = ImcPublishScheduler<InterMcuCommunicationModule, Config::publishSourcesCount>;
+    using Publisher = typename PublishScheduler::Publisher;
+
+    /// Function signature for callback notified about transmission of user frames
+    /// \param context Context passed to setTransmitCallback()
+    /// \param event Stage of transmission
+    /// \param sequence Sequence of frame
+    /// \param timestampUs Time of event read from timer given to setTransmitCallback()
+    using TransmitFunc = void(*)(CallbackContext, TransmitEvent, std::uint16_t, std::uint32_t);
+    using TransmitCallback = Callback<TransmitFunc>;
+
+    InterMcuCommunicationModule(Uart& uart_, Crc& crc_, ImcSettings& settings_, Recipients&... staticRecipients_) :
         uart{ uart_ },
         crc{ crc_ },
         receiver{ uart },
         sender{ uart },
         control{ uart, receiver, sender, settings_ },
+        negotiator{ uart, settings_, makeCapabilities(uart_) },
+        batcher{},
+        retransmitWindow{},
+        fragmenter{},
+        reassembler{},
+        scheduler{},
+        staticRecipients{ staticRecipients_... },
         settings{ settings_ }
     {
+        sender.setFrameEventCallback({[](CallbackContext ctx, TransmitEvent event, const std::uint8_t* header)
+        {
+            static_cast<InterMcuCommunicationModule*>(ctx)->onFrameEvent(event, header);
+        }, this});
     }
 
     /// Registers callback that will be called when message with corresponding recipient number is received.
     ///
-    /// \param recipientNumber Unique number of recipient module, should be one of {1, 2, 3}
+    /// \param recipientNumber Unique number of recipient module, should be one of {1, 2, 3}, not used by any of Recipients.
     /// \param recipient Callback that will be called when message with corresponding recipient number is received.
     void registerMessageRecipient(std::uint8_t recipientNumber, MessageRecipient recipient)
     {
         dyna_assert(recipientNumber > 0 && recipientNumber < 4);
+        dyna_assert((staticRecipientsMask & (1 << recipientNumber)) == 0);
         recipients[recipientNumber-1] = recipient;
     }
 
+    /// Registers callback that will be called when wide message with corresponding recipient number is received.
+    ///
+    /// \param recipientNumber Unique number of recipient module, as given by WideIdLayout::getRecipientNumber().
+    /// \param recipient Callback that will be called when wide message with corresponding recipient number is received.
+    void registerWideMessageRecipient(std::uint16_t recipientNumber, WideMessageRecipient recipient)
+    {
+        static_assert(hasWideIds, "Wide messages are disabled in Config");
+        dyna_assert(recipientNumber < wideRecipientsCount);
+        wideRecipients[recipientNumber] = recipient;
+    }
+
+    /// Registers periodic source of MessageT, which should send it with sendMessage() when called.
+    /// First message is published after phaseUs since communication is established and then every periodUs.
+    /// Sources are registered in order, index of first one is 0.
+    /// Returns false if there are already ImcDefaultConfig::publishSourcesCount sources.
+    template<typename MessageT>
+    bool registerPublisher(std::uint32_t periodUs, std::uint32_t phaseUs, Publisher publisher)
+    {
+        return scheduler.addSource(periodUs, phaseUs, sizeof(MessageT), publisher);
+    }
+
+    /// Returns count of periods in which source with given index couldn't publish its message.
+    std::uint32_t getMissedPublishPeriods(std::uint8_t sourceIndex) const
+    {
+        return scheduler.getMissedPeriods(sourceIndex);
+    }
+
+    /// Returns count of bytes per second scheduled by registered publishers.
+    std::uint32_t getScheduledLinkLoad() const
+    {
+        return scheduler.getScheduledBytesPerSecond();
+    }
+
+    /// Sets buffer in which received fragmented messages are reassembled and callback that will be called
+    /// when whole message is received. Message is valid only during the call and buffer must not be used
+    /// by anything else. Fragmented messages larger than buffer are rejected.
+    void setFragmentedMessageReceiver(Span<std::uint8_t> buffer, FragmentedMessageRecipient recipient)
+    {
+        reassembler.setBuffer(buffer);
+        fragmentedMessageRecipient = recipient;
+    }
+
     /// Should be called regularly from main loop.
     /// Updates control module and dispatches received messages.
     void update(std::uint32_t loopUs)
     {
         control.updateTimers(loopUs);
+        negotiator.updateTimers(loopUs);
+        batcher.updateTimer(loopUs);
+        retransmitRequestTimer += loopUs;
+
+        if(!control.hasCommunicationEstablished())
+        {
+            resetReliableState();
+        }
 
         while(handleReceivedMessage())
         {
@@ -101,27 +293,37 @@ public:
 
         if(receiver.hasError())
         {
-            responseWithReceiveError();
+            requestRetransmission();
             receiver.clearError();
         }
 
+        retransmitFrames();
+        updatePublishers(loopUs);
+        updateBatch();
+        sendNextFragment();
+
         control.updateStatus(*this);
+        switchBaudRate();
     }
 
     /// Tries to send a message to other MCU.
-    /// At most one application module (user) message may be enqueued at the time.
+    /// At most (Config::sendQueueSize - 1) application module (user) messages may be enqueued at the time.
+    /// In reliable mode user messages are not accepted while lost frames are retransmitted.
+    /// If batching is enabled user messages are added to batch instead, as long as there's space in it.
+    /// State messages (see ImcProtocol::StateMessage) overwrite their unsent instance in batch or queue if there is one,
+    /// so they're accepted even if queue is full.
     /// Communication should also be established first.
     /// Returns true if message was successfully enqueued.
     ///
     /// Unless there were some errors with receiving only one control message should be sent at the time,
-    /// leaving second ImcSender slot for user messages.
+    /// as last ImcSender slot is reserved for them.
     ///
-    /// There is no notification whether message was transmitted successfully.
+    /// Sequence of message is set in msg (unless it is batched), so that its transmission may be tracked with setTransmitCallback().
+    /// In reliable mode frames reported as lost by other device are retransmitted as long as they're in retransmit window.
     template<typename MessageT>
     bool sendMessage(MessageT& msg)
     {
-        constexpr std::uint8_t rIdx = ImcProtocol::getRecipientNumber(MessageT::myId);
-        if constexpr(rIdx == ImcProtocol::controlMessageRecipient)
+        if constexpr(ImcProtocol::isControlMessageId(MessageT::myId))
         {
             return sendControlMessage(msg);
         }
@@ -131,25 +333,176 @@ public:
         }
     }
 
+    /// Tries to send a user message of which only first contentsSize bytes of contents are sent
+    /// (i.e. encoded by ImcDeltaEncoder), with size field set to contentsSize.
+    /// Apart from that it works as sendMessage(), but message is never batched - if there is pending batch,
+    /// it is sent first. Contents after first contentsSize bytes are overwritten with padding and crc.
+    template<typename MessageT>
+    bool sendMessage(MessageT& msg, std::uint8_t contentsSize)
+    {
+        static_assert(mp::is_instantiation_of<ImcProtocol::MessageBase, MessageT>::value, "MessageT needs to be instantiation of InterMcuProtocol::Message");
+        static_assert(!ImcProtocol::isControlMessageId(MessageT::myId), "Only user messages may be sent with variable size");
+        static_assert(!ImcProtocol::isWideMessage<MessageT> || hasWideIds, "Wide messages are disabled in Config");
+        dyna_assert(contentsSize <= MessageT::dataSize);
+
+        if(!hasCommunicationEstablished() || !sendBatch() || !canSendUserFrame())
+        {
+            return false;
+        }
+
+        msg.id = MessageT::myId;
+        msg.size = contentsSize;
+        msg.extendedId = MessageT::myExtendedId;
+        msg.sequence = nextSequence;
+        msg.ackSequence = lastReceivedSequence;
+
+        // Crc follows padded contents, as in frames with full contents
+        std::uint8_t* data = ImcProtocol::encode(msg);
+        std::uint8_t crcOffset = ImcProtocol::headerSize + ImcProtocol::paddedDataSize(contentsSize);
+        std::fill(data + ImcProtocol::headerSize + contentsSize, data + crcOffset, 0);
+        std::uint32_t crcValue = computeSentCrc(data, ImcProtocol::headerSize + contentsSize);
+        std::memcpy(data + crcOffset, &crcValue, ImcProtocol::crcSize);
+
+        return enqueueUserFrame(data, crcOffset + ImcProtocol::crcSize, sendPriority<MessageT>);
+    }
+
+    /// Tries to send a user message to other MCU, reading its contents directly from given memory.
+    ///
+    /// Contents are neither copied nor modified - header and crc are kept by ImcSender and contents
+    /// are transmitted in place, so they must stay unchanged until onSent is called from UART interrupt.
+    /// Apart from that it works as sendMessage(). If there is pending batch, it is sent first, so
+    /// that messages are received in order they were enqueued.
+    /// In reliable mode copy of message is still kept in retransmit window.
+    template<typename MessageT>
+    bool sendMessageInPlace(const typename MessageT::Data& contents, SentCallback onSent = {})
+    {
+        static_assert(mp::is_instantiation_of<ImcProtocol::MessageBase, MessageT>::value, "MessageT needs to be instantiation of InterMcuProtocol::Message");
+        static_assert(!ImcProtocol::isControlMessageId(MessageT::myId), "Only user messages may be sent in place");
+        static_assert(!ImcProtocol::isWideMessage<MessageT> || hasWideIds, "Wide messages are disabled in Config");
+
+        ImcProtocol::Header header{};
+        header.id = MessageT::myId;
+        header.size = MessageT::dataSize;
+        header.extendedId = MessageT::myExtendedId;
+
+        return sendFrameInPlace(header, makeSpan(reinterpret_cast<const std::uint8_t*>(&contents), MessageT::dataSize), onSent, sendPriority<MessageT>);
+    }
+
+    /// Starts transfer of message larger than single frame (up to 65535 bytes), which is sent in fragments
+    /// from update(). Message is transmitted in place, so it must stay unchanged until onSent is called
+    /// from UART interrupt after last fragment. Other user messages may be sent during transfer.
+    /// If communication is lost, transfer is aborted without calling onSent.
+    ///
+    /// \param messageId User defined id passed to receiver callback (see setFragmentedMessageReceiver()).
+    /// Returns false if other transfer is in progress or communication is not established.
+    bool sendFragmentedMessage(std::uint16_t messageId, Span<const std::uint8_t> message, SentCallback onSent = {})
+    {
+        static_assert(maxFragmentSize > 0, "maxMessageSize is too small for fragmented messages");
+
+        if(!hasCommunicationEstablished() || !fragmenter.start(messageId, message, onSent))
+        {
+            return false;
+        }
+        sendNextFragment();
+        return true;
+    }
+
+    /// Returns true if fragmented message is being sent.
+    bool isSendingFragmentedMessage() const
+    {
+        return fragmenter.isBusy();
+    }
+
     /// Returns true if communication with other device was established.
     bool hasCommunicationEstablished() const
     {
         return control.hasCommunicationEstablished();
     }
 
+    /// Returns longest time for which frame with given priority waited in send queue, counted in bytes transmitted
+    /// by UART in meantime (so that it doesn't depend on baud rate), since start or last resetQueueingDelays().
+    std::uint32_t getMaxQueueingDelay(ImcProtocol::Priority priority) const
+    {
+        return sender.getMaxQueueingDelay(priority);
+    }
+
+    void resetQueueingDelays()
+    {
+        sender.resetQueueingDelays();
+    }
+
+    /// Sets callback notified about each stage of transmission of user frames: when frame is enqueued, when its
+    /// first and last byte is transmitted (called from UART interrupt) and, in reliable mode, when other device
+    /// acknowledges it. Frames are identified by sequence set in sent messages - batched messages share sequence of
+    /// batch, which is reported only when whole batch is enqueued. Retransmitted frames are reported again (except acknowledgement).
+    ///
+    /// \param timer Source of timestamps, running independently of application use.
+    /// \param channel Channel of timer which is never reset, so that timestamps may be compared.
+    template<typename UsTimer>
+    void setTransmitCallback(UsTimerBase<UsTimer>& timer, std::uint8_t channel, TransmitCallback callback)
+    {
+        UartSendLock lock{uart};
+        timestampTimer = {[](CallbackContext ctx, std::uint8_t channel)
+        {
+            return static_cast<UsTimerBase<UsTimer>*>(ctx)->readUs(channel);
+        }, &timer};
+        timestampChannel = channel;
+        onTransmitEvent = callback;
+    }
+
+    /// Returns current baud rate of UART (see ImcLinkNegotiator).
+    std::uint32_t getBaudRate() const
+    {
+        return negotiator.getBaudRate();
+    }
+
+    /// Returns ratio of link errors to received frames in last window of baud rate adaptation, in permille.
+    std::uint16_t getLinkErrorPermille() const
+    {
+        return negotiator.getLinkErrorPermille();
+    }
+
+    /// Returns capabilities of other device, received during baud rate negotiation (all zeros if they weren't received).
+    const ImcProtocol::CapabilitiesContents& getPeerCapabilities() const
+    {
+        return negotiator.getPeerCapabilities();
+    }
+
     /// Returns true if module currently have capacity to enqueue message for sending.
     bool canEnqueueMessage()
     {
-        return sender.queueCapacity() > 1;
+        if(isBatchingEnabled())
+        {
+            return batcher.isEmpty() || canSendUserFrame();
+        }
+        return canSendUserFrame();
     }
 
 private:
     template<typename MessageT>
     bool sendUserMessage(MessageT& msg)
     {
-        if(hasCommunicationEstablished() && sender.queueCapacity() > 1)
+        if(!hasCommunicationEstablished())
+        {
+            return false;
+        }
+
+        if constexpr(MessageT::isLatestValue)
+        {
+            if(replaceUnsentMessage(msg))
+            {
+                return true;
+            }
+        }
+
+        // High priority messages are not held in batch
+        if(isBatchingEnabled() && sendPriority<MessageT> != ImcProtocol::Priority::High)
+        {
+            return batchUserMessage(msg);
+        }
+
+        if(canSendUserFrame())
         {
-            // Always reserve one slot for control messages
             return sendMessageImpl(msg);
         }
         else
@@ -158,6 +511,235 @@ private:
         }
     }
 
+    /// Overwrites instance of given state message which is waiting in batch or send queue.
+    template<typename MessageT>
+    bool replaceUnsentMessage(MessageT& msg)
+    {
+        msg.id = MessageT::myId;
+        msg.size = MessageT::dataSize;
+        msg.extendedId = MessageT::myExtendedId;
+
+        if(batcher.replace(msg))
+        {
+            return true;
+        }
+
+        return sender.updateQueuedMessage([this, &msg](std::uint8_t* frame, std::uint8_t frameSize)
+        {
+            const ImcProtocol::Header& header = *reinterpret_cast<const ImcProtocol::Header*>(frame);
+            if(frameSize != sizeof(MessageT) || header.id != msg.id || header.size != msg.size || header.extendedId != msg.extendedId)
+            {
+                return false;
+            }
+
+            // Frame keeps its sequence, so other device sees no gap
+            msg.sequence = header.sequence;
+            msg.ackSequence = header.ackSequence;
+            msg.crc = computeSentCrc(ImcProtocol::encode(msg), ImcProtocol::headerSize + MessageT::dataSize);
+            std::memcpy(frame, &msg, sizeof(MessageT));
+            if constexpr(isReliable)
+            {
+                if(auto copy = retransmitWindow.find(msg.sequence))
+                {
+                    copy->assign(frame, frame + frameSize);
+                }
+            }
+            return true;
+        });
+    }
+
+    bool canSendUserFrame()
+    {
+        // Always reserve one slot for control messages
+        return !isRetransmitting && !negotiator.hasPendingSwitch() && sender.queueCapacity() > 1;
+    }
+
+    bool isBatchingEnabled() const
+    {
+        return settings.batchMaxSize > 0;
+    }
+
+    template<typename MessageT>
+    bool batchUserMessage(MessageT& msg)
+    {
+        msg.id = MessageT::myId;
+        msg.size = MessageT::dataSize;
+        msg.extendedId = MessageT::myExtendedId;
+
+        if(!batcher.template canAdd<MessageT>(settings.batchMaxSize))
+        {
+            sendBatch();
+        }
+
+        if(batcher.template canAdd<MessageT>(settings.batchMaxSize))
+        {
+            return batcher.add(msg, settings.batchMaxSize);
+        }
+        else if(batcher.isEmpty() && canSendUserFrame())
+        {
+            // Message is too big to be batched
+            return sendMessageImpl(msg);
+        }
+        return false;
+    }
+
+    void updatePublishers(std::uint32_t loopUs)
+    {
+        if(hasCommunicationEstablished())
+        {
+            scheduler.update(*this, loopUs);
+        }
+        else
+        {
+            scheduler.restart();
+        }
+    }
+
+    void updateBatch()
+    {
+        if(!hasCommunicationEstablished())
+        {
+            batcher.clear();
+        }
+        else if(batcher.isHoldTimeExceeded(settings.batchMaxHoldUs))
+        {
+            sendBatch();
+        }
+    }
+
+    bool sendBatch()
+    {
+        if(batcher.isEmpty())
+        {
+            return true;
+        }
+
+        if(!canSendUserFrame())
+        {
+            return false;
+        }
+
+        Span<std::uint8_t> frame = batcher.finalize(nextSequence, lastReceivedSequence, [this](std::uint8_t* data, std::uint8_t size)
+        {
+            return computeSentCrc(data, size);
+        });
+
+        if(enqueueUserFrame(frame.data(), frame.size(), ImcProtocol::Priority::Normal))
+        {
+            batcher.clear();
+            return true;
+        }
+        return false;
+    }
+
+    /// Enqueues complete user frame (with sequence and crc set) for sending.
+    bool enqueueUserFrame(const std::uint8_t* frame, std::uint8_t frameSize, ImcProtocol::Priority priority)
+    {
+        if(sender.sendMessage(frame, frameSize, priority))
+        {
+            nextSequence++;
+            if constexpr(isReliable)
+            {
+                retransmitWindow.push(frame, frameSize);
+            }
+            control.onMessageSent();
+            return true;
+        }
+        return false;
+    }
+
+    /// Sends user frame with given header (with id, size and extendedId set), transmitting payload in place.
+    /// Header size has to be multiple of 4.
+    template<typename HeaderT>
+    bool sendFrameInPlace(HeaderT& header, Span<const std::uint8_t> payload, SentCallback onSent, ImcProtocol::Priority priority)
+    {
+        static_assert(sizeof(HeaderT) % 4 == 0, "Header size should be multiple of 4");
+
+        if(!hasCommunicationEstablished() || !sendBatch() || !canSendUserFrame())
+        {
+            return false;
+        }
+
+        ImcProtocol::Header& frameHeader = reinterpret_cast<ImcProtocol::Header&>(header);
+        frameHeader.sequence = nextSequence;
+        frameHeader.ackSequence = lastReceivedSequence;
+
+        const std::uint8_t* headerBytes = reinterpret_cast<const std::uint8_t*>(&header);
+        std::uint8_t payloadSize = payload.size();
+
+        // With streaming CRC it is written to trailer by ImcSender
+        std::uint32_t crcValue = 0;
+        if constexpr(!Config::streamingCrc)
+        {
+            crc.reset();
+            // Header size is multiple of 4, so with CrcFeed::Words result is the same as for whole message
+            crc.add(makeSpan(headerBytes, sizeof(HeaderT)), Config::crcFeed);
+            crc.add(payload, Config::crcFeed);
+            crcValue = crc.get();
+        }
+
+        // Contents are padded with zeros, so that crc is 4-byte aligned
+        std::uint8_t paddingSize = ImcProtocol::paddedDataSize(payloadSize) - payloadSize;
+        std::array<std::uint8_t, 3 + ImcProtocol::crcSize> trailer{};
+        const std::uint8_t* crcBytes = reinterpret_cast<const std::uint8_t*>(&crcValue);
+        std::copy(crcBytes, crcBytes + ImcProtocol::crcSize, trailer.begin() + paddingSize);
+
+        auto headerSpan = makeSpan(headerBytes, sizeof(HeaderT));
+        auto trailerSpan = makeSpan<const std::uint8_t>(trailer.data(), paddingSize + ImcProtocol::crcSize);
+
+        if(sender.sendMessage(headerSpan, payload, trailerSpan, onSent, priority))
+        {
+            nextSequence++;
+            if constexpr(isReliable)
+            {
+                retransmitWindow.push(headerSpan, payload, trailerSpan);
+            }
+            control.onMessageSent();
+            return true;
+        }
+        return false;
+    }
+
+    struct FragmentFrameHeader
+    {
+        ImcProtocol::Header header;
+        ImcProtocol::FragmentHeader fragment;
+    };
+
+    void sendNextFragment()
+    {
+        if(!hasCommunicationEstablished())
+        {
+            fragmenter.cancel();
+            reassembler.clear();
+            return;
+        }
+
+        if(!fragmenter.hasNextFragment())
+        {
+            return;
+        }
+
+        FragmentFrameHeader frameHeader{};
+        Span<const std::uint8_t> fragment = fragmenter.nextFragment(frameHeader.fragment);
+        frameHeader.header.id = ImcProtocol::fragmentMessageId;
+        frameHeader.header.size = ImcProtocol::fragmentHeaderSize + fragment.size();
+
+        SentCallback onFragmentSent{[](CallbackContext ctx)
+        {
+            static_cast<InterMcuCommunicationModule*>(ctx)->fragmenter.onFragmentSent();
+        }, this};
+
+        // Transfers are assumed to be least urgent
+        constexpr auto fragmentPriority = isReliable ? ImcProtocol::Priority::Normal : ImcProtocol::Priority::Low;
+        // Fragment is marked in flight first, as it may be transmitted before sendFrameInPlace() returns
+        fragmenter.onFragmentEnqueued(fragment.size());
+        if(!sendFrameInPlace(frameHeader, fragment, onFragmentSent, fragmentPriority))
+        {
+            fragmenter.onFragmentEnqueueFailed(fragment.size());
+        }
+    }
+
     template<typename MessageT>
     bool sendControlMessage(MessageT& msg)
     {
@@ -176,13 +758,28 @@ private:
     {
         static_assert(mp::is_instantiation_of<ImcProtocol::MessageBase, MessageT>::value, "MessageT needs to be instantiation of InterMcuProtocol::Message");
 
+        static_assert(!ImcProtocol::isWideMessage<MessageT> || hasWideIds, "Wide messages are disabled in Config");
+
+        constexpr bool isUserMessage = !ImcProtocol::isControlMessageId(MessageT::myId);
+
         msg.id = MessageT::myId;
         msg.size = MessageT::dataSize;
-        msg.sequence = nextSequence++;
-        msg.crc = computeCrc(reinterpret_cast<std::uint8_t*>(&msg), 4 + MessageT::dataSize);
+        msg.extendedId = MessageT::myExtendedId;
+        msg.sequence = nextSequence;
+        msg.ackSequence = lastReceivedSequence;
+        msg.crc = computeSentCrc(reinterpret_cast<std::uint8_t*>(&msg), ImcProtocol::headerSize + MessageT::dataSize);
 
-        if(sender.sendMessage(msg))
+        if(sender.sendMessage(msg, sendPriority<MessageT>))
         {
+            // In reliable mode control messages are not retransmitted, so they don't consume sequence numbers
+            if constexpr(isUserMessage || !isReliable)
+            {
+                nextSequence++;
+            }
+            if constexpr(isUserMessage && isReliable)
+            {
+                retransmitWindow.push(ImcProtocol::encode(msg), sizeof(MessageT));
+            }
             control.onMessageSent();
             return true;
         }
@@ -192,13 +789,77 @@ private:
         }
     }
 
+    void notifyTransmitEvent(TransmitEvent event, std::uint16_t sequence)
+    {
+        if(onTransmitEvent.isSet())
+        {
+            onTransmitEvent(event, sequence, timestampTimer(timestampChannel));
+        }
+    }
+
+    // Called from UART interrupt
+    void onFrameEvent(TransmitEvent event, const std::uint8_t* header)
+    {
+        if(!ImcProtocol::isControlMessageId(header[0]))
+        {
+            notifyTransmitEvent(event, *reinterpret_cast<const std::uint16_t*>(header + ImcProtocol::sequenceOffset));
+        }
+    }
+
+    /// Reports acknowledgement of user frames up to given sequence (cumulative acknowledgement).
+    void onAcknowledged(std::uint16_t ackSequence)
+    {
+        if constexpr(isReliable)
+        {
+            // Only frames which were sent and not acknowledged yet
+            std::int16_t newlyAcked = static_cast<std::int16_t>(ackSequence - lastAckedSequence);
+            std::int16_t notSent = static_cast<std::int16_t>(ackSequence - nextSequence);
+            if(newlyAcked <= 0 || notSent >= 0)
+            {
+                return;
+            }
+
+            while(lastAckedSequence != ackSequence)
+            {
+                lastAckedSequence++;
+                notifyTransmitEvent(TransmitEvent::Acknowledged, lastAckedSequence);
+            }
+        }
+    }
+
     std::uint32_t computeCrc(std::uint8_t* message, std::uint8_t headerAndContentsSize)
     {
         crc.reset();
-        crc.add(makeSpan(message, headerAndContentsSize));
+        crc.add(makeSpan(message, headerAndContentsSize), Config::crcFeed);
         return crc.get();
     }
 
+    std::uint32_t computeSentCrc(std::uint8_t* message, std::uint8_t headerAndContentsSize)
+    {
+        if constexpr(Config::streamingCrc)
+        {
+            // Computed by ImcSender during transmission
+            return 0;
+        }
+        else
+        {
+            return computeCrc(message, headerAndContentsSize);
+        }
+    }
+
+    std::uint32_t computeReceivedCrc(ReceivedMessage& message, std::uint8_t headerAndContentsSize)
+    {
+        if constexpr(Config::streamingCrc)
+        {
+            // Computed by ImcReceiver during reception
+            return receiver.getMessageCrc();
+        }
+        else
+        {
+            return computeCrc(message.data(), headerAndContentsSize);
+        }
+    }
+
     bool handleReceivedMessage()
     {
         auto maybeMessage = receiver.getNextMessage();
@@ -214,28 +875,203 @@ private:
     {
         if(checkReceivedMessageIsValid(message))
         {
+            negotiator.onFrameReceived();
+            onAcknowledged(*reinterpret_cast<std::uint16_t*>(message.data() + ImcProtocol::ackSequenceOffset));
+
+            if(!checkReceivedSequence(message))
+            {
+                return;
+            }
+
+            // Responses sent by recipients acknowledge this message already
+            std::uint16_t previousSequence = lastReceivedSequence;
+            if constexpr(!isReliable)
+            {
+                lastReceivedSequence = getSequence(message);
+            }
+
             if(dispatchMessage(message))
             {
-                constexpr std::uint8_t sequenceOffset = 2;
-                std::uint16_t sequence = *reinterpret_cast<std::uint16_t*>(message.data() + sequenceOffset);
-                lastReceivedSequence = sequence;
                 control.onMessageReceived();
             }
             else
             {
-                responseWithReceiveError();
+                if constexpr(!isReliable)
+                {
+                    lastReceivedSequence = previousSequence;
+                }
+                responseWithReceiveError(ImcProtocol::ReceiveErrorReason::Rejected);
             }
         }
         else
         {
-            responseWithReceiveError();
+            requestRetransmission();
+        }
+    }
+
+    static std::uint16_t getSequence(ReceivedMessage& message)
+    {
+        return *reinterpret_cast<std::uint16_t*>(message.data() + ImcProtocol::sequenceOffset);
+    }
+
+    /// In reliable mode returns false if message should be dropped because of its sequence.
+    bool checkReceivedSequence(ReceivedMessage& message)
+    {
+        if constexpr(isReliable)
+        {
+            std::uint8_t id = message[0];
+            std::uint16_t sequence = getSequence(message);
+            bool isControlMessage = ImcProtocol::isControlMessageId(id);
+
+            // Handshake means that other device was reset, so it starts its own sequence
+            if(!isSequenceSynchronized || id == ImcProtocol::Handshake::myId)
+            {
+                synchronizeSequence(sequence);
+            }
+
+            std::int16_t distance = static_cast<std::int16_t>(sequence - expectedSequence);
+            if(distance > 0)
+            {
+                // Some frames were lost, control messages are still valid though
+                requestRetransmission();
+                return isControlMessage;
+            }
+            if(isControlMessage)
+            {
+                return true;
+            }
+            if(distance < 0)
+            {
+                // Retransmitted frame which was already received
+                return false;
+            }
+
+            lastReceivedSequence = sequence;
+            expectedSequence++;
+            isWaitingForRetransmission = false;
+        }
+        return true;
+    }
+
+    void synchronizeSequence(std::uint16_t sequence)
+    {
+        expectedSequence = sequence;
+        lastReceivedSequence = sequence - 1;
+        isSequenceSynchronized = true;
+        isWaitingForRetransmission = false;
+    }
+
+    /// Sends ReceiveError. In reliable mode it is not repeated until retransmission of lost frames starts
+    /// or ImcSettings::retransmitRequestIntervalUs passes, as every frame after a gap would request it again.
+    void requestRetransmission()
+    {
+        if constexpr(isReliable)
+        {
+            if(isWaitingForRetransmission && retransmitRequestTimer < settings.retransmitRequestIntervalUs)
+            {
+                return;
+            }
+            isWaitingForRetransmission = true;
+            retransmitRequestTimer = 0;
+        }
+        // Frames following a gap are not counted, as they were lost because of single error
+        negotiator.onLinkError();
+        responseWithReceiveError(ImcProtocol::ReceiveErrorReason::LinkError);
+    }
+
+    static ImcProtocol::CapabilitiesContents makeCapabilities(const Uart& uart)
+    {
+        ImcProtocol::CapabilitiesContents capabilities{};
+        capabilities.maxMessageSize = maxMessageSize;
+        capabilities.receiveQueueSize = Config::receiveQueueSize;
+        capabilities.framing = static_cast<std::uint8_t>(uart.getFraming());
+        capabilities.crcFeed = static_cast<std::uint8_t>(Config::crcFeed);
+        return capabilities;
+    }
+
+    LinkNegotiator& getLinkNegotiator()
+    {
+        return negotiator;
+    }
+
+    /// Switches baud rate selected by negotiation, once all frames are transmitted.
+    void switchBaudRate()
+    {
+        if(negotiator.hasPendingSwitch() && sender.isIdle() && !uart.isTransmitOngoing())
+        {
+            negotiator.applyPendingSwitch();
+            control.resetCommunication();
+        }
+    }
+
+    /// Called by control module when ReceiveError is received.
+    /// Frames rejected by recipients of other device are not counted as link errors.
+    void onReceiveErrorReceived([[maybe_unused]] std::uint16_t lastOkSequence, ImcProtocol::ReceiveErrorReason reason)
+    {
+        if(reason == ImcProtocol::ReceiveErrorReason::LinkError)
+        {
+            negotiator.onLinkError();
+        }
+        if constexpr(isReliable)
+        {
+            std::uint16_t firstLostSequence = lastOkSequence + 1;
+            if(static_cast<std::int16_t>(nextSequence - firstLostSequence) <= 0)
+            {
+                // All sent frames were received
+                return;
+            }
+            retransmitSequence = firstLostSequence;
+            isRetransmitting = true;
+            retransmitFrames();
+        }
+    }
+
+    void retransmitFrames()
+    {
+        if constexpr(isReliable)
+        {
+            while(isRetransmitting && sender.queueCapacity() > 1)
+            {
+                if(retransmitSequence == nextSequence)
+                {
+                    isRetransmitting = false;
+                    break;
+                }
+
+                auto* frame = retransmitWindow.find(retransmitSequence);
+                if(frame == nullptr)
+                {
+                    // Other device can't receive anything after lost frame, so start over
+                    resetReliableState();
+                    control.resetCommunication();
+                    break;
+                }
+
+                if(!sender.sendMessage(frame->data(), frame->size()))
+                {
+                    break;
+                }
+                retransmitSequence++;
+                control.onMessageSent();
+            }
+        }
+    }
+
+    void resetReliableState()
+    {
+        if constexpr(isReliable)
+        {
+            retransmitWindow.clear();
+            lastAckedSequence = nextSequence - 1;
+            isRetransmitting = false;
+            isSequenceSynchronized = false;
+            isWaitingForRetransmission = false;
         }
     }
 
     bool checkReceivedMessageIsValid(ReceivedMessage& message)
     {
-        constexpr std::uint8_t headerSize = 4;
-        constexpr std::uint8_t headerAndCrcSize = 8;
+        constexpr std::uint8_t headerAndCrcSize = ImcProtocol::headerSize + ImcProtocol::crcSize;
 
         if(message.size() < headerAndCrcSize)
         {
@@ -243,18 +1079,16 @@ private:
         }
 
         std::uint8_t dataSize = message[1];
-        // As crc is 4-byte aligned, message contents are padded to 4 bytes
-        std::uint8_t dataSizeWithPadding = dataSize > 4 ? dataSize + 3 - ((dataSize + 3) % 4) : 4;
 
-        if(dataSizeWithPadding != message.size() - headerAndCrcSize)
+        if(ImcProtocol::paddedDataSize(dataSize) != message.size() - headerAndCrcSize)
         {
             return false;
         }
 
-        std::uint8_t crcOffset = message.size() - headerSize;
+        std::uint8_t crcOffset = message.size() - ImcProtocol::crcSize;
         std::uint32_t crc = *reinterpret_cast<std::uint32_t*>(message.data() + crcOffset);
 
-        if(crc != computeCrc(message.data(), headerSize + dataSize))
+        if(crc != computeReceivedCrc(message, ImcProtocol::headerSize + dataSize))
         {
             return false;
         }
@@ -268,12 +1102,60 @@ private:
         std::uint8_t dataSize = message[1];
         std::uint8_t* data = message.data();
 
+        if(id == ImcProtocol::batchMessageId)
+        {
+            return dispatchBatch(data + ImcProtocol::headerSize, dataSize);
+        }
+        return dispatchMessage(id, dataSize, data);
+    }
+
+    bool dispatchBatch(std::uint8_t* entries, std::uint8_t entriesSize)
+    {
+        bool allValid = entriesSize > 0;
+        for(std::uint8_t offset = 0; offset < entriesSize; )
+        {
+            std::uint8_t* entry = entries + offset;
+            if(offset + ImcProtocol::headerSize > entriesSize || entry[0] == ImcProtocol::batchMessageId)
+            {
+                return false;
+            }
+
+            std::uint8_t entrySize = ImcProtocol::headerSize + ImcProtocol::paddedDataSize(entry[1]);
+            if(offset + entrySize > entriesSize)
+            {
+                return false;
+            }
+
+            allValid = dispatchMessage(entry[0], entry[1], entry) && allValid;
+            offset += entrySize;
+        }
+        return allValid;
+    }
+
+    bool dispatchMessage(std::uint8_t id, std::uint8_t dataSize, std::uint8_t* data)
+    {
+        if(id == ImcProtocol::wideMessageId)
+        {
+            return dispatchWideMessage(dataSize, data);
+        }
+        if(id == ImcProtocol::fragmentMessageId)
+        {
+            return dispatchFragment(dataSize, data);
+        }
+
         std::uint8_t rIdx = ImcProtocol::getRecipientNumber(id);
         if(rIdx == ImcProtocol::controlMessageRecipient)
         {
             return control.dispatch(*this, id, dataSize, data);
         }
-        else
+
+        bool isValid = false;
+        if(dispatchToStaticRecipient(rIdx, id, dataSize, data, isValid))
+        {
+            return isValid;
+        }
+
+        if constexpr(!hasStaticRecipientForEachNumber)
         {
             auto& recipient = recipients[rIdx-1];
             return recipient(*this, id, dataSize, data);
@@ -281,24 +1163,96 @@ private:
         return false;
     }
 
-    void responseWithReceiveError()
+    bool dispatchWideMessage([[maybe_unused]] std::uint8_t dataSize, [[maybe_unused]] std::uint8_t* data)
+    {
+        if constexpr(hasWideIds)
+        {
+            std::uint16_t wideId = *reinterpret_cast<std::uint16_t*>(data + ImcProtocol::extendedIdOffset);
+            auto& recipient = wideRecipients[WideIdLayout::getRecipientNumber(wideId)];
+            return recipient(*this, wideId, dataSize, data);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    bool dispatchFragment(std::uint8_t dataSize, std::uint8_t* data)
+    {
+        if(dataSize < ImcProtocol::fragmentHeaderSize)
+        {
+            return false;
+        }
+
+        auto& fragment = *reinterpret_cast<ImcProtocol::FragmentHeader*>(data + ImcProtocol::headerSize);
+        std::uint8_t* fragmentData = data + ImcProtocol::headerSize + ImcProtocol::fragmentHeaderSize;
+        if(!reassembler.add(fragment, fragmentData, dataSize - ImcProtocol::fragmentHeaderSize))
+        {
+            return false;
+        }
+
+        if(reassembler.isComplete())
+        {
+            bool isValid = fragmentedMessageRecipient(*this, reassembler.getMessageId(), reassembler.getMessage());
+            reassembler.clear();
+            return isValid;
+        }
+        return true;
+    }
+
+    /// Returns true if one of Recipients has given number. Result of its dispatch() is stored in isValid.
+    bool dispatchToStaticRecipient(
+        [[maybe_unused]] std::uint8_t rIdx,
+        [[maybe_unused]] std::uint8_t id,
+        [[maybe_unused]] std::uint8_t dataSize,
+        [[maybe_unused]] std::uint8_t* data,
+        [[maybe_unused]] bool& isValid)
+    {
+        return ((rIdx == Recipients::recipentNumber &&
+                 (isValid = std::get<Recipients&>(staticRecipients).dispatch(*this, id, dataSize, data), true)) || ...);
+    }
+
+    void responseWithReceiveError(ImcProtocol::ReceiveErrorReason reason)
     {
         ImcProtocol::ReceiveError response {};
         response.data.lastOkSequence = lastReceivedSequence;
+        response.data.reason = reason;
         sendControlMessage(response);
     }
 
     Uart& uart;
     Crc& crc;
-    ImcReceiver<Uart, maxMessageSize> receiver;
-    ImcSender<Uart, maxMessageSize> sender;
+    Receiver receiver;
+    Sender sender;
     ImcControl control;
+    LinkNegotiator negotiator;
+    ImcBatcher<maxMessageSize> batcher;
+    ImcRetransmitWindow<maxMessageSize, Config::retransmitWindowSize> retransmitWindow;
+    ImcFragmenter<maxFragmentSize> fragmenter;
+    ImcReassembler reassembler;
+    PublishScheduler scheduler;
+    FragmentedMessageRecipient fragmentedMessageRecipient{};
 
+    std::tuple<Recipients&...> staticRecipients;
     std::array<MessageRecipient, 3> recipients {};
+    std::array<WideMessageRecipient, wideRecipientsCount> wideRecipients {};
 
     ImcSettings& settings;
     std::uint16_t nextSequence = 0;
     std::uint16_t lastReceivedSequence = 0;
+
+    TransmitCallback onTransmitEvent{};
+    Callback<std::uint32_t(*)(CallbackContext, std::uint8_t)> timestampTimer{};
+    std::uint8_t timestampChannel = 0;
+
+    // Reliable mode state
+    std::uint16_t retransmitSequence = 0;
+    bool isRetransmitting = false;
+    std::uint16_t expectedSequence = 0;
+    bool isSequenceSynchronized = false;
+    bool isWaitingForRetransmission = false;
+    std::uint32_t retransmitRequestTimer = 0;
+    std::uint16_t lastAckedSequence = 0;
 };
 
 }
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <peripheral/TableCrc.hpp>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DYNASOFT_CLMUL_CRC_AVAILABLE 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#else
+#define DYNASOFT_CLMUL_CRC_AVAILABLE 0
+#endif
+
+namespace DynaSoft
+{
+
+/// Software CRC unit for PC side, which gives the same results as SoftwareCrc and STM32 hardware CRC unit.
+///
+/// On x86 CPUs with PCLMULQDQ instruction addWords() folds 16 bytes at a time with carry-less
+/// multiplication. Single words, tails shorter than 16 bytes and other CPUs use TableCrc<8>.
+/// CPU support is checked at runtime, so no special compiler flags are needed.
+class ClmulCrc : public CrcBase<ClmulCrc>
+{
+public:
+    using CrcBase::CrcBase;
+
+    /// Returns true if CPU supports carry-less multiplication, so addWords() is accelerated.
+    static bool isAccelerated()
+    {
+#if DYNASOFT_CLMUL_CRC_AVAILABLE
+        static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    void _add(std::uint32_t x)
+    {
+        crc = TableCrc<8>::update(crc, x);
+    }
+
+    void _addWords(const std::uint8_t* data, std::size_t wordsCount)
+    {
+        std::size_t blocksCount = wordsCount / 4;
+        // Folding pays off only if there are at least 2 blocks
+        if(blocksCount >= 2 && isAccelerated())
+        {
+            crc = fold(crc, data, blocksCount);
+            data += blocksCount * 16;
+            wordsCount -= blocksCount * 4;
+        }
+        crc = TableCrc<8>::update(crc, data, wordsCount);
+    }
+
+    std::uint32_t _get()
+    {
+        return crc;
+    }
+
+    void _reset()
+    {
+        crc = SoftwareCrc::initialValue;
+    }
+
+private:
+#if DYNASOFT_CLMUL_CRC_AVAILABLE
+    // Block of 4 words is treated as 128-bit polynomial with first word as most significant one
+    __attribute__((target("sse2,pclmul")))
+    static __m128i loadBlock(const std::uint8_t* data)
+    {
+        return _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), 0x1B);
+    }
+
+    // Computes remainder of all blocks as 128-bit polynomial by folding each block into next one:
+    // X' = X.high * (x^192 mod P) ^ X.low * (x^128 mod P) ^ B. Then feeds it to table CRC.
+    __attribute__((target("sse2,pclmul")))
+    static std::uint32_t fold(std::uint32_t crc, const std::uint8_t* data, std::size_t blocksCount)
+    {
+        const __m128i constants = _mm_set_epi64x(SoftwareCrc::shift(1, 192), SoftwareCrc::shift(1, 128));
+
+        __m128i x = _mm_xor_si128(loadBlock(data), _mm_set_epi32(static_cast<int>(crc), 0, 0, 0));
+        for(std::size_t i = 1; i < blocksCount; ++i)
+        {
+            data += 16;
+            __m128i high = _mm_clmulepi64_si128(x, constants, 0x11);
+            __m128i low = _mm_clmulepi64_si128(x, constants, 0x00);
+            x = _mm_xor_si128(_mm_xor_si128(high, low), loadBlock(data));
+        }
+
+        alignas(16) std::uint32_t words[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(words), x);
+        std::uint32_t value = 0;
+        for(std::uint8_t i = 4; i > 0; --i)
+        {
+            value = TableCrc<8>::update(value, words[i - 1]);
+        }
+        return value;
+    }
+#else
+    static std::uint32_t fold(std::uint32_t crc, const std::uint8_t*, std::size_t)
+    {
+        return crc;
+    }
+#endif
+
+    std::uint32_t crc = SoftwareCrc::initialValue;
+};
+
+}
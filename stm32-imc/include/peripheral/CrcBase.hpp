@@ -2,11 +2,21 @@
 
 #include <containers/Span.hpp>
 #include <cstdint>
+#include <cstring>
 #include <type_traits>
 
 namespace DynaSoft
 {
 
+/// Method of feeding bytes to CRC unit. Each gives different CRC value for the same bytes.
+enum class CrcFeed : std::uint8_t
+{
+    /// Each byte is casted to std::uint32_t and added separately.
+    Bytes,
+    /// Bytes are packed into 32-bit little-endian words, remaining 1-3 bytes are added separately.
+    Words
+};
+
 /// Base class for CRC unit, that abstracts CRC hardware/algorithm.
 ///
 /// As it may use global CRC hardware it's state should be treaded as shared
@@ -48,6 +58,36 @@ public:
         }
     }
 
+    /// Adds all bytes of given buffer packed into 32-bit little-endian words, so CRC unit is fed
+    /// 4 times less often. Remaining 1-3 bytes are casted to std::uint32_t and added separately.
+    /// Buffer doesn't need to be aligned.
+    template<typename T>
+    void addWords(Span<T> buffer)
+    {
+        static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value && sizeof(T) == 1, "CrcBase::addWords requires buffer of bytes");
+        const std::uint8_t* data = buffer.begin();
+        std::size_t wordsCount = buffer.size() / 4;
+        static_cast<Derived*>(this)->_addWords(data, wordsCount);
+        for(data += wordsCount * 4; data != buffer.end(); ++data)
+        {
+            add(static_cast<std::uint32_t>(*data));
+        }
+    }
+
+    /// Adds all bytes of given buffer using given method.
+    template<typename T>
+    void add(Span<T> buffer, CrcFeed feed)
+    {
+        if(feed == CrcFeed::Words)
+        {
+            addWords(buffer);
+        }
+        else
+        {
+            add(buffer);
+        }
+    }
+
     /// Returns current CRC value.
     std::uint32_t get()
     {
@@ -59,5 +99,18 @@ public:
     {
         static_cast<Derived*>(this)->_reset();
     }
+
+protected:
+    /// Adds given count of 32-bit little-endian words read from possibly unaligned memory.
+    /// Derived may provide its own _addWords if it can process several words at once.
+    void _addWords(const std::uint8_t* data, std::size_t wordsCount)
+    {
+        for(std::size_t i = 0; i < wordsCount; ++i, data += 4)
+        {
+            std::uint32_t word;
+            std::memcpy(&word, data, 4);
+            add(word);
+        }
+    }
 };
 }
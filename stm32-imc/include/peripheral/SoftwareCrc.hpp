@@ -0,0 +1,53 @@
+#pragma once
+
+#include <peripheral/CrcBase.hpp>
+#include <cstdint>
+
+namespace DynaSoft
+{
+
+/// Software implementation of CRC unit, which gives the same results as STM32 hardware CRC unit.
+///
+/// CRC-32 with polynomial 0x04C11DB7 and initial value 0xFFFFFFFF, without reflection and final xor,
+/// computed over 32-bit words (most significant bit first).
+/// Processes one bit at a time, so it is slow, but doesn't need any tables.
+/// May be used as a reference model in tests (see TableCrc and ClmulCrc for faster ones).
+class SoftwareCrc : public CrcBase<SoftwareCrc>
+{
+public:
+    static constexpr std::uint32_t polynomial = 0x04C11DB7;
+    static constexpr std::uint32_t initialValue = 0xFFFFFFFF;
+
+    using CrcBase::CrcBase;
+
+    /// Returns value multiplied by x^bits modulo polynomial, i.e. CRC register after shifting
+    /// given value by given number of bits with zero input.
+    static constexpr std::uint32_t shift(std::uint32_t value, std::uint16_t bits)
+    {
+        for(std::uint16_t i = 0; i < bits; ++i)
+        {
+            value = (value & 0x80000000) ? (value << 1) ^ polynomial : (value << 1);
+        }
+        return value;
+    }
+
+    void _add(std::uint32_t x)
+    {
+        crc = shift(crc ^ x, 32);
+    }
+
+    std::uint32_t _get()
+    {
+        return crc;
+    }
+
+    void _reset()
+    {
+        crc = initialValue;
+    }
+
+private:
+    std::uint32_t crc = initialValue;
+};
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <peripheral/SoftwareCrc.hpp>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace DynaSoft
+{
+
+/// Table-driven software CRC unit, which gives the same results as SoftwareCrc and STM32 hardware CRC unit.
+///
+/// Uses slice-by-N algorithm with N lookup tables of 256 words, which are generated at compile time
+/// (so they are placed in flash on MCU):
+/// - 1 table (1 KiB) - each word is processed byte after byte,
+/// - 4 tables (4 KiB) - each word is processed with 4 independent lookups,
+/// - 8 tables (8 KiB) - as above, but addWords() processes two words at once.
+///
+/// \tparam slicesCount Count of lookup tables: 1, 4 or 8.
+template<std::uint8_t slicesCount = 4>
+class TableCrc : public CrcBase<TableCrc<slicesCount>>
+{
+    static_assert(slicesCount == 1 || slicesCount == 4 || slicesCount == 8, "TableCrc supports 1, 4 or 8 slices");
+
+public:
+    using Table = std::array<std::uint32_t, 256>;
+
+    using CrcBase<TableCrc>::CrcBase;
+
+    /// Returns CRC register value after adding given word to CRC with given value.
+    static std::uint32_t update(std::uint32_t crc, std::uint32_t x)
+    {
+        std::uint32_t value = crc ^ x;
+        if constexpr(slicesCount == 1)
+        {
+            for(std::uint8_t i = 0; i < 4; ++i)
+            {
+                value = (value << 8) ^ tables[0][value >> 24];
+            }
+            return value;
+        }
+        else
+        {
+            return tables[3][value >> 24] ^ tables[2][(value >> 16) & 0xFF] ^
+                tables[1][(value >> 8) & 0xFF] ^ tables[0][value & 0xFF];
+        }
+    }
+
+    /// Returns CRC register value after adding given count of little-endian words to CRC with given value.
+    static std::uint32_t update(std::uint32_t crc, const std::uint8_t* data, std::size_t wordsCount)
+    {
+        std::uint32_t value = crc;
+        if constexpr(slicesCount == 8)
+        {
+            for(; wordsCount >= 2; wordsCount -= 2, data += 8)
+            {
+                std::uint32_t first = readWord(data) ^ value;
+                std::uint32_t second = readWord(data + 4);
+                value = tables[7][first >> 24] ^ tables[6][(first >> 16) & 0xFF] ^
+                    tables[5][(first >> 8) & 0xFF] ^ tables[4][first & 0xFF] ^
+                    tables[3][second >> 24] ^ tables[2][(second >> 16) & 0xFF] ^
+                    tables[1][(second >> 8) & 0xFF] ^ tables[0][second & 0xFF];
+            }
+        }
+        for(; wordsCount > 0; --wordsCount, data += 4)
+        {
+            value = update(value, readWord(data));
+        }
+        return value;
+    }
+
+    void _add(std::uint32_t x)
+    {
+        crc = update(crc, x);
+    }
+
+    void _addWords(const std::uint8_t* data, std::size_t wordsCount)
+    {
+        crc = update(crc, data, wordsCount);
+    }
+
+    std::uint32_t _get()
+    {
+        return crc;
+    }
+
+    void _reset()
+    {
+        crc = SoftwareCrc::initialValue;
+    }
+
+private:
+    // With 1 slice table shifts top byte by 8 bits. Otherwise table i shifts byte (i % 4) of a word
+    // by 32 bits (tables 0-3) or 64 bits (tables 4-7), so their results may be xored together.
+    static constexpr std::array<Table, slicesCount> makeTables()
+    {
+        std::array<Table, slicesCount> result{};
+        for(std::uint8_t i = 0; i < slicesCount; ++i)
+        {
+            for(std::uint16_t b = 0; b < 256; ++b)
+            {
+                result[i][b] = slicesCount == 1 ?
+                    SoftwareCrc::shift(std::uint32_t{b} << 24, 8) :
+                    SoftwareCrc::shift(std::uint32_t{b} << (8 * (i % 4)), 32 * (1 + i / 4));
+            }
+        }
+        return result;
+    }
+
+    static std::uint32_t readWord(const std::uint8_t* data)
+    {
+        std::uint32_t word;
+        std::memcpy(&word, data, 4);
+        return word;
+    }
+
+    static constexpr std::array<Table, slicesCount> tables = makeTables();
+
+    std::uint32_t crc = SoftwareCrc::initialValue;
+};
+
+}
@@ -1,13 +1,68 @@
 #pragma once
 
+#include <containers/Span.hpp>
 #include <misc/Callback.hpp>
 #include <peripheral/InterruptTimerBase.hpp>
 #include <array>
+#include <atomic>
 #include <cstdint>
+#include <initializer_list>
 
 namespace DynaSoft
 {
 
+/// Method of marking boundaries of sent messages on the line.
+enum class UartFraming : std::uint8_t
+{
+    /// Message ends when line is idle for some time. Sender needs to call generateIdleLine() after each
+    /// message and receiver restarts idle detection timer after each received byte.
+    IdleLine,
+    /// Same as IdleLine, but idle line is detected by UART hardware (after one idle character) and reported
+    /// by Derived with handleIdleLineDetected(), so InterruptTimer channel 1 is not used during receive.
+    /// Gaps between bytes of sent message need to be shorter than one character.
+    HardwareIdleLine,
+    /// Messages are COBS encoded on the fly and terminated with 0 byte, so they may be sent back to back.
+    /// Receiver resynchronizes on next 0 byte after any corrupted one. IdleCallback fires on each terminator.
+    Cobs
+};
+
+/// Interrupt which triggers sending of next byte.
+enum class UartTransmitInterrupt : std::uint8_t
+{
+    /// Next byte is sent from handleTransmissionComplete(), after previous one is fully shifted out.
+    TransmissionComplete,
+    /// Next byte is sent from handleDataRegisterEmpty(), while previous one is still being shifted out,
+    /// so bytes are sent without gaps. handleTransmissionComplete() only ends whole message.
+    DataRegisterEmpty,
+    /// Each sent memory segment is passed at once to Derived::_sendBlock() (to be sent by DMA), Derived calls
+    /// handleBlockSent() when block is transferred. handleTransmissionComplete() only ends whole message.
+    /// Not used with UartFraming::Cobs, as it needs to encode bytes one by one - TransmissionComplete is used instead.
+    Dma
+};
+
+/// Receive errors passed to UartBase::ErrorCallback.
+enum class UartError : std::uint8_t
+{
+    None = 0,
+    ReceiveBufferOverrun,
+    ReceiveNoise,
+    ReceiveFrameError,
+    ReceiveParityError,
+};
+
+/// Flags of UART status register passed to UartBase::handleInterrupt() (same as bits of STM32 USART_SR).
+namespace UartStatus
+{
+constexpr std::uint8_t ParityError = 1 << 0;
+constexpr std::uint8_t FrameError = 1 << 1;
+constexpr std::uint8_t NoiseError = 1 << 2;
+constexpr std::uint8_t Overrun = 1 << 3;
+constexpr std::uint8_t IdleLine = 1 << 4;
+constexpr std::uint8_t DataReceived = 1 << 5;
+constexpr std::uint8_t TransmissionComplete = 1 << 6;
+constexpr std::uint8_t DataRegisterEmpty = 1 << 7;
+}
+
 /// Base class for UART peripheral, that abstracts hardware and implements some of send/receive logic.
 ///
 /// \tparam Derived Actual implementation of UART.
@@ -15,6 +70,12 @@ namespace DynaSoft
 /// \tparam SendBuffer Container for sending buffer that provides vector-like interface. Should be able to contain largest sent message.
 ///
 /// Class Derived needs to add UartBase as friend.
+/// Derived may dispatch its interrupt with handleInterrupt(), which requires _clearTransmissionComplete()
+/// and, when receiving by DMA, _processDmaReceivedData().
+/// With UartTransmitInterrupt::DataRegisterEmpty, Derived needs to call handleDataRegisterEmpty() from
+/// its interrupt, which is enabled/disabled by _enableDataRegisterEmptyInterrupt()/_disableDataRegisterEmptyInterrupt().
+/// With UartTransmitInterrupt::Dma, Derived needs to implement _sendBlock() and call handleBlockSent().
+/// Data received by circular DMA should be passed to handleDmaDataReceived() instead of handleDataReceived().
 template<typename Derived, typename InterruptTimer, typename SendBuffer>
 class UartBase
 {
@@ -23,15 +84,26 @@ public:
     using RxCallback = Callback<void(CallbackContext)>;
     using TxCallback = Callback<void(CallbackContext)>;
     using ErrorCallback = Callback<void(CallbackContext, std::uint8_t)>;
+    using SegmentCallback = Callback<void(CallbackContext, std::uint8_t)>;
+
+    /// Continuous block of memory sent by sendSegments().
+    using Segment = Span<const std::uint8_t>;
+
+    /// Maximum number of segments that may be passed to sendSegments().
+    static constexpr std::uint8_t maxSegmentsCount = 3;
 
     template<bool B = std::is_default_constructible_v<SendBuffer>, typename std::enable_if<B, int>::type = 0>
     UartBase(InterruptTimer& irqTimer_,
              std::uint32_t checkForIdleTimeUs_,
-             std::uint32_t generateIdleTimeUs_) :
+             std::uint32_t generateIdleTimeUs_,
+             UartFraming framing_ = UartFraming::IdleLine,
+             UartTransmitInterrupt transmitInterrupt_ = UartTransmitInterrupt::TransmissionComplete) :
         irqTimer{irqTimer_},
         sendQueue{},
         checkForIdleTimeUs{checkForIdleTimeUs_},
-        generateIdleTimeUs{generateIdleTimeUs_}
+        generateIdleTimeUs{generateIdleTimeUs_},
+        framing{framing_},
+        transmitInterrupt{transmitInterrupt_}
     {
     }
 
@@ -39,11 +111,15 @@ public:
     UartBase(SendBufferInitializer&& initSendBuffer,
              InterruptTimer& irqTimer_,
              std::uint32_t checkForIdleTimeUs_,
-             std::uint32_t generateIdleTimeUs_) :
+             std::uint32_t generateIdleTimeUs_,
+             UartFraming framing_ = UartFraming::IdleLine,
+             UartTransmitInterrupt transmitInterrupt_ = UartTransmitInterrupt::TransmissionComplete) :
         irqTimer{irqTimer_},
         sendQueue{std::forward<SendBufferInitializer>(initSendBuffer)},
         checkForIdleTimeUs{checkForIdleTimeUs_},
-        generateIdleTimeUs{generateIdleTimeUs_}
+        generateIdleTimeUs{generateIdleTimeUs_},
+        framing{framing_},
+        transmitInterrupt{transmitInterrupt_}
     {
     }
 
@@ -59,6 +135,43 @@ public:
         static_cast<Derived*>(this)->_turnOff();
     }
 
+    /// Returns method used to mark message boundaries.
+    UartFraming getFraming() const
+    {
+        return framing;
+    }
+
+    /// Changes baud rate together with idle line times, which should be scaled to last the same count of characters.
+    /// Should be called when no transmission is ongoing - bytes currently received may be corrupted.
+    void setBaudRate(std::uint32_t baudRate, std::uint32_t checkForIdleTimeUs_, std::uint32_t generateIdleTimeUs_)
+    {
+        checkForIdleTimeUs = checkForIdleTimeUs_;
+        generateIdleTimeUs = generateIdleTimeUs_;
+        static_cast<Derived*>(this)->_setBaudRate(baudRate);
+    }
+
+    /// Returns baud rate currently used by UART.
+    std::uint32_t getBaudRate() const
+    {
+        return static_cast<const Derived*>(this)->_getBaudRate();
+    }
+
+    std::uint32_t getCheckForIdleTimeUs() const
+    {
+        return checkForIdleTimeUs;
+    }
+
+    std::uint32_t getGenerateIdleTimeUs() const
+    {
+        return generateIdleTimeUs;
+    }
+
+    /// Returns true if messages need to be separated with generateIdleLine().
+    bool isIdleLineFraming() const
+    {
+        return framing != UartFraming::Cobs;
+    }
+
     /// Returns true if Uart is currently sending a message.
     bool isTransmitOngoing() const
     {
@@ -67,16 +180,35 @@ public:
 
     /// Enqueues data for sending.
     /// Only one message of max size sendBufferSize may be enqueued at the time.
+    /// If idle line is currently generated, transmission starts after it.
     /// If there was space in queue returns true.
     /// After whole data is transmitted callback registered in setDataSentCallback() is called.
     bool send(std::uint8_t* data, std::uint8_t size)
     {
         if(size > 0 && size <= sendQueue.max_size() && !isTransmiting)
         {
-            isTransmiting = true;
             sendQueue.assign(data, data + size);
-            sendQueueIndex = 1;
-            sendByte(data[0]);
+            startTransmission({Segment{sendQueue.data(), sendQueue.data() + sendQueue.size()}});
+            return true;
+        }
+        return false;
+    }
+
+    /// Enqueues given memory segments for sending, one after another, without copying them to send buffer.
+    /// Memory of segments must stay unchanged until callback registered in setDataSentCallback() is called.
+    /// Empty segments are skipped, at most maxSegmentsCount segments may be given.
+    /// If there was no other transmission ongoing returns true.
+    bool sendSegments(std::initializer_list<Segment> segments)
+    {
+        std::size_t size = 0;
+        for(const Segment& segment: segments)
+        {
+            size += segment.size();
+        }
+
+        if(size > 0 && segments.size() <= maxSegmentsCount && !isTransmiting)
+        {
+            startTransmission(segments);
             return true;
         }
         return false;
@@ -90,7 +222,7 @@ public:
     }
 
     /// Generates IDLE on Tx - so stop sending for some time.
-    /// IDLE indicates end of message for receiver end.
+    /// IDLE indicates end of message for receiver end. Not needed with UartFraming::Cobs.
     void generateIdleLine()
     {
         isGeneratingIdle = true;
@@ -98,10 +230,7 @@ public:
         {
             UartBase& self = *static_cast<UartBase*>(ctx);
             self.isGeneratingIdle = false;
-            if(self.sendQueueIndex < self.sendQueue.size())
-            {
-                self.sendByte(self.sendQueue[self.sendQueueIndex++]);
-            }
+            self.tryStartSending();
         }, this});
     }
 
@@ -129,7 +258,7 @@ public:
         static_cast<Derived*>(this)->_resumeReceive();
     }
 
-    /// Called when IDLE was detected on Rx.
+    /// Called when IDLE was detected on Rx (or message terminator with UartFraming::Cobs).
     void setIdleLineDetectedCallback(IdleCallback callback)
     {
         onIdleLineDetected = callback;
@@ -156,6 +285,15 @@ public:
         onReceiveError = callback;
     }
 
+    /// Fires before first byte of segment passed to sendSegments() is read, so that its contents may be completed
+    /// while previous ones are transmitted. Index of segment is passed.
+    /// Fires from interrupt, unless segment is read right when transmission starts (i.e. by COBS encoder).
+    /// For segment 0 it fires right before first byte of message is sent, after idle line preceding it ends.
+    void setSegmentStartCallback(SegmentCallback callback)
+    {
+        onSegmentStart = callback;
+    }
+
 protected:
     void sendByte(std::uint8_t data)
     {
@@ -169,13 +307,17 @@ protected:
 
     void handleTransmissionComplete()
     {
-        if(!isGeneratingIdle)
+        if(!isGeneratingIdle && !isBlockTransferOngoing)
         {
-            if(sendQueueIndex < sendQueue.size())
+            if(hasNextByte())
             {
-                sendByte(sendQueue[sendQueueIndex++]);
+                // With DataRegisterEmpty it may happen only if interrupt was delayed, next byte is sent from it
+                if(transmitInterrupt != UartTransmitInterrupt::DataRegisterEmpty && !isBlockTransmit())
+                {
+                    sendByte(popNextByte());
+                }
             }
-            else
+            else if(isTransmiting)
             {
                 isTransmiting = false;
                 onDataSent();
@@ -183,35 +325,393 @@ protected:
         }
     }
 
+    /// Dispatches UART interrupt given flags of status register (see UartStatus), with DataRegisterEmpty
+    /// masked out if its interrupt is disabled. Flags cleared by reading status register followed by data
+    /// register are cleared with _receiveByte(), unless received byte waits for DMA, which reads it instead.
+    /// With isReceiveDma received bytes are left for DMA and its data is processed on idle line.
+    void handleInterrupt(std::uint8_t status, bool isReceiveDma)
+    {
+        constexpr std::uint8_t byteErrors = UartStatus::ParityError | UartStatus::NoiseError | UartStatus::FrameError;
+
+        if(status & UartStatus::DataRegisterEmpty)
+        {
+            // Writing data register after reading status also clears TC, so it is set only after last byte
+            handleDataRegisterEmpty();
+        }
+        else if(status & UartStatus::TransmissionComplete)
+        {
+            static_cast<Derived*>(this)->_clearTransmissionComplete();
+            handleTransmissionComplete();
+        }
+        else if(!isReceiveDma && (status & UartStatus::DataReceived))
+        {
+            // Errors are checked here as well, as byte and error may appear in single interrupt
+            if(status & byteErrors)
+            {
+                handleReceiveError(status, isReceiveDma);
+            }
+            else
+            {
+                handleDataReceived();
+            }
+        }
+        else if(status & UartStatus::IdleLine)
+        {
+            clearReceiveFlags(status, isReceiveDma);
+            if(isReceiveDma)
+            {
+                static_cast<Derived*>(this)->_processDmaReceivedData();
+            }
+            handleIdleLineDetected();
+        }
+        else if(status & (byteErrors | UartStatus::Overrun))
+        {
+            handleReceiveError(status, isReceiveDma);
+        }
+    }
+
+    void handleReceiveError(std::uint8_t status, bool isReceiveDma)
+    {
+        // Erroneous byte is dropped, unless it is already taken by DMA
+        clearReceiveFlags(status, isReceiveDma);
+
+        UartError error = UartError::ReceiveFrameError;
+        if(status & UartStatus::Overrun)
+        {
+            // Last read wasn't fast enough - shouldn't really happen unless onDataReceived is too long
+            error = UartError::ReceiveBufferOverrun;
+        }
+        else if(status & UartStatus::ParityError)
+        {
+            error = UartError::ReceiveParityError;
+        }
+        else if(status & UartStatus::NoiseError)
+        {
+            error = UartError::ReceiveNoise;
+        }
+        onReceiveError(static_cast<std::uint8_t>(error));
+    }
+
+    /// Completes clearing sequence of flags (status register read followed by data register read).
+    /// If received byte waits for DMA, data register is not read, so that byte is not lost - DMA reads it instead.
+    void clearReceiveFlags(std::uint8_t status, bool isReceiveDma)
+    {
+        if(!isReceiveDma || !(status & UartStatus::DataReceived))
+        {
+            receiveByte();
+        }
+    }
+
+    void handleDataRegisterEmpty()
+    {
+        if(hasNextByte())
+        {
+            sendByte(popNextByte());
+        }
+        else
+        {
+            // Message ends with transmission complete interrupt
+            static_cast<Derived*>(this)->_disableDataRegisterEmptyInterrupt();
+        }
+    }
+
+    void handleBlockSent()
+    {
+        isBlockTransferOngoing = false;
+        // Message ends with transmission complete interrupt
+        if(hasNextRawByte())
+        {
+            sendNextBlock();
+        }
+    }
+
+    void startSending()
+    {
+        onSegmentStart(0);
+        if(isBlockTransmit())
+        {
+            sendNextBlock();
+            return;
+        }
+
+        sendByte(popNextByte());
+        if(transmitInterrupt == UartTransmitInterrupt::DataRegisterEmpty)
+        {
+            static_cast<Derived*>(this)->_enableDataRegisterEmptyInterrupt();
+        }
+    }
+
+    bool isBlockTransmit() const
+    {
+        return transmitInterrupt == UartTransmitInterrupt::Dma && framing != UartFraming::Cobs;
+    }
+
+    void sendNextBlock()
+    {
+        const Segment& segment = sendSegmentsQueue[sendSegmentIndex];
+        const std::uint8_t* block = segment.begin() + sendByteIndex;
+        std::uint16_t blockSize = segment.size() - sendByteIndex;
+        sendByteIndex = segment.size();
+        isBlockTransferOngoing = true;
+        static_cast<Derived*>(this)->_sendBlock(block, blockSize);
+    }
+
     void handleDataReceived()
     {
-        lastReceived = receiveByte();
+        processReceivedByte(receiveByte());
+    }
 
-        // Reset wait time for idle
-        irqTimer.scheduleInterrupt(1, checkForIdleTimeUs, {[](CallbackContext ctx, std::uint32_t)
+    /// Processes bytes written by circular DMA to given buffer since previous call.
+    /// Should be called often enough, so that DMA doesn't overwrite unprocessed data
+    /// (i.e. on idle line, half transfer and transfer complete).
+    /// \param remaining Count of transfers left until DMA wraps to beginning of buffer (DMA counter register).
+    void handleDmaDataReceived(Span<const std::uint8_t> buffer, std::uint16_t remaining)
+    {
+        std::uint16_t size = buffer.size();
+        std::uint16_t writeIndex = remaining < size ? size - remaining : 0;
+        while(dmaReadIndex != writeIndex)
         {
-            static_cast<UartBase*>(ctx)->onIdleLineDetected();
-        }, this});
+            processReceivedByte(buffer[dmaReadIndex]);
+            dmaReadIndex = dmaReadIndex + 1 < size ? dmaReadIndex + 1 : 0;
+        }
+    }
+
+    void processReceivedByte(std::uint8_t x)
+    {
+        if(framing == UartFraming::Cobs)
+        {
+            handleCobsByteReceived(x);
+            return;
+        }
+
+        lastReceived = x;
+
+        if(framing == UartFraming::IdleLine)
+        {
+            // Reset wait time for idle
+            irqTimer.scheduleInterrupt(1, checkForIdleTimeUs, {[](CallbackContext ctx, std::uint32_t)
+            {
+                static_cast<UartBase*>(ctx)->onIdleLineDetected();
+            }, this});
+        }
 
         onDataReceived();
     }
 
+    /// Should be called when UART hardware detects idle line after received data.
+    /// Ignored unless UartFraming::HardwareIdleLine is used.
+    void handleIdleLineDetected()
+    {
+        if(framing == UartFraming::HardwareIdleLine)
+        {
+            onIdleLineDetected();
+        }
+    }
+
+    void startTransmission(std::initializer_list<Segment> segments)
+    {
+        // Idle timer interrupt is not masked by suspendSend(), so message has to be complete before it is visible
+        std::copy(segments.begin(), segments.end(), sendSegmentsQueue.begin());
+        sendSegmentsCount = segments.size();
+        sendSegmentIndex = 0;
+        sendByteIndex = 0;
+        startedSegmentIndex = 0;
+        cobsSendState = CobsSendState::Code;
+        isSendStartClaimed = false;
+        isTransmiting = true;
+        // If idle line is being generated, first byte will be sent after it ends
+        tryStartSending();
+    }
+
+    /// Starts sending message unless idle line is being generated. Called both when message is enqueued and from
+    /// idle timer interrupt - only the first call which gets past idle line starts it.
+    void tryStartSending()
+    {
+        if(!isTransmiting || isGeneratingIdle || isSendStartClaimed.exchange(true))
+        {
+            return;
+        }
+        if(hasNextByte())
+        {
+            startSending();
+        }
+    }
+
+    bool hasNextByte()
+    {
+        if(framing == UartFraming::Cobs)
+        {
+            return cobsSendState != CobsSendState::Done;
+        }
+        return hasNextRawByte();
+    }
+
+    std::uint8_t popNextByte()
+    {
+        if(framing == UartFraming::Cobs)
+        {
+            return popNextCobsByte();
+        }
+        return popNextRawByte();
+    }
+
+    /// Moves to next non-empty segment if current one is fully sent.
+    bool hasNextRawByte()
+    {
+        while(sendSegmentIndex < sendSegmentsCount && sendByteIndex >= sendSegmentsQueue[sendSegmentIndex].size())
+        {
+            sendSegmentIndex++;
+            sendByteIndex = 0;
+            notifySegmentStart(sendSegmentIndex);
+        }
+        return sendSegmentIndex < sendSegmentsCount;
+    }
+
+    void notifySegmentStart(std::uint8_t segment)
+    {
+        if(segment > startedSegmentIndex && segment < sendSegmentsCount)
+        {
+            startedSegmentIndex = segment;
+            onSegmentStart(segment);
+        }
+    }
+
+    std::uint8_t popNextRawByte()
+    {
+        return sendSegmentsQueue[sendSegmentIndex][sendByteIndex++];
+    }
+
+    /// Each block of non-zero bytes is preceded by code byte equal to its size + 1. Zero byte following
+    /// the block is skipped, as it is implied by code smaller than cobsMaxCode. Message ends with 0 byte.
+    std::uint8_t popNextCobsByte()
+    {
+        if(cobsSendState == CobsSendState::Data)
+        {
+            if(cobsSendBlockRemaining > 0 && hasNextRawByte())
+            {
+                cobsSendBlockRemaining--;
+                return popNextRawByte();
+            }
+
+            if(cobsSendBlockEndsWithZero && hasNextRawByte())
+            {
+                popNextRawByte();
+                cobsSendState = CobsSendState::Code;
+            }
+            else if(cobsSendBlockIsFull && hasNextRawByte())
+            {
+                cobsSendState = CobsSendState::Code;
+            }
+            else
+            {
+                cobsSendState = CobsSendState::Done;
+                return 0;
+            }
+        }
+
+        // Find size of next block without consuming it
+        std::uint8_t segment = sendSegmentIndex;
+        std::uint8_t index = sendByteIndex;
+        std::uint8_t blockSize = 0;
+        cobsSendBlockEndsWithZero = false;
+        while(segment < sendSegmentsCount && blockSize < cobsMaxCode - 1)
+        {
+            if(index >= sendSegmentsQueue[segment].size())
+            {
+                segment++;
+                index = 0;
+                notifySegmentStart(segment);
+            }
+            else if(sendSegmentsQueue[segment][index] == 0)
+            {
+                cobsSendBlockEndsWithZero = true;
+                break;
+            }
+            else
+            {
+                blockSize++;
+                index++;
+            }
+        }
+
+        cobsSendBlockRemaining = blockSize;
+        cobsSendBlockIsFull = blockSize == cobsMaxCode - 1;
+        cobsSendState = CobsSendState::Data;
+        return blockSize + 1;
+    }
+
+    void handleCobsByteReceived(std::uint8_t x)
+    {
+        if(x == 0)
+        {
+            cobsReceiveCode = 0;
+            cobsReceiveBlockRemaining = 0;
+            onIdleLineDetected();
+        }
+        else if(cobsReceiveBlockRemaining == 0)
+        {
+            // Code byte - zero is implied between blocks, unless previous one was full
+            bool isZeroImplied = cobsReceiveCode != 0 && cobsReceiveCode != cobsMaxCode;
+            cobsReceiveCode = x;
+            cobsReceiveBlockRemaining = x - 1;
+            if(isZeroImplied)
+            {
+                lastReceived = 0;
+                onDataReceived();
+            }
+        }
+        else
+        {
+            cobsReceiveBlockRemaining--;
+            lastReceived = x;
+            onDataReceived();
+        }
+    }
+
     InterruptTimer& irqTimer;
 
     SendBuffer sendQueue;
-    std::uint8_t sendQueueIndex = 0;
+    std::array<Segment, maxSegmentsCount> sendSegmentsQueue{};
+    std::uint8_t sendSegmentsCount = 0;
+    std::uint8_t sendSegmentIndex = 0;
+    std::uint8_t sendByteIndex = 0;
+    std::uint8_t startedSegmentIndex = 0;
+
+    enum class CobsSendState : std::uint8_t
+    {
+        Code,
+        Data,
+        Done
+    };
+
+    static constexpr std::uint8_t cobsMaxCode = 0xFF;
+
+    CobsSendState cobsSendState = CobsSendState::Code;
+    std::uint8_t cobsSendBlockRemaining = 0;
+    bool cobsSendBlockEndsWithZero = false;
+    bool cobsSendBlockIsFull = false;
+
+    std::uint8_t cobsReceiveCode = 0; // 0 at the beginning of message
+    std::uint8_t cobsReceiveBlockRemaining = 0;
+
+    volatile bool isBlockTransferOngoing = false;
+    std::uint16_t dmaReadIndex = 0;
 
     volatile bool isTransmiting = false;
     volatile bool isGeneratingIdle = false;
+    std::atomic<bool> isSendStartClaimed = false;
     volatile std::uint8_t lastReceived = 0;
 
     std::uint32_t checkForIdleTimeUs = 0;
     std::uint32_t generateIdleTimeUs = 0;
+    UartFraming framing = UartFraming::IdleLine;
+    UartTransmitInterrupt transmitInterrupt = UartTransmitInterrupt::TransmissionComplete;
 
     IdleCallback onIdleLineDetected{};
     RxCallback onDataReceived{};
     TxCallback onDataSent{};
     ErrorCallback onReceiveError{};
+    SegmentCallback onSegmentStart{};
 };
 
 }
@@ -14,6 +14,7 @@ namespace DynaSoft
 {
 class StmUart;
 void uartIrqHandler(StmUart*);
+void uartDmaIrqHandler(StmUart*);
 
 enum class UartChannel : std::uint8_t
 {
@@ -28,24 +29,24 @@ struct UartSettings
     std::uint32_t baudRate = 921600;
     std::uint32_t checkForIdleTimeUs = 50;
     std::uint32_t generateIdleTimeUs = 100;
-};
-
-enum class UartError : std::uint8_t
-{
-    None = 0,
-    ReceiveBufferOverrun,
-    ReceiveNoise,
-    ReceiveFrameError,
-    ReceiveParityError,
+    UartFraming framing = UartFraming::IdleLine;
+    UartTransmitInterrupt transmitInterrupt = UartTransmitInterrupt::TransmissionComplete;
 };
 
 /// Concrete implementation of UART interface that handles hardware
+///
+/// If UartSettings::transmitInterrupt is UartTransmitInterrupt::Dma, sent data is transferred by DMA1.
+/// If receiveDmaBuffer is given, received data is written by circular DMA1 to it and processed on IDLE,
+/// half transfer and transfer complete interrupts - then UartSettings::framing should be HardwareIdleLine or Cobs.
 class StmUart : public UartBase<StmUart, StmInterruptTimer, SpanVector<std::uint8_t>>
 {
 public:
 	/// Initializes UART hardware. It needs to be turned on later.
-	/// sendBuffer needs to point to persistent memory with size at least equal to largest sent message
-    StmUart(StmGpio& gpio, StmInterruptTimer& irqTimer, const UartSettings& settings, Span<std::uint8_t> sendBuffer);
+	/// sendBuffer needs to point to persistent memory with size at least equal to largest message sent with send()
+	/// (it is not used by sendSegments(), which transmits directly from given memory)
+	/// receiveDmaBuffer needs to point to persistent memory, if empty DMA is not used for receiving
+    StmUart(StmGpio& gpio, StmInterruptTimer& irqTimer, const UartSettings& settings, Span<std::uint8_t> sendBuffer,
+            Span<std::uint8_t> receiveDmaBuffer = {});
 
 protected:
     using Base = UartBase<StmUart, StmInterruptTimer, SpanVector<std::uint8_t>>;
@@ -57,6 +58,17 @@ protected:
     void _resumeSend();
     void _suspendReceive();
     void _resumeReceive();
+    void _enableDataRegisterEmptyInterrupt();
+    void _disableDataRegisterEmptyInterrupt();
+    void _sendBlock(const std::uint8_t* data, std::uint16_t size);
+    void _setBaudRate(std::uint32_t baudRate);
+    void _clearTransmissionComplete();
+    void _processDmaReceivedData();
+
+    std::uint32_t _getBaudRate() const
+    {
+        return baudRate;
+    }
 
     void _sendByte(std::uint8_t data)
     {
@@ -72,15 +84,23 @@ protected:
 
 private:
     friend void uartIrqHandler(StmUart*); // Needed to call private method from interrupt
+    friend void uartDmaIrqHandler(StmUart*);
     void handleUartIrq();
-
-    void handleReceiveOverrunError();
-    void handleReceiveNoiseError();
-    void handleReceiveFrameError();
-    void handleReceiveParityError();
+    void handleDmaIrq();
+    void initDma(const UartSettings& settings);
 
     StmGpio& gpio;
     USART_TypeDef* uart = nullptr;
+    std::uint32_t baudRate = 0;
+
+    volatile bool isSendSuspended = false;
+    volatile bool isDataRegisterEmptyInterruptEnabled = false;
+
+    Span<std::uint8_t> receiveDmaBuffer;
+    DMA_Channel_TypeDef* transmitDma = nullptr;
+    DMA_Channel_TypeDef* receiveDma = nullptr;
+    std::uint8_t transmitDmaChannel = 0;
+    std::uint8_t receiveDmaChannel = 0;
 };
 
 }
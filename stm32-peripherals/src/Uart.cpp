@@ -9,6 +9,49 @@ DynaSoft::StmUart* gUart2 = nullptr;
 DynaSoft::StmUart* gUart3 = nullptr;
 
 constexpr std::uint32_t maxBaudRate = 2250 * 1000;
+
+// SR is passed to UartBase::handleInterrupt() as it is
+static_assert(USART_FLAG_PE == DynaSoft::UartStatus::ParityError && USART_FLAG_FE == DynaSoft::UartStatus::FrameError &&
+              USART_FLAG_NE == DynaSoft::UartStatus::NoiseError && USART_FLAG_ORE == DynaSoft::UartStatus::Overrun &&
+              USART_FLAG_IDLE == DynaSoft::UartStatus::IdleLine && USART_FLAG_RXNE == DynaSoft::UartStatus::DataReceived &&
+              USART_FLAG_TC == DynaSoft::UartStatus::TransmissionComplete && USART_FLAG_TXE == DynaSoft::UartStatus::DataRegisterEmpty,
+              "USART_SR flags don't match UartStatus");
+
+// DMA1 interrupt flags of given channel (1-7) in ISR / IFCR registers
+constexpr std::uint32_t dmaFlagTransferComplete(std::uint8_t channel)
+{
+    return 0x2u << (4 * (channel - 1));
+}
+
+constexpr std::uint32_t dmaFlagHalfTransfer(std::uint8_t channel)
+{
+    return 0x4u << (4 * (channel - 1));
+}
+
+constexpr std::uint32_t dmaFlagsAll(std::uint8_t channel)
+{
+    return 0xFu << (4 * (channel - 1));
+}
+
+std::uint8_t dmaIrqn(std::uint8_t channel)
+{
+    return DMA1_Channel1_IRQn + channel - 1;
+}
+
+// Interrupt enable bits are not changed by USART_Init
+// Returns baud rate actually set
+std::uint32_t initUsart(USART_TypeDef* uart, std::uint32_t baudRate)
+{
+    USART_InitTypeDef uartInit{};
+    uartInit.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
+    uartInit.USART_BaudRate = std::min(baudRate, maxBaudRate);
+    uartInit.USART_WordLength = USART_WordLength_9b;
+    uartInit.USART_StopBits = USART_StopBits_1;
+    uartInit.USART_Parity = USART_Parity_Even;
+    uartInit.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+    USART_Init(uart, &uartInit);
+    return uartInit.USART_BaudRate;
+}
 }
 
 extern "C"
@@ -27,6 +70,37 @@ void USART3_IRQHandler(void)
 {
     uartIrqHandler(gUart3);
 }
+
+// DMA1 channels: 2/3 - USART3 Tx/Rx, 4/5 - USART1 Tx/Rx, 6/7 - USART2 Rx/Tx
+void DMA1_Channel2_IRQHandler(void)
+{
+    uartDmaIrqHandler(gUart3);
+}
+
+void DMA1_Channel3_IRQHandler(void)
+{
+    uartDmaIrqHandler(gUart3);
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+    uartDmaIrqHandler(gUart1);
+}
+
+void DMA1_Channel5_IRQHandler(void)
+{
+    uartDmaIrqHandler(gUart1);
+}
+
+void DMA1_Channel6_IRQHandler(void)
+{
+    uartDmaIrqHandler(gUart2);
+}
+
+void DMA1_Channel7_IRQHandler(void)
+{
+    uartDmaIrqHandler(gUart2);
+}
 }
 
 namespace DynaSoft
@@ -36,9 +110,16 @@ void uartIrqHandler(StmUart* uart)
     uart->handleUartIrq();
 }
 
-StmUart::StmUart(StmGpio& gpio_, StmInterruptTimer& irqTimer_, const UartSettings& settings, Span<std::uint8_t> sendBuffer) :
-    Base{sendBuffer, irqTimer_, settings.checkForIdleTimeUs, settings.generateIdleTimeUs},
-    gpio{gpio_}
+void uartDmaIrqHandler(StmUart* uart)
+{
+    uart->handleDmaIrq();
+}
+
+StmUart::StmUart(StmGpio& gpio_, StmInterruptTimer& irqTimer_, const UartSettings& settings, Span<std::uint8_t> sendBuffer,
+                 Span<std::uint8_t> receiveDmaBuffer_) :
+    Base{sendBuffer, irqTimer_, settings.checkForIdleTimeUs, settings.generateIdleTimeUs, settings.framing, settings.transmitInterrupt},
+    gpio{gpio_},
+    receiveDmaBuffer{receiveDmaBuffer_}
 {
     std::uint8_t irqn = 0;
 
@@ -74,19 +155,17 @@ StmUart::StmUart(StmGpio& gpio_, StmInterruptTimer& irqTimer_, const UartSetting
         break;
     }
 
-    USART_InitTypeDef uartInit{};
-    uartInit.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
-    uartInit.USART_BaudRate = std::min(settings.baudRate, maxBaudRate);
-    uartInit.USART_WordLength = USART_WordLength_9b;
-    uartInit.USART_StopBits = USART_StopBits_1;
-    uartInit.USART_Parity = USART_Parity_Even;
-    uartInit.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
-    USART_Init(uart, &uartInit);
+    baudRate = initUsart(uart, settings.baudRate);
+
+    initDma(settings);
 
     // Enable interrupts
     uart->CR1 |= USART_CR1_PEIE;
     uart->CR1 |= USART_CR1_TCIE;
-    uart->CR1 |= USART_CR1_RXNEIE;
+    if(receiveDma == nullptr)
+    {
+        uart->CR1 |= USART_CR1_RXNEIE;
+    }
     uart->CR1 |= USART_CR1_IDLEIE;
     uart->CR3 |= USART_CR3_EIE;
 
@@ -98,6 +177,82 @@ StmUart::StmUart(StmGpio& gpio_, StmInterruptTimer& irqTimer_, const UartSetting
     NVIC_Init(&uartNvicInit);
 }
 
+void StmUart::initDma(const UartSettings& settings)
+{
+    bool useTransmitDma = settings.transmitInterrupt == UartTransmitInterrupt::Dma;
+    bool useReceiveDma = receiveDmaBuffer.size() > 0;
+    if(!useTransmitDma && !useReceiveDma)
+    {
+        return;
+    }
+
+    switch(settings.channel)
+    {
+    case UartChannel::Uart2:
+        transmitDmaChannel = 7;
+        receiveDmaChannel = 6;
+        transmitDma = DMA1_Channel7;
+        receiveDma = DMA1_Channel6;
+        break;
+    case UartChannel::Uart3:
+        transmitDmaChannel = 2;
+        receiveDmaChannel = 3;
+        transmitDma = DMA1_Channel2;
+        receiveDma = DMA1_Channel3;
+        break;
+    case UartChannel::Uart1:
+    default:
+        transmitDmaChannel = 4;
+        receiveDmaChannel = 5;
+        transmitDma = DMA1_Channel4;
+        receiveDma = DMA1_Channel5;
+        break;
+    }
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    std::uint32_t dataRegister = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(&uart->DR));
+
+    NVIC_InitTypeDef dmaNvicInit;
+    dmaNvicInit.NVIC_IRQChannelPreemptionPriority = IRQ_PRIORITY_GROUP_CRITICAL;
+    dmaNvicInit.NVIC_IRQChannelSubPriority = IRQ_PRIORITY_GROUP_LOW;
+    dmaNvicInit.NVIC_IRQChannelCmd = ENABLE;
+
+    if(useTransmitDma)
+    {
+        // Memory to peripheral, memory address is set for each block
+        transmitDma->CCR = 0;
+        transmitDma->CPAR = dataRegister;
+        transmitDma->CCR = DMA_CCR1_DIR | DMA_CCR1_MINC | DMA_CCR1_TCIE;
+        uart->CR3 |= USART_CR3_DMAT;
+
+        dmaNvicInit.NVIC_IRQChannel = dmaIrqn(transmitDmaChannel);
+        NVIC_Init(&dmaNvicInit);
+    }
+    else
+    {
+        transmitDma = nullptr;
+    }
+
+    if(useReceiveDma)
+    {
+        // Peripheral to memory, circular - it is never stopped
+        receiveDma->CCR = 0;
+        receiveDma->CPAR = dataRegister;
+        receiveDma->CMAR = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(receiveDmaBuffer.data()));
+        receiveDma->CNDTR = receiveDmaBuffer.size();
+        receiveDma->CCR = DMA_CCR1_MINC | DMA_CCR1_CIRC | DMA_CCR1_HTIE | DMA_CCR1_TCIE | DMA_CCR1_EN;
+        uart->CR3 |= USART_CR3_DMAR;
+
+        dmaNvicInit.NVIC_IRQChannel = dmaIrqn(receiveDmaChannel);
+        NVIC_Init(&dmaNvicInit);
+    }
+    else
+    {
+        receiveDma = nullptr;
+    }
+}
+
 void StmUart::_turnOn()
 {
     USART_Cmd(uart, ENABLE);
@@ -108,99 +263,121 @@ void StmUart::_turnOff()
     USART_Cmd(uart, DISABLE);
 }
 
+void StmUart::_setBaudRate(std::uint32_t baudRate_)
+{
+    bool isEnabled = (uart->CR1 & USART_CR1_UE) != 0;
+    USART_Cmd(uart, DISABLE);
+    baudRate = initUsart(uart, baudRate_);
+    if(isEnabled)
+    {
+        USART_Cmd(uart, ENABLE);
+    }
+}
+
 void StmUart::_suspendSend()
 {
-    uart->CR1 &= ~(USART_CR1_IDLEIE);
+    isSendSuspended = true;
+    uart->CR1 &= ~(USART_CR1_TCIE | USART_CR1_TXEIE);
 }
 
 void StmUart::_resumeSend()
 {
+    isSendSuspended = false;
     // Interrupts for pending events will be called after this call
-    uart->CR1 |= USART_CR1_IDLEIE;
+    uart->CR1 |= USART_CR1_TCIE;
+    if(isDataRegisterEmptyInterruptEnabled)
+    {
+        uart->CR1 |= USART_CR1_TXEIE;
+    }
 }
 
-void StmUart::_suspendReceive()
+void StmUart::_enableDataRegisterEmptyInterrupt()
 {
-    uart->CR1 &= ~(USART_CR1_RXNEIE);
+    isDataRegisterEmptyInterruptEnabled = true;
+    // If send is suspended interrupt is enabled on resume
+    if(!isSendSuspended)
+    {
+        uart->CR1 |= USART_CR1_TXEIE;
+    }
 }
 
-void StmUart::_resumeReceive()
+void StmUart::_disableDataRegisterEmptyInterrupt()
 {
-    // Interrupts for pending events will be called after this call
-    uart->CR1 |= USART_CR1_RXNEIE;
+    isDataRegisterEmptyInterruptEnabled = false;
+    uart->CR1 &= ~(USART_CR1_TXEIE);
 }
 
-void StmUart::handleUartIrq()
+void StmUart::_suspendReceive()
 {
-    if(uart->SR & USART_FLAG_TC)
-    {
-        USART_ClearFlag(uart, USART_FLAG_TC);
-        handleTransmissionComplete();
-    }
-    else if(uart->SR & USART_FLAG_RXNE)
-    {
-        // Some errors are checked here as well, as RXNE and error may appear in single interrupt
-        if(uart->SR & USART_FLAG_PE)
-        {
-            handleReceiveParityError();
-        }
-        else if(uart->SR & USART_FLAG_NE)
-        {
-            handleReceiveNoiseError();
-        }
-        else if(uart->SR & USART_FLAG_FE)
-        {
-            handleReceiveFrameError();
-        }
-        else
-        {
-            handleDataReceived();
-        }
-    }
-    else if(uart->SR & USART_FLAG_IDLE)
+    if(receiveDma != nullptr)
     {
-        _receiveByte();
+        // DMA keeps receiving, only processing of received data is suspended
+        uart->CR1 &= ~(USART_CR1_IDLEIE);
+        NVIC_DisableIRQ(static_cast<IRQn_Type>(dmaIrqn(receiveDmaChannel)));
     }
-    else if(uart->SR & USART_FLAG_ORE)
+    else
     {
-        handleReceiveOverrunError();
+        uart->CR1 &= ~(USART_CR1_RXNEIE);
     }
-    else if(uart->SR & USART_FLAG_NE)
+}
+
+void StmUart::_resumeReceive()
+{
+    // Interrupts for pending events will be called after this call
+    if(receiveDma != nullptr)
     {
-        handleReceiveNoiseError();
+        uart->CR1 |= USART_CR1_IDLEIE;
+        NVIC_EnableIRQ(static_cast<IRQn_Type>(dmaIrqn(receiveDmaChannel)));
     }
-    else if(uart->SR & USART_FLAG_FE)
+    else
     {
-        handleReceiveFrameError();
+        uart->CR1 |= USART_CR1_RXNEIE;
     }
 }
 
-void StmUart::handleReceiveOverrunError()
+void StmUart::_sendBlock(const std::uint8_t* data, std::uint16_t size)
 {
-    // Receive buffer overrun error - so last read wasn't fast enough
-    // Shouldn't really happen unless 'onDataReceive' is too long
-    onReceiveError(static_cast<std::uint8_t>(UartError::ReceiveBufferOverrun));
-    _receiveByte();
-    USART_ClearFlag(uart, USART_FLAG_ORE);
+    transmitDma->CCR &= ~(DMA_CCR1_EN);
+    transmitDma->CMAR = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(data));
+    transmitDma->CNDTR = size;
+    // TC needs to be cleared manually, as DMA writes to DR without reading SR
+    USART_ClearFlag(uart, USART_FLAG_TC);
+    transmitDma->CCR |= DMA_CCR1_EN;
 }
 
-void StmUart::handleReceiveNoiseError()
+void StmUart::handleUartIrq()
 {
-     _receiveByte();
-    onReceiveError(static_cast<std::uint8_t>(UartError::ReceiveNoise));
+    std::uint8_t status = static_cast<std::uint8_t>(uart->SR);
+    if(!(uart->CR1 & USART_CR1_TXEIE))
+    {
+        status &= ~UartStatus::DataRegisterEmpty;
+    }
+    handleInterrupt(status, receiveDma != nullptr);
+}
+
+void StmUart::handleDmaIrq()
+{
+    if(transmitDma != nullptr && (DMA1->ISR & dmaFlagTransferComplete(transmitDmaChannel)))
+    {
+        DMA1->IFCR = dmaFlagsAll(transmitDmaChannel);
+        transmitDma->CCR &= ~(DMA_CCR1_EN);
+        handleBlockSent();
+    }
+    if(receiveDma != nullptr && (DMA1->ISR & (dmaFlagTransferComplete(receiveDmaChannel) | dmaFlagHalfTransfer(receiveDmaChannel))))
+    {
+        DMA1->IFCR = dmaFlagsAll(receiveDmaChannel);
+        _processDmaReceivedData();
+    }
 }
 
-void StmUart::handleReceiveFrameError()
+void StmUart::_processDmaReceivedData()
 {
-    // Framing error - desynchronization or noise
-     _receiveByte();
-    onReceiveError(static_cast<std::uint8_t>(UartError::ReceiveFrameError));
+    handleDmaDataReceived(makeSpan<const std::uint8_t>(receiveDmaBuffer.data(), receiveDmaBuffer.size()), receiveDma->CNDTR);
 }
 
-void StmUart::handleReceiveParityError()
+void StmUart::_clearTransmissionComplete()
 {
-     _receiveByte();
-    onReceiveError(static_cast<std::uint8_t>(UartError::ReceiveParityError));
+    USART_ClearFlag(uart, USART_FLAG_TC);
 }
 
 }
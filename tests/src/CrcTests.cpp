@@ -0,0 +1,115 @@
+#include <tests/framework.hpp>
+#include <peripheral/ClmulCrc.hpp>
+#include <peripheral/SoftwareCrc.hpp>
+#include <peripheral/TableCrc.hpp>
+#include <array>
+#include <cstring>
+#include <vector>
+
+using namespace DynaSoft;
+
+namespace
+{
+
+std::vector<std::uint8_t> makeBytes(std::size_t size)
+{
+    std::vector<std::uint8_t> bytes(size);
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        bytes[i] = static_cast<std::uint8_t>(i * 37 + 11);
+    }
+    return bytes;
+}
+
+template<typename Crc>
+void expectSameCrcAsSoftwareCrc(const std::string& fileLine)
+{
+    for(std::size_t size = 0; size < 200; size += 3)
+    {
+        auto bytes = makeBytes(size);
+
+        SoftwareCrc reference{};
+        reference.add(0xA5u);
+        reference.addWords(makeSpan(bytes.data(), bytes.size()));
+        reference.add(static_cast<std::uint32_t>(size));
+
+        Crc crc{};
+        crc.add(0xA5u);
+        crc.addWords(makeSpan(bytes.data(), bytes.size()));
+        crc.add(static_cast<std::uint32_t>(size));
+        EXPECT_EQUAL_EXT(reference.get(), crc.get(), fileLine);
+
+        crc.reset();
+        EXPECT_EQUAL_EXT(SoftwareCrc::initialValue, crc.get(), fileLine);
+    }
+}
+
+}
+
+ADD_TEST(CrcTests, softwareCrc_givesSameResultAsHardwareUnit)
+{
+    // Value from STM32 CRC unit documentation
+    SoftwareCrc crc{};
+    crc.add(0x12345678u);
+    EXPECT_EQUAL(0xDF8A8A2Bu, crc.get());
+
+    crc.reset();
+    EXPECT_EQUAL(SoftwareCrc::initialValue, crc.get());
+}
+
+ADD_TEST(CrcTests, wordsFeed_addsLittleEndianWordsFollowedByTailBytes)
+{
+    for(std::size_t size = 0; size < 14; ++size)
+    {
+        auto bytes = makeBytes(size);
+
+        SoftwareCrc reference{};
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4)
+        {
+            reference.add(bytes[i] | (bytes[i + 1] << 8) | (bytes[i + 2] << 16) | (static_cast<std::uint32_t>(bytes[i + 3]) << 24));
+        }
+        for(; i < size; ++i)
+        {
+            reference.add(static_cast<std::uint32_t>(bytes[i]));
+        }
+
+        SoftwareCrc crc{};
+        crc.add(makeSpan(bytes.data(), bytes.size()), CrcFeed::Words);
+        EXPECT_EQUAL(reference.get(), crc.get());
+
+        // Up to 3 bytes both methods are equal
+        SoftwareCrc bytesCrc{};
+        bytesCrc.add(makeSpan(bytes.data(), bytes.size()), CrcFeed::Bytes);
+        EXPECT_EQUAL(size < 4, bytesCrc.get() == crc.get());
+    }
+}
+
+ADD_TEST(CrcTests, wordsFeed_doesntRequireAlignedBuffer)
+{
+    auto bytes = makeBytes(23);
+    std::array<std::uint32_t, 8> aligned{};
+    std::memcpy(aligned.data(), bytes.data(), bytes.size());
+
+    std::vector<std::uint8_t> unalignedStorage(bytes.size() + 1);
+    std::memcpy(unalignedStorage.data() + 1, bytes.data(), bytes.size());
+
+    SoftwareCrc alignedCrc{};
+    alignedCrc.addWords(makeSpan(reinterpret_cast<const std::uint8_t*>(aligned.data()), bytes.size()));
+    SoftwareCrc unalignedCrc{};
+    unalignedCrc.addWords(makeSpan<const std::uint8_t>(unalignedStorage.data() + 1, bytes.size()));
+
+    EXPECT_EQUAL(alignedCrc.get(), unalignedCrc.get());
+}
+
+ADD_TEST(CrcTests, tableCrc_givesSameResultAsSoftwareCrc)
+{
+    expectSameCrcAsSoftwareCrc<TableCrc<1>>(FILE_LINE());
+    expectSameCrcAsSoftwareCrc<TableCrc<4>>(FILE_LINE());
+    expectSameCrcAsSoftwareCrc<TableCrc<8>>(FILE_LINE());
+}
+
+ADD_TEST(CrcTests, clmulCrc_givesSameResultAsSoftwareCrc)
+{
+    expectSameCrcAsSoftwareCrc<ClmulCrc>(FILE_LINE());
+}
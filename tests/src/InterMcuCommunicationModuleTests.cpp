@@ -11,13 +11,19 @@ struct TestUartSettings
 {
 };
 
-constexpr std::uint8_t sendBufferSize = 32;
+constexpr std::uint8_t sendBufferSize = 48;
 
 template<typename Msg>
 std::vector<std::uint8_t> payload(Msg msg)
 {
     std::uint8_t* p = reinterpret_cast<std::uint8_t*>(&msg);
-    return std::vector<std::uint8_t>(p, p + sizeof(Msg));
+    std::vector<std::uint8_t> bytes(p, p + sizeof(Msg));
+    if constexpr(mp::is_instantiation_of<ImcProtocol::MessageBase, Msg>::value)
+    {
+        // Padding after contents is not preserved by copies, but it is sent as zeros
+        std::fill(bytes.begin() + ImcProtocol::headerSize + Msg::dataSize, bytes.end() - ImcProtocol::crcSize, 0);
+    }
+    return bytes;
 }
 
 template<typename Msg, typename Buffer>
@@ -54,16 +60,37 @@ struct TestInterruptTimer : public InterruptTimerBase<TestInterruptTimer, 4>
     std::array<Event, 4> events{};
 };
 
+struct TestUsTimer : public UsTimerBase<TestUsTimer>
+{
+    void _turnOn() {}
+    void _turnOff() {}
+    std::uint32_t _readUs(std::uint8_t) { return us; }
+    void _reset(std::uint8_t) { us = 0; }
+    std::uint32_t _maxReading() { return 0xFFFFFFFF; }
+
+    std::uint32_t us = 0;
+};
+
 struct TestUart : public UartBase<TestUart, TestInterruptTimer, StaticVector<std::uint8_t, sendBufferSize>>
 {
-    TestUart(TestInterruptTimer& t) : UartBase(t, 100, 100) {}
+    TestUart(TestInterruptTimer& t,
+             UartFraming framing = UartFraming::IdleLine,
+             UartTransmitInterrupt transmitInterrupt = UartTransmitInterrupt::TransmissionComplete) :
+        UartBase(t, 100, 100, framing, transmitInterrupt)
+    {
+    }
 
     void _suspendSend()
     {
     }
 
+    // Models transmit interrupts which became pending while send was suspended
     void _resumeSend()
     {
+        if(isSendingOnResume)
+        {
+            sendAllQueuedBytes();
+        }
     }
 
     void _suspendReceive()
@@ -74,32 +101,148 @@ struct TestUart : public UartBase<TestUart, TestInterruptTimer, StaticVector<std
     {
     }
 
+    void _enableDataRegisterEmptyInterrupt()
+    {
+        isDataRegisterEmptyInterruptEnabled = true;
+    }
+
+    void _disableDataRegisterEmptyInterrupt()
+    {
+        isDataRegisterEmptyInterruptEnabled = false;
+    }
+
+    void _setBaudRate(std::uint32_t baudRate_)
+    {
+        baudRate = baudRate_;
+    }
+
+    std::uint32_t _getBaudRate() const
+    {
+        return baudRate;
+    }
+
+    // Models DMA transmit channel - block memory is read when transfer completes
+    void _sendBlock(const std::uint8_t* data, std::uint16_t size)
+    {
+        dmaTransmitData = data;
+        dmaTransmitSize = size;
+    }
+
+    void completeDmaTransmit()
+    {
+        sentBytes.insert(sentBytes.end(), dmaTransmitData, dmaTransmitData + dmaTransmitSize);
+        dmaTransmitSize = 0;
+        handleBlockSent();
+    }
+
+    // Models circular DMA receive channel, which fires half transfer and transfer complete interrupts
+    void callDataReceivedByDma(std::vector<std::uint8_t> xs)
+    {
+        for(auto x: xs)
+        {
+            isIdleFlagArmed = true;
+            dmaReceiveBuffer[dmaReceiveBuffer.size() - dmaReceiveRemaining] = x;
+            dmaReceiveRemaining--;
+            if(dmaReceiveRemaining == 0)
+            {
+                dmaReceiveRemaining = dmaReceiveBuffer.size();
+                callDmaDataReceived();
+            }
+            else if(dmaReceiveRemaining == dmaReceiveBuffer.size() / 2)
+            {
+                callDmaDataReceived();
+            }
+        }
+    }
+
+    void callDmaDataReceived()
+    {
+        handleDmaDataReceived(makeSpan<const std::uint8_t>(dmaReceiveBuffer.data(), dmaReceiveBuffer.size()), dmaReceiveRemaining);
+    }
+
+    void _processDmaReceivedData()
+    {
+        callDmaDataReceived();
+    }
+
+    // Models USART interrupt - status register is read once and dispatched by UartBase
+    void callInterrupt()
+    {
+        std::uint8_t flags = status;
+        isStatusRead = true;
+        if(!isDataRegisterEmptyInterruptEnabled)
+        {
+            flags &= ~UartStatus::DataRegisterEmpty;
+        }
+        handleInterrupt(flags, isReceiveDma);
+    }
+
+    // Writing data register clears TXE, and TC if status was read before
     void _sendByte(std::uint8_t data)
     {
         sentBytes.push_back(data);
+        status &= ~UartStatus::DataRegisterEmpty;
+        if(isStatusRead)
+        {
+            status &= ~UartStatus::TransmissionComplete;
+            isStatusRead = false;
+        }
     }
 
+    // Reading data register clears RXNE, and idle and error flags if status was read before
     std::uint8_t _receiveByte()
     {
+        dataRegisterReads++;
+        status &= ~UartStatus::DataReceived;
+        if(isStatusRead)
+        {
+            status &= ~(UartStatus::IdleLine | UartStatus::Overrun | UartStatus::NoiseError | UartStatus::FrameError | UartStatus::ParityError);
+            isStatusRead = false;
+        }
         return nextByte;
     }
 
+    void _clearTransmissionComplete()
+    {
+        status &= ~UartStatus::TransmissionComplete;
+    }
+
     void callTransmissionComplete()
     {
-        handleTransmissionComplete();
+        status |= UartStatus::TransmissionComplete;
+        callInterrupt();
+    }
+
+    void callDataRegisterEmpty()
+    {
+        status |= UartStatus::DataRegisterEmpty;
+        callInterrupt();
     }
 
     void sendAllQueuedBytes()
     {
         while(isTransmitOngoing())
         {
-            callTransmissionComplete();
+            if(dmaTransmitSize > 0)
+            {
+                completeDmaTransmit();
+            }
+            else if(isDataRegisterEmptyInterruptEnabled)
+            {
+                callDataRegisterEmpty();
+            }
+            else
+            {
+                callTransmissionComplete();
+            }
         }
     }
 
     void callDataReceived()
     {
-        handleDataReceived();
+        isIdleFlagArmed = true;
+        status |= UartStatus::DataReceived;
+        callInterrupt();
     }
 
     void callDataReceived(std::vector<std::uint8_t> xs)
@@ -121,13 +264,43 @@ struct TestUart : public UartBase<TestUart, TestInterruptTimer, StaticVector<std
         onIdleLineDetected();
     }
 
+    // Models USART IDLE flag - it is set only when line becomes idle after some data was received
+    void callHardwareIdle()
+    {
+        if(isIdleFlagArmed)
+        {
+            isIdleFlagArmed = false;
+            status |= UartStatus::IdleLine;
+            callInterrupt();
+        }
+    }
+
     void generateIdleLine() // shadows function from UartBase
     {
         idleLines++;
+        if(isIdleLineTimed)
+        {
+            // Idle line ends when timer interrupt is invoked
+            UartBase::generateIdleLine();
+        }
     }
 
     std::uint8_t nextByte = 0;
+    std::uint8_t status = 0;
+    bool isStatusRead = false;
+    bool isReceiveDma = false;
+    int dataRegisterReads = 0;
     std::uint8_t idleLines = 0;
+    bool isIdleLineTimed = false;
+    std::uint32_t baudRate = 115200;
+    bool isIdleFlagArmed = false;
+    bool isDataRegisterEmptyInterruptEnabled = false;
+    bool isSendingOnResume = false;
+
+    const std::uint8_t* dmaTransmitData = nullptr;
+    std::uint16_t dmaTransmitSize = 0;
+    std::array<std::uint8_t, 16> dmaReceiveBuffer{};
+    std::uint16_t dmaReceiveRemaining = 16;
 
     std::vector<std::uint8_t> sentBytes{};
 };
@@ -152,22 +325,18 @@ struct TestCrc : public CrcBase<TestCrc>
     }
 
     template<typename Message>
-    std::uint32_t getCrc(Message msg)
+    std::uint32_t getCrc(Message msg, CrcFeed feed = CrcFeed::Bytes)
     {
         auto buf = payload(msg);
-        crc = 0;
-        int headerAndContentsSize = 4 + msg.size;
-        for(int i = 0; i < headerAndContentsSize; ++i)
-        {
-            add(buf[i]);
-        }
-        return crc;
+        reset();
+        add(makeSpan(buf.data(), ImcProtocol::headerSize + msg.size), feed);
+        return get();
     }
 
     std::uint32_t crc;
 };
 
-constexpr std::uint8_t maxMessageSize = 32;
+constexpr std::uint8_t maxMessageSize = 48;
 
 using TestMasterIMC = InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, true>;
 using TestSlaveIMC = InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false>;
@@ -179,8 +348,18 @@ constexpr std::uint8_t testRecipent = 2;
 
 struct TestMessageContents
 {
+    // No implicit padding, so that crc computed over copies of message is always the same
     std::uint8_t a;
+    std::uint8_t _[3];
     std::uint32_t b;
+
+    TestMessageContents() = default;
+
+    TestMessageContents(std::uint8_t a_, std::uint32_t b_) :
+        a{a_},
+        _{},
+        b{b_}
+    {}
 };
 using TestMessage = ImcProtocol::Message<TestMessageContents, ImcProtocol::makeMessageId(testRecipent, 1)>;
 
@@ -196,8 +375,8 @@ std::uint8_t expectMessage(Container& uartMsg, const std::string& fileLine, cons
     else
     {
         auto msgBytes = payload(expectedMsg);
-        int headerAndContentsSize = 4 + expectedMsg.size;
-        int crcOffset = sizeof(Message) - 4;
+        int headerAndContentsSize = ImcProtocol::headerSize + expectedMsg.size;
+        int crcOffset = sizeof(Message) - ImcProtocol::crcSize;
 
         bool areContentsEqual = std::equal(msgBytes.begin(), msgBytes.begin() + headerAndContentsSize, uartMsg.begin() + index);
         bool areCrcEqual = std::equal(msgBytes.begin() + crcOffset, msgBytes.end(), uartMsg.begin() + index + crcOffset);
@@ -219,7 +398,7 @@ std::uint8_t expectMessage(Container& uartMsg, const std::string& fileLine, cons
         EXPECT_EQUAL_EXT(true, areContentsEqual, fileLine);
         EXPECT_EQUAL_EXT(true, areCrcEqual, fileLine);
     }
-    return sizeof(Message);
+    return index + sizeof(Message);
 }
 }
 
@@ -233,8 +412,8 @@ void expectSentMessages(TestUart& uart, const std::string& fileLine, const Messa
     uart.sentBytes.clear();
 }
 
-template<typename Msg>
-void expectReceivedMessage(TestImcReceiver& receiver, const std::string& fileLine)
+template<typename Msg, typename Receiver>
+void expectReceivedMessage(Receiver& receiver, const std::string& fileLine)
 {
     auto maybeMsg = receiver.getNextMessage();
     ASSERT_EQUAL_EXT(true, maybeMsg.has_value(), fileLine);
@@ -268,6 +447,14 @@ Message makeMessage(std::uint16_t sequence, MessageContents contents)
     return msg;
 }
 
+template<typename Message>
+Message withAckSequence(Message msg, std::uint16_t ackSequence)
+{
+    msg.ackSequence = ackSequence;
+    msg.crc = TestCrc{}.getCrc(msg);
+    return msg;
+}
+
 class ImcReceiverTest : public ::test::Test
 {
 public:
@@ -407,6 +594,102 @@ ADD_TEST_F(ImcReceiverTest, whenNewMessagesNotProcessedInTime_risesErrorAndIgnor
     EXPECT_FALSE(receiver.getNextMessage().has_value());
 }
 
+ADD_TEST_F(ImcReceiverTest, withDeeperQueue_absorbsBurstOfMessages_risesErrorWhenItOverflows)
+{
+    ImcReceiver<TestUart, maxMessageSize, 4> deepReceiver{uart};
+
+    uart.callIdleLineDetected();
+    for(std::uint16_t i = 0; i < 4; ++i)
+    {
+        uart.callDataReceived(payload(makeMessage<ImcProtocol::KeepAlive>(i)));
+        uart.callIdleLineDetected();
+    }
+
+    EXPECT_FALSE(deepReceiver.hasError());
+
+    uart.callDataReceived(payload(ImcProtocol::Handshake{}));
+    uart.callIdleLineDetected();
+
+    EXPECT_TRUE(deepReceiver.hasError());
+
+    for(std::uint16_t i = 0; i < 4; ++i)
+    {
+        auto maybeMsg = deepReceiver.getNextMessage();
+        ASSERT_TRUE(maybeMsg.has_value());
+        EXPECT_EQUAL(i, ImcProtocol::decode<ImcProtocol::KeepAlive>((*maybeMsg)->data()).sequence);
+    }
+    EXPECT_FALSE(deepReceiver.getNextMessage().has_value());
+
+    // Slots freed by reading are reused for next messages
+    deepReceiver.clearError();
+    for(std::uint16_t i = 4; i < 8; ++i)
+    {
+        uart.callDataReceived(payload(makeMessage<ImcProtocol::KeepAlive>(i)));
+        uart.callIdleLineDetected();
+    }
+
+    EXPECT_FALSE(deepReceiver.hasError());
+    for(std::uint16_t i = 4; i < 8; ++i)
+    {
+        auto maybeMsg = deepReceiver.getNextMessage();
+        ASSERT_TRUE(maybeMsg.has_value());
+        EXPECT_EQUAL(i, ImcProtocol::decode<ImcProtocol::KeepAlive>((*maybeMsg)->data()).sequence);
+    }
+}
+
+ADD_TEST_F(ImcReceiverTest, whenQueueIsFull_idleLineDoesntAddMoreMessages)
+{
+    uart.callIdleLineDetected();
+    uart.callDataReceived(payload(ImcProtocol::Handshake{}));
+    uart.callIdleLineDetected();
+    uart.callDataReceived(payload(TestMessage{}));
+    uart.callIdleLineDetected();
+    uart.callIdleLineDetected();
+
+    EXPECT_FALSE(receiver.hasError());
+    EXPECT_RECEIVED_MESSAGE(receiver, ImcProtocol::Handshake);
+    uart.callIdleLineDetected();
+    EXPECT_RECEIVED_MESSAGE(receiver, TestMessage);
+    EXPECT_FALSE(receiver.getNextMessage().has_value());
+}
+
+ADD_TEST_F(ImcReceiverTest, whenEndIsDetectedFromSize_completesMessageWithoutWaitingForIdle)
+{
+    ImcReceiver<TestUart, maxMessageSize, 2, true> sizeReceiver{uart};
+
+    uart.callIdleLineDetected();
+    uart.callDataReceived(payload(TestMessage{}));
+    uart.callDataReceived(payload(ImcProtocol::Handshake{}));
+
+    EXPECT_RECEIVED_MESSAGE(sizeReceiver, TestMessage);
+    EXPECT_RECEIVED_MESSAGE(sizeReceiver, ImcProtocol::Handshake);
+
+    // Idle after complete message is ignored
+    uart.callIdleLineDetected();
+    EXPECT_FALSE(sizeReceiver.getNextMessage().has_value());
+    EXPECT_FALSE(sizeReceiver.hasError());
+}
+
+ADD_TEST_F(ImcReceiverTest, whenEndIsDetectedFromSize_andSizeIsCorrupted_resynchronizesOnIdle)
+{
+    ImcReceiver<TestUart, maxMessageSize, 2, true> sizeReceiver{uart};
+
+    TestMessage corrupted{};
+    corrupted.size = 40;
+
+    uart.callIdleLineDetected();
+    uart.callDataReceived(payload(corrupted));
+    EXPECT_FALSE(sizeReceiver.getNextMessage().has_value());
+
+    uart.callIdleLineDetected();
+    uart.callDataReceived(payload(ImcProtocol::Handshake{}));
+
+    auto maybeMsg = sizeReceiver.getNextMessage();
+    ASSERT_TRUE(maybeMsg.has_value());
+    EXPECT_EQUAL(sizeof(TestMessage), (*maybeMsg)->size());
+    EXPECT_RECEIVED_MESSAGE(sizeReceiver, ImcProtocol::Handshake);
+}
+
 ADD_TEST_F(ImcReceiverTest, whenBufferOverrun_risesErrorAndDropsMessages)
 {
     // We received message longer than expected max, it is treated as error
@@ -528,699 +811,2940 @@ ADD_TEST_F(ImcSenderTest, doesntQueueThirdMessage)
     EXPECT_SENT_MESSAGES(uart, msg, msg);
 }
 
-class ImcSlaveTest : public ::test::Test
+ADD_TEST_F(ImcSenderTest, withDeeperQueue_sendsAllQueuedMessagesInOrder)
 {
-public:
-    ImcSlaveTest() :
-        timer{},
-        settings{},
-        uart{timer},
-        imc{uart, crc, settings}
-    {
-        settings.slaveHandshakeIntervalUs = 1000;
-        settings.slaveKeepAliveIntervalUs = 1000;
-        settings.slaveAckTimeoutUs = 3000;
-
-        uart.callIdleLineDetected();
-    }
+    ImcSender<TestUart, maxMessageSize, 4> deepSender{uart};
+    EXPECT_EQUAL(4u, deepSender.queueCapacity());
 
-    void sendAck(std::uint16_t sequence, std::uint8_t ackedId, std::uint16_t ackedSequence)
-    {
-        ImcProtocol::Acknowledge ack{};
-        ack.sequence = sequence;
-        ack.data.ackId = ackedId;
-        ack.data.ackSequence = ackedSequence;
-        ack.crc = TestCrc{}.getCrc(ack);
-        uart.callDataReceived(payload(ack));
-        uart.callIdleLineDetected();
-    }
+    TestMessage msg = makeMessage<TestMessage>(1, TestMessageContents{1, 2});
+    ImcProtocol::Handshake msg2 = makeMessage<ImcProtocol::Handshake>(2);
+    ImcProtocol::KeepAlive msg3 = makeMessage<ImcProtocol::KeepAlive>(3);
+    ImcProtocol::Handshake msg4 = makeMessage<ImcProtocol::Handshake>(4);
 
-    void establishCommunication()
-    {
-        imc.update(1);
-        uart.sendAllQueuedBytes();
-        EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
-        sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 22);
-        imc.update(1);
-        uart.sendAllQueuedBytes();
-        EXPECT_EQUAL(0u, uart.sentBytes.size());
-    }
+    EXPECT_TRUE(deepSender.sendMessage(msg));
+    EXPECT_TRUE(deepSender.sendMessage(msg2));
+    EXPECT_TRUE(deepSender.sendMessage(msg3));
+    EXPECT_TRUE(deepSender.sendMessage(msg4));
+    EXPECT_EQUAL(0u, deepSender.queueCapacity());
+    EXPECT_FALSE(deepSender.sendMessage(msg));
 
-    std::uint16_t getNextSentSequence()
-    {
-        return nextSentSequence++;
-    }
+    uart.sendAllQueuedBytes();
 
-    std::uint16_t getNextReceivedSequence()
-    {
-        return nextReceivedSequence++;
-    }
+    EXPECT_EQUAL(4, uart.idleLines);
+    EXPECT_SENT_MESSAGES(uart, msg, msg2, msg3, msg4);
+    EXPECT_EQUAL(4u, deepSender.queueCapacity());
+}
 
-    void checkImcProcessesData()
-    {
-        bool dispatchedFlag = false;
-        imc.registerMessageRecipient(
-            testRecipent, {
-            [](void* ctx, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
-            {
-                *reinterpret_cast<bool*>(ctx) = true;
-                return true;
-            },
-            &dispatchedFlag
-        });
+ADD_TEST_F(ImcSenderTest, withDeeperQueue_reusesSlotsFreedDuringTransmission)
+{
+    ImcSender<TestUart, maxMessageSize, 3> deepSender{uart};
 
-        TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
-        uart.callDataReceived(payload(msg));
-        uart.callIdleLineDetected();
+    ImcProtocol::Handshake msg = makeMessage<ImcProtocol::Handshake>(1);
+    ImcProtocol::KeepAlive msg2 = makeMessage<ImcProtocol::KeepAlive>(2);
+    ImcProtocol::Handshake msg3 = makeMessage<ImcProtocol::Handshake>(3);
 
-        imc.update(1);
-        uart.sendAllQueuedBytes();
+    deepSender.sendMessage(msg);
+    deepSender.sendMessage(msg2);
+    deepSender.sendMessage(msg3);
 
-        EXPECT_EQUAL(0u, uart.sentBytes.size());
-        EXPECT_TRUE(dispatchedFlag);
+    // Finish first message only
+    while(uart.idleLines == 0)
+    {
+        uart.callTransmissionComplete();
     }
+    EXPECT_EQUAL(1u, deepSender.queueCapacity());
 
-    TestCrc crc;
-    TestInterruptTimer timer;
-    ImcSettings settings;
-    TestUart uart;
-    TestSlaveIMC imc;
+    ImcProtocol::KeepAlive msg4 = makeMessage<ImcProtocol::KeepAlive>(4);
+    EXPECT_TRUE(deepSender.sendMessage(msg4));
 
-    std::uint16_t nextSentSequence = 0;
-    std::uint16_t nextReceivedSequence = 0;
-};
+    uart.sendAllQueuedBytes();
 
-class ImcMasterTest : public ::test::Test
+    EXPECT_EQUAL(4, uart.idleLines);
+    EXPECT_SENT_MESSAGES(uart, msg, msg2, msg3, msg4);
+}
+
+ADD_TEST_F(ImcSenderTest, startsOldestMessageWithHighestPriority_andMeasuresQueueingDelays)
 {
-public:
-    ImcMasterTest() :
-        timer{},
-        settings{},
-        uart{timer},
-        imc{uart, crc, settings}
-    {
-        settings.slaveHandshakeIntervalUs = 1000;
-        settings.slaveKeepAliveIntervalUs = 1000;
-        settings.slaveAckTimeoutUs = 3000;
+    using Priority = ImcProtocol::Priority;
+    ImcSender<TestUart, maxMessageSize, 4> deepSender{uart};
 
-        settings.masterCommunicationTimeoutUs = 3000;
+    TestMessage lowMsg1 = makeMessage<TestMessage>(1);
+    TestMessage lowMsg2 = makeMessage<TestMessage>(2);
+    TestMessage normalMsg = makeMessage<TestMessage>(3);
+    TestMessage highMsg = makeMessage<TestMessage>(4);
 
-        uart.callIdleLineDetected();
-    }
+    // First message is started right away
+    EXPECT_TRUE(deepSender.sendMessage(lowMsg1, Priority::Low));
+    EXPECT_TRUE(deepSender.sendMessage(lowMsg2, Priority::Low));
+    EXPECT_TRUE(deepSender.sendMessage(normalMsg, Priority::Normal));
+    EXPECT_TRUE(deepSender.sendMessage(highMsg, Priority::High));
 
-    void establishCommunication()
-    {
-        std::uint16_t s = getNextReceivedSequence();
-        ImcProtocol::Handshake handshake = makeMessage<ImcProtocol::Handshake>(s);
-        uart.callDataReceived(payload(handshake));
-        uart.callIdleLineDetected();
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, lowMsg1, highMsg, normalMsg, lowMsg2);
 
-        imc.update(1);
-        uart.sendAllQueuedBytes();
-        EXPECT_TRUE(imc.hasCommunicationEstablished());
-        EXPECT_SENT_MESSAGES(uart,
-            makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::Handshake::myId, s})
-        );
-    }
+    constexpr std::uint32_t frameSize = sizeof(TestMessage);
+    EXPECT_EQUAL(frameSize, deepSender.getMaxQueueingDelay(Priority::High));
+    EXPECT_EQUAL(2 * frameSize, deepSender.getMaxQueueingDelay(Priority::Normal));
+    EXPECT_EQUAL(3 * frameSize, deepSender.getMaxQueueingDelay(Priority::Low));
 
-    std::uint16_t getNextSentSequence()
-    {
-        return nextSentSequence++;
-    }
+    deepSender.resetQueueingDelays();
+    EXPECT_EQUAL(0u, deepSender.getMaxQueueingDelay(Priority::Low));
+}
 
-    std::uint16_t getNextReceivedSequence()
+ADD_TEST_F(ImcSenderTest, withSeparatePayload_sendsItInPlace_andNotifiesWhenSent)
+{
+    TestMessage msg = makeMessage<TestMessage>(1, TestMessageContents{1, 2});
+    const std::uint8_t* data = reinterpret_cast<const std::uint8_t*>(&msg);
+    std::uint8_t* payload = reinterpret_cast<std::uint8_t*>(&msg.data);
+
+    int sentCount = 0;
+    bool success = sender.sendMessage(
+        makeSpan(data, ImcProtocol::headerSize),
+        makeSpan<const std::uint8_t>(payload, sizeof(TestMessageContents)),
+        makeSpan(data + ImcProtocol::headerSize + sizeof(TestMessageContents), ImcProtocol::crcSize),
+        {[](void* ctx) { (*static_cast<int*>(ctx))++; }, &sentCount}
+    );
+    EXPECT_TRUE(success);
+
+    // Payload is read from original memory during transmission
+    payload[0] = 5;
+    while(uart.idleLines == 0)
     {
-        return nextReceivedSequence++;
+        EXPECT_EQUAL(0, sentCount);
+        uart.callTransmissionComplete();
     }
 
-    TestCrc crc;
+    EXPECT_EQUAL(1, sentCount);
+    EXPECT_SENT_MESSAGES(uart, msg);
+}
+
+ADD_TEST_F(ImcSenderTest, whenIdleLineIsGenerated_startsSendingAfterIt)
+{
+    uart.UartBase::generateIdleLine();
+
+    TestMessage msg{};
+    EXPECT_TRUE(uart.send(reinterpret_cast<std::uint8_t*>(&msg), sizeof(msg)));
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    timer.invoke(0);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, msg);
+}
+
+ADD_TEST_F(ImcSenderTest, whenIdleTimerFiresAfterMessageIsStarted_doesntStartItAgain)
+{
+    uart.UartBase::generateIdleLine();
+
+    TestMessage msg{};
+    EXPECT_TRUE(uart.send(reinterpret_cast<std::uint8_t*>(&msg), sizeof(msg)));
+    timer.invoke(0);
+    EXPECT_EQUAL(1u, uart.sentBytes.size());
+
+    timer.invoke(0);
+    EXPECT_EQUAL(1u, uart.sentBytes.size());
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, msg);
+}
+
+ADD_TEST_F(ImcSenderTest, reportsFrameStart_whenItsFirstByteIsSent_afterIdleLine)
+{
+    uart.isIdleLineTimed = true;
+    std::vector<TransmitEvent> events{};
+    sender.setFrameEventCallback({[](CallbackContext ctx, TransmitEvent event, const std::uint8_t*)
+    {
+        static_cast<std::vector<TransmitEvent>*>(ctx)->push_back(event);
+    }, &events});
+
+    TestMessage msg{};
+    EXPECT_TRUE(sender.sendMessage(msg));
+    EXPECT_TRUE(sender.sendMessage(msg));
+    while(uart.idleLines == 0)
+    {
+        uart.callTransmissionComplete();
+    }
+
+    // Second frame is already handed to UART, but waits for idle line to end
+    ASSERT_EQUAL(4u, events.size());
+    EXPECT_TRUE(events[0] == TransmitEvent::Queued);
+    EXPECT_TRUE(events[1] == TransmitEvent::Started);
+    EXPECT_TRUE(events[2] == TransmitEvent::Queued);
+    EXPECT_TRUE(events[3] == TransmitEvent::Sent);
+    EXPECT_TRUE(uart.isTransmitOngoing());
+
+    timer.invoke(0);
+    ASSERT_EQUAL(5u, events.size());
+    EXPECT_TRUE(events[4] == TransmitEvent::Started);
+    EXPECT_EQUAL(sizeof(TestMessage) + 1, uart.sentBytes.size());
+}
+
+class UartHardwareIdleTest : public ::test::Test
+{
+public:
+    UartHardwareIdleTest() :
+        uart{timer, UartFraming::HardwareIdleLine},
+        receiver{uart}
+    {
+    }
+
+    TestInterruptTimer timer;
+    TestUart uart;
+    TestImcReceiver receiver;
+};
+
+ADD_TEST_F(UartHardwareIdleTest, endsMessagesOnHardwareIdle_withoutUsingTimer)
+{
+    uart.callDataReceived({1, 2});
+    uart.callHardwareIdle();
+    uart.callDataReceived(payload(TestMessage{}));
+
+    EXPECT_FALSE(receiver.getNextMessage().has_value());
+
+    uart.callHardwareIdle();
+    // Flag is not set again until next data is received
+    uart.callHardwareIdle();
+    uart.callDataReceived(payload(ImcProtocol::Handshake{}));
+    uart.callHardwareIdle();
+
+    EXPECT_FALSE(receiver.hasError());
+    EXPECT_RECEIVED_MESSAGE(receiver, TestMessage);
+    EXPECT_RECEIVED_MESSAGE(receiver, ImcProtocol::Handshake);
+    EXPECT_FALSE(timer.events[1].cb.isSet());
+}
+
+ADD_TEST_F(UartHardwareIdleTest, sentMessagesAreStillFollowedByIdleLine)
+{
+    TestImcSender sender{uart};
+    TestMessage msg{};
+    EXPECT_TRUE(sender.sendMessage(msg));
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(1u, uart.idleLines);
+    EXPECT_SENT_MESSAGES(uart, msg);
+}
+
+ADD_TEST_F(UartHardwareIdleTest, clearsFlagsByReadingStatusFollowedByData_andDropsBytesReceivedWithError)
+{
+    std::vector<std::uint8_t> errors{};
+    uart.setReceiveErrorCallback({[](CallbackContext ctx, std::uint8_t error)
+    {
+        static_cast<std::vector<std::uint8_t>*>(ctx)->push_back(error);
+    }, &errors});
+
+    uart.callDataReceived({1, 2});
+    uart.nextByte = 3;
+    uart.status |= UartStatus::DataReceived | UartStatus::ParityError;
+    uart.callInterrupt();
+    uart.status |= UartStatus::Overrun;
+    uart.callInterrupt();
+    EXPECT_EQUAL(0, uart.status);
+    EXPECT_TRUE((std::vector<std::uint8_t>{
+        static_cast<std::uint8_t>(UartError::ReceiveParityError),
+        static_cast<std::uint8_t>(UartError::ReceiveBufferOverrun)
+    }) == errors);
+
+    uart.callHardwareIdle();
+    EXPECT_EQUAL(0, uart.status);
+    EXPECT_EQUAL(5, uart.dataRegisterReads);
+}
+
+class UartDataRegisterEmptyTest : public ::test::Test
+{
+public:
+    UartDataRegisterEmptyTest() :
+        uart{timer, UartFraming::IdleLine, UartTransmitInterrupt::DataRegisterEmpty}
+    {
+        uart.setDataSentCallback({[](CallbackContext ctx)
+        {
+            (*static_cast<int*>(ctx))++;
+        }, &sentCount});
+    }
+
+    TestInterruptTimer timer;
+    TestUart uart;
+    int sentCount = 0;
+};
+
+ADD_TEST_F(UartDataRegisterEmptyTest, sendsNextBytesFromDataRegisterEmpty_andEndsMessageOnTransmissionComplete)
+{
+    std::vector<std::uint8_t> data{1, 2, 3};
+    EXPECT_TRUE(uart.send(data.data(), data.size()));
+    EXPECT_TRUE(uart.isDataRegisterEmptyInterruptEnabled);
+
+    // Transmission complete in the middle of message (delayed interrupt) doesn't send anything
+    uart.callTransmissionComplete();
+    EXPECT_EQUAL(1u, uart.sentBytes.size());
+
+    uart.callDataRegisterEmpty();
+    uart.callDataRegisterEmpty();
+    EXPECT_TRUE(data == uart.sentBytes);
+    EXPECT_TRUE(uart.isTransmitOngoing());
+
+    // No more data - interrupt is disabled and message ends after last byte is shifted out
+    uart.callDataRegisterEmpty();
+    EXPECT_FALSE(uart.isDataRegisterEmptyInterruptEnabled);
+    EXPECT_EQUAL(0, sentCount);
+
+    uart.callTransmissionComplete();
+    EXPECT_FALSE(uart.isTransmitOngoing());
+    EXPECT_EQUAL(1, sentCount);
+}
+
+ADD_TEST_F(UartDataRegisterEmptyTest, sendsQueuedMessagesWithIdleLinesBetween)
+{
+    TestImcSender sender{uart};
+    TestMessage msg = makeMessage<TestMessage>(1, TestMessageContents{1, 2});
+    ImcProtocol::Handshake msg2 = makeMessage<ImcProtocol::Handshake>(2);
+
+    EXPECT_TRUE(sender.sendMessage(msg));
+    EXPECT_TRUE(sender.sendMessage(msg2));
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(2u, uart.idleLines);
+    EXPECT_SENT_MESSAGES(uart, msg, msg2);
+}
+
+class UartDmaTest : public ::test::Test
+{
+public:
+    UartDmaTest() :
+        uart{timer, UartFraming::HardwareIdleLine, UartTransmitInterrupt::Dma},
+        receiver{uart},
+        sender{uart}
+    {
+        uart.isReceiveDma = true;
+    }
+
+    TestInterruptTimer timer;
+    TestUart uart;
+    TestImcReceiver receiver;
+    TestImcSender sender;
+};
+
+ADD_TEST_F(UartDmaTest, sendsEachSegmentAsSingleBlock_andEndsMessageOnTransmissionComplete)
+{
+    TestMessage msg = makeMessage<TestMessage>(1, TestMessageContents{1, 2});
+    const std::uint8_t* data = reinterpret_cast<const std::uint8_t*>(&msg);
+    constexpr std::uint8_t headerAndContentsSize = ImcProtocol::headerSize + sizeof(TestMessageContents);
+
+    EXPECT_TRUE(sender.sendMessage(
+        makeSpan(data, ImcProtocol::headerSize),
+        makeSpan(data + ImcProtocol::headerSize, sizeof(TestMessageContents)),
+        makeSpan(data + headerAndContentsSize, ImcProtocol::crcSize),
+        {}
+    ));
+
+    EXPECT_EQUAL(ImcProtocol::headerSize, uart.dmaTransmitSize);
+    // Transmission complete during block transfer is ignored
+    uart.callTransmissionComplete();
+    EXPECT_TRUE(uart.isTransmitOngoing());
+
+    uart.completeDmaTransmit();
+    EXPECT_EQUAL(sizeof(TestMessageContents), uart.dmaTransmitSize);
+    EXPECT_TRUE(data + ImcProtocol::headerSize == uart.dmaTransmitData);
+
+    uart.completeDmaTransmit();
+    uart.completeDmaTransmit();
+    EXPECT_TRUE(uart.isTransmitOngoing());
+    EXPECT_EQUAL(0u, uart.idleLines);
+
+    uart.callTransmissionComplete();
+    EXPECT_FALSE(uart.isTransmitOngoing());
+    EXPECT_EQUAL(1u, uart.idleLines);
+    EXPECT_SENT_MESSAGES(uart, msg);
+}
+
+ADD_TEST_F(UartDmaTest, withCobsFraming_sendsBytesOneByOne)
+{
+    TestUart cobsUart{timer, UartFraming::Cobs, UartTransmitInterrupt::Dma};
+
+    std::vector<std::uint8_t> data{1, 0, 2};
+    EXPECT_TRUE(cobsUart.send(data.data(), data.size()));
+    EXPECT_EQUAL(0u, cobsUart.dmaTransmitSize);
+    cobsUart.sendAllQueuedBytes();
+
+    std::vector<std::uint8_t> expected{2, 1, 2, 2, 0};
+    EXPECT_TRUE(expected == cobsUart.sentBytes);
+}
+
+ADD_TEST_F(UartDmaTest, receivesMessagesWrittenByCircularDma)
+{
+    // IDLE interrupt processes data received so far before ending message
+    uart.callDataReceivedByDma({1, 2, 3});
+    uart.callHardwareIdle();
+
+    // Messages are longer than DMA buffer, so they are partially processed on half and full transfer
+    uart.callDataReceivedByDma(payload(makeMessage<TestMessage>(1, TestMessageContents{1, 2})));
+    uart.callHardwareIdle();
+    uart.callDataReceivedByDma(payload(makeMessage<ImcProtocol::Handshake>(2)));
+    uart.callHardwareIdle();
+
+    EXPECT_FALSE(receiver.hasError());
+    EXPECT_RECEIVED_MESSAGE(receiver, TestMessage);
+    EXPECT_RECEIVED_MESSAGE(receiver, ImcProtocol::Handshake);
+}
+
+ADD_TEST_F(UartDmaTest, receiveErrors_dontTakeByteWaitingForDma_fromDataRegister)
+{
+    std::vector<std::uint8_t> errors{};
+    uart.setReceiveErrorCallback({[](CallbackContext ctx, std::uint8_t error)
+    {
+        static_cast<std::vector<std::uint8_t>*>(ctx)->push_back(error);
+    }, &errors});
+
+    // DMA reading the byte completes clearing of the flag
+    uart.status = UartStatus::DataReceived | UartStatus::ParityError;
+    uart.callInterrupt();
+    EXPECT_EQUAL(1u, errors.size());
+    EXPECT_EQUAL(0, uart.dataRegisterReads);
+
+    // Byte was already taken by DMA
+    uart.status = UartStatus::ParityError;
+    uart.callInterrupt();
+    EXPECT_EQUAL(2u, errors.size());
+    EXPECT_EQUAL(1, uart.dataRegisterReads);
+    EXPECT_EQUAL(0, uart.status);
+
+    uart.status = UartStatus::DataReceived | UartStatus::IdleLine;
+    uart.callInterrupt();
+    EXPECT_EQUAL(1, uart.dataRegisterReads);
+    EXPECT_EQUAL(static_cast<std::uint8_t>(UartError::ReceiveParityError), errors[1]);
+}
+
+class UartCobsTest : public ::test::Test
+{
+public:
+    UartCobsTest() :
+        uart{timer, UartFraming::Cobs},
+        receiverUart{timer, UartFraming::Cobs},
+        receiver{receiverUart}
+    {
+    }
+
+    void transfer()
+    {
+        uart.sendAllQueuedBytes();
+        receiverUart.callDataReceived(uart.sentBytes);
+        uart.sentBytes.clear();
+    }
+
+    TestInterruptTimer timer;
+    TestUart uart;
+    TestUart receiverUart;
+    TestImcReceiver receiver;
+};
+
+ADD_TEST_F(UartCobsTest, encodesMessageWithoutZeros_andTerminatesItWithZero)
+{
+    std::vector<std::uint8_t> data{0, 1, 2, 0, 0, 3, 0};
+    EXPECT_TRUE(uart.send(data.data(), data.size()));
+    uart.sendAllQueuedBytes();
+
+    std::vector<std::uint8_t> expected{1, 3, 1, 2, 1, 2, 3, 1, 0};
+    EXPECT_TRUE(expected == uart.sentBytes);
+    EXPECT_EQUAL(0u, uart.idleLines);
+}
+
+ADD_TEST_F(UartCobsTest, sentDataIsDecodedOnReceive)
+{
+    struct Decoded
+    {
+        TestUart& uart;
+        std::vector<std::vector<std::uint8_t>> messages{{}};
+    } decoded{receiverUart};
+
+    receiverUart.setDataReceivedCallback({[](CallbackContext ctx)
+    {
+        auto& d = *static_cast<Decoded*>(ctx);
+        d.messages.back().push_back(d.uart.read());
+    }, &decoded});
+    receiverUart.setIdleLineDetectedCallback({[](CallbackContext ctx)
+    {
+        static_cast<Decoded*>(ctx)->messages.emplace_back();
+    }, &decoded});
+
+    // Long block of non-zero bytes is split, as it doesn't fit in single code byte
+    std::vector<std::uint8_t> longData(300, 7);
+    longData[254] = 0;
+    longData[290] = 0;
+    std::vector<std::uint8_t> shortData{0, 5, 0};
+
+    EXPECT_TRUE(uart.sendSegments({
+        makeSpan<const std::uint8_t>(longData.data(), 200),
+        makeSpan<const std::uint8_t>(longData.data() + 200, 100)
+    }));
+    transfer();
+    EXPECT_TRUE(uart.send(shortData.data(), shortData.size()));
+    transfer();
+
+    ASSERT_EQUAL(3u, decoded.messages.size());
+    EXPECT_TRUE(longData == decoded.messages[0]);
+    EXPECT_TRUE(shortData == decoded.messages[1]);
+    EXPECT_EQUAL(0u, decoded.messages[2].size());
+}
+
+ADD_TEST_F(UartCobsTest, sentMessagesAreSentBackToBack_andReceivedWithoutIdleLine)
+{
+    TestImcSender sender{uart};
+    TestMessage msg = makeMessage<TestMessage>(1, TestMessageContents{1, 0});
+    ImcProtocol::Handshake msg2 = makeMessage<ImcProtocol::Handshake>(2);
+
+    receiverUart.callDataReceived({0});
+    EXPECT_TRUE(sender.sendMessage(msg));
+    EXPECT_TRUE(sender.sendMessage(msg2));
+    transfer();
+
+    EXPECT_EQUAL(0u, uart.idleLines);
+    EXPECT_RECEIVED_MESSAGE(receiver, TestMessage);
+    EXPECT_RECEIVED_MESSAGE(receiver, ImcProtocol::Handshake);
+}
+
+ADD_TEST_F(UartCobsTest, afterCorruptedByte_resynchronizesOnNextTerminator)
+{
+    TestImcSender sender{uart};
+    ImcProtocol::Handshake msg = makeMessage<ImcProtocol::Handshake>(1);
+
+    receiverUart.callDataReceived({0});
+    EXPECT_TRUE(sender.sendMessage(msg));
+    uart.sendAllQueuedBytes();
+    // Corrupted code byte makes decoder skip data
+    uart.sentBytes[0] = 0x30;
+    transfer();
+
+    EXPECT_TRUE(sender.sendMessage(msg));
+    transfer();
+
+    auto maybeMsg = receiver.getNextMessage();
+    ASSERT_TRUE(maybeMsg.has_value());
+    auto sent = payload(msg);
+    EXPECT_FALSE(std::equal(sent.begin(), sent.end(), (*maybeMsg)->begin(), (*maybeMsg)->end()));
+    EXPECT_RECEIVED_MESSAGE(receiver, ImcProtocol::Handshake);
+}
+
+struct OddSizeMessageContents
+{
+    std::uint8_t bytes[5];
+};
+using OddSizeMessage = ImcProtocol::Message<OddSizeMessageContents, ImcProtocol::makeMessageId(testRecipent, 3)>;
+
+ADD_TEST(ImcStreamingCrcTest, senderWritesCrcWhileFrameIsTransmitted_inEachTransmitMode)
+{
+    const std::array<std::pair<UartFraming, UartTransmitInterrupt>, 4> modes{{
+        {UartFraming::IdleLine, UartTransmitInterrupt::TransmissionComplete},
+        {UartFraming::IdleLine, UartTransmitInterrupt::DataRegisterEmpty},
+        {UartFraming::HardwareIdleLine, UartTransmitInterrupt::Dma},
+        {UartFraming::Cobs, UartTransmitInterrupt::TransmissionComplete}
+    }};
+
+    for(auto [framing, transmitInterrupt]: modes)
+    {
+        TestInterruptTimer timer{};
+        TestUart uart{timer, framing, transmitInterrupt};
+        ImcSender<TestUart, maxMessageSize, 2, TestCrc> sender{uart};
+
+        TestMessage msg = makeMessage<TestMessage>(1, TestMessageContents{1, 2});
+        TestMessage msgWithoutCrc = msg;
+        msgWithoutCrc.crc = 0;
+
+        OddSizeMessage inPlaceMsg = makeMessage<OddSizeMessage>(2, OddSizeMessageContents{{1, 2, 3, 4, 5}});
+        const std::uint8_t* inPlaceData = reinterpret_cast<const std::uint8_t*>(&inPlaceMsg);
+        std::array<std::uint8_t, 3 + ImcProtocol::crcSize> trailer{};
+
+        EXPECT_TRUE(sender.sendMessage(msgWithoutCrc));
+        EXPECT_TRUE(sender.sendMessage(
+            makeSpan(inPlaceData, ImcProtocol::headerSize),
+            makeSpan(inPlaceData + ImcProtocol::headerSize, sizeof(OddSizeMessageContents)),
+            makeSpan<const std::uint8_t>(trailer.data(), trailer.size()),
+            {}
+        ));
+        uart.sendAllQueuedBytes();
+
+        if(framing == UartFraming::Cobs)
+        {
+            TestUart receiverUart{timer, UartFraming::Cobs};
+            TestImcReceiver receiver{receiverUart};
+            receiverUart.callDataReceived({0});
+            receiverUart.callDataReceived(uart.sentBytes);
+
+            for(auto expected: {payload(msg), payload(inPlaceMsg)})
+            {
+                auto received = receiver.getNextMessage();
+                ASSERT_TRUE(received.has_value());
+                EXPECT_TRUE(std::equal(expected.begin(), expected.end(), (*received)->begin(), (*received)->end()));
+            }
+        }
+        else
+        {
+            EXPECT_SENT_MESSAGES(uart, msg, inPlaceMsg);
+        }
+    }
+}
+
+ADD_TEST(ImcStreamingCrcTest, receiverComputesCrcOfHeaderAndContentsWhileReceiving)
+{
+    TestInterruptTimer timer{};
+    TestUart uart{timer};
+    ImcReceiver<TestUart, maxMessageSize, 2, false, TestCrc> receiver{uart};
+    TestUart wordsUart{timer};
+    ImcReceiver<TestUart, maxMessageSize, 2, false, TestCrc, CrcFeed::Words> wordsReceiver{wordsUart};
+
+    OddSizeMessage msg = makeMessage<OddSizeMessage>(1, OddSizeMessageContents{{1, 2, 3, 4, 5}});
+    ImcProtocol::Handshake handshake = makeMessage<ImcProtocol::Handshake>(2);
+    for(TestUart* u: {&uart, &wordsUart})
+    {
+        // Partial message before first idle line doesn't affect crc of next one
+        u->callDataReceived({9, 9, 9});
+        u->callIdleLineDetected();
+        u->callDataReceived(payload(msg));
+        u->callIdleLineDetected();
+        u->callDataReceived(payload(handshake));
+        u->callIdleLineDetected();
+    }
+
+    EXPECT_RECEIVED_MESSAGE(receiver, OddSizeMessage);
+    EXPECT_EQUAL(TestCrc{}.getCrc(msg), receiver.getMessageCrc());
+    EXPECT_RECEIVED_MESSAGE(receiver, ImcProtocol::Handshake);
+    EXPECT_EQUAL(TestCrc{}.getCrc(handshake), receiver.getMessageCrc());
+
+    EXPECT_RECEIVED_MESSAGE(wordsReceiver, OddSizeMessage);
+    EXPECT_EQUAL(TestCrc{}.getCrc(msg, CrcFeed::Words), wordsReceiver.getMessageCrc());
+    EXPECT_NOT_EQUAL(TestCrc{}.getCrc(msg), wordsReceiver.getMessageCrc());
+}
+
+template<typename Imc>
+class ImcSlaveTestBase : public ::test::Test
+{
+public:
+    template<typename... Recipients>
+    ImcSlaveTestBase(Recipients&... recipients) :
+        timer{},
+        settings{},
+        uart{timer},
+        imc{uart, crc, settings, recipients...}
+    {
+        settings.slaveHandshakeIntervalUs = 1000;
+        settings.slaveKeepAliveIntervalUs = 1000;
+        settings.slaveAckTimeoutUs = 3000;
+
+        uart.callIdleLineDetected();
+    }
+
+    void sendAck(std::uint16_t sequence, std::uint8_t ackedId, std::uint16_t ackedSequence)
+    {
+        ImcProtocol::Acknowledge ack{};
+        ack.sequence = sequence;
+        ack.data.ackId = ackedId;
+        ack.data.ackSequence = ackedSequence;
+        ack.crc = TestCrc{}.getCrc(ack);
+        uart.callDataReceived(payload(ack));
+        uart.callIdleLineDetected();
+    }
+
+    void establishCommunication()
+    {
+        imc.update(1);
+        uart.sendAllQueuedBytes();
+        EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+        sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 22);
+        imc.update(1);
+        uart.sendAllQueuedBytes();
+        EXPECT_EQUAL(0u, uart.sentBytes.size());
+    }
+
+    std::uint16_t getNextSentSequence()
+    {
+        return nextSentSequence++;
+    }
+
+    std::uint16_t getNextReceivedSequence()
+    {
+        return nextReceivedSequence++;
+    }
+
+    void checkImcProcessesData()
+    {
+        bool dispatchedFlag = false;
+        imc.registerMessageRecipient(
+            testRecipent, {
+            [](void* ctx, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+            {
+                *reinterpret_cast<bool*>(ctx) = true;
+                return true;
+            },
+            &dispatchedFlag
+        });
+
+        TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
+        uart.callDataReceived(payload(msg));
+        uart.callIdleLineDetected();
+
+        imc.update(1);
+        uart.sendAllQueuedBytes();
+
+        EXPECT_EQUAL(0u, uart.sentBytes.size());
+        EXPECT_TRUE(dispatchedFlag);
+    }
+
+    TestCrc crc;
     TestInterruptTimer timer;
     ImcSettings settings;
     TestUart uart;
-    TestMasterIMC imc;
+    Imc imc;
+
+    std::uint16_t nextSentSequence = 0;
+    std::uint16_t nextReceivedSequence = 0;
+};
+
+using ImcSlaveTest = ImcSlaveTestBase<TestSlaveIMC>;
+
+class ImcMasterTest : public ::test::Test
+{
+public:
+    ImcMasterTest() :
+        timer{},
+        settings{},
+        uart{timer},
+        imc{uart, crc, settings}
+    {
+        settings.slaveHandshakeIntervalUs = 1000;
+        settings.slaveKeepAliveIntervalUs = 1000;
+        settings.slaveAckTimeoutUs = 3000;
+
+        settings.masterCommunicationTimeoutUs = 3000;
+
+        uart.callIdleLineDetected();
+    }
+
+    void establishCommunication()
+    {
+        std::uint16_t s = getNextReceivedSequence();
+        ImcProtocol::Handshake handshake = makeMessage<ImcProtocol::Handshake>(s);
+        uart.callDataReceived(payload(handshake));
+        uart.callIdleLineDetected();
+
+        imc.update(1);
+        uart.sendAllQueuedBytes();
+        EXPECT_TRUE(imc.hasCommunicationEstablished());
+        EXPECT_SENT_MESSAGES(uart,
+            withAckSequence(makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::Handshake::myId, s}), s)
+        );
+    }
+
+    std::uint16_t getNextSentSequence()
+    {
+        return nextSentSequence++;
+    }
+
+    std::uint16_t getNextReceivedSequence()
+    {
+        return nextReceivedSequence++;
+    }
+
+    TestCrc crc;
+    TestInterruptTimer timer;
+    ImcSettings settings;
+    TestUart uart;
+    TestMasterIMC imc;
+
+    std::uint16_t nextSentSequence = 0;
+    std::uint16_t nextReceivedSequence = 0;
+};
+
+// ImcModuleTest tests part of InterMcuCommunicationModule common for slave and master, uses slave control
+class ImcModuleTest : public ImcSlaveTest
+{
+};
+
+ADD_TEST_F(ImcSlaveTest, onResetState_sendsHandshakesAfterInterval)
+{
+    // First handshake is sent immediately
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+    EXPECT_EQUAL(1, uart.idleLines);
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+
+    // Another one after programmed interval (1000)
+    imc.update(999);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+    EXPECT_EQUAL(2, uart.idleLines);
+}
+
+ADD_TEST_F(ImcSlaveTest, whenHandshakeAcked_sendsKeepAlive)
+{
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+
+    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 0);
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
+}
+
+ADD_TEST_F(ImcSlaveTest, whenHandshakeAckedWithWrongId_ignoresIt_acceptsWrongSquenceId)
+{
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+
+    sendAck(getNextReceivedSequence(), 0x54, 0);
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+
+    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 22);
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()), 1));
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+}
+
+ADD_TEST_F(ImcSlaveTest, whenKeepAliveNotAckedAfterTimeout_switchesToResetState)
+{
+    establishCommunication();
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+}
+
+ADD_TEST_F(ImcSlaveTest, whenUserDataIsSent_delaysKeepAlive)
+{
+    establishCommunication();
+
+    imc.update(600);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    TestMessage msg = makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{1, 2});
+    imc.sendMessage(msg);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, msg);
+
+    imc.update(600);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+}
+
+ADD_TEST_F(ImcSlaveTest, whenAnyMessageIsReceived_treatsItAsAcknowledge)
+{
+    establishCommunication();
+    imc.registerMessageRecipient(testRecipent, {[](void*, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+    {
+        return true;
+    }, nullptr});
+
+    for(int i = 0; i < 3; ++i)
+    {
+        imc.update(1000);
+        uart.sendAllQueuedBytes();
+        uart.sentBytes.clear();
+
+        TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
+        uart.callDataReceived(payload(msg));
+        uart.callIdleLineDetected();
+    }
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::KeepAlive>(4), 3));
+}
+
+ADD_TEST_F(ImcSlaveTest, sentMessagesAcknowledgeLastReceivedMessage)
+{
+    establishCommunication();
+    imc.registerMessageRecipient(testRecipent, {[](void*, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+    {
+        return true;
+    }, nullptr});
+
+    getNextReceivedSequence();
+    std::uint16_t s = getNextReceivedSequence();
+    TestMessage received = makeMessage<TestMessage>(s, TestMessageContents{1, 2});
+    uart.callDataReceived(payload(received));
+    uart.callIdleLineDetected();
+    imc.update(1);
+
+    TestMessage msg{};
+    imc.sendMessage(msg);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<TestMessage>(getNextSentSequence()), s));
+}
+
+ADD_TEST_F(ImcMasterTest, onResetState_doesNothing)
+{
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(5000);
+    uart.sendAllQueuedBytes();
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+}
+
+ADD_TEST_F(ImcMasterTest, whenReceivesHandshake_sendsAck_establishesCommunication)
+{
+    ImcProtocol::Handshake handshake = makeMessage<ImcProtocol::Handshake>(0);
+    uart.callDataReceived(payload(handshake));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_SENT_MESSAGES(uart,
+        makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::Handshake::myId, 0})
+    );
+}
+
+ADD_TEST_F(ImcMasterTest, whenReceivesKeepAlive_sendsAck)
+{
+    establishCommunication();
+
+    imc.update(1000);
+
+    ImcProtocol::KeepAlive keepAlive = makeMessage<ImcProtocol::KeepAlive>(1);
+    uart.callDataReceived(payload(keepAlive));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::KeepAlive::myId, 1}), 1)
+    );
+}
+
+ADD_TEST_F(ImcMasterTest, whenReceivesKeepAlive_afterRecentlySentMessage_doesntSendAck)
+{
+    establishCommunication();
+
+    imc.update(500);
+
+    TestMessage msg = makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{1, 2});
+    imc.sendMessage(msg);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, msg);
+
+    imc.update(999);
+
+    // Message sent less than slaveKeepAliveIntervalUs ago already acknowledged data from slave
+    ImcProtocol::KeepAlive keepAlive = makeMessage<ImcProtocol::KeepAlive>(1);
+    uart.callDataReceived(payload(keepAlive));
+    uart.callIdleLineDetected();
+
+    imc.update(0);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+}
+
+ADD_TEST_F(ImcMasterTest, onResetState_whenReceivesKeepAlive_doesNothing)
+{
+    ImcProtocol::KeepAlive keepAlive = makeMessage<ImcProtocol::KeepAlive>(1);
+    uart.callDataReceived(payload(keepAlive));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+}
+
+ADD_TEST_F(ImcMasterTest, whenNoMessageIsReceivedForLongTime_tearsDownConnection)
+{
+    // No message
+    establishCommunication();
+
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+
+    // KeepAlive refreshes timer
+    establishCommunication();
+
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    ImcProtocol::KeepAlive keepAlive = makeMessage<ImcProtocol::KeepAlive>(getNextReceivedSequence());
+    uart.callDataReceived(payload(keepAlive));
+    uart.callIdleLineDetected();
+
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::KeepAlive::myId, keepAlive.sequence}), keepAlive.sequence)
+    );
+
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+
+    // User message refreshes timer
+    establishCommunication();
+
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.registerMessageRecipient(testRecipent, {[](void*, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+    {
+        return true;
+    }, nullptr});
+
+    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence());
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+
+}
+
+ADD_TEST_F(ImcModuleTest, whenUserDataIsReceived_dispatchesToRecipient)
+{
+    establishCommunication();
+
+    bool dispatchedFlag = false;
+
+    imc.registerMessageRecipient(
+        testRecipent, {
+        [](void* ctx, auto&, std::uint8_t id, std::uint8_t size, std::uint8_t* data)
+        {
+            ASSERT_EQUAL(TestMessage::myId, id);
+            ASSERT_EQUAL(TestMessage::dataSize, size);
+
+            TestMessageContents& message = reinterpret_cast<TestMessage*>(data)->data;
+            EXPECT_EQUAL(1u, message.a);
+            EXPECT_EQUAL(2u, message.b);
+            *reinterpret_cast<bool*>(ctx) = true;
+
+            return true;
+        },
+        &dispatchedFlag
+    });
+
+    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    EXPECT_TRUE(dispatchedFlag);
+}
+
+ADD_TEST_F(ImcModuleTest, whenNoRecipentIsRegistred_sendsRecieveError)
+{
+    establishCommunication();
+
+    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart,
+        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0, ImcProtocol::ReceiveErrorReason::Rejected})
+    );
+
+    // After error is sent further data should be processed normally
+    checkImcProcessesData();
+}
+
+ADD_TEST_F(ImcModuleTest, whenRecipentReturnsFalse_sendsRecieveError)
+{
+    establishCommunication();
+
+    bool dispatchedFlag = false;
+
+    imc.registerMessageRecipient(testRecipent, {[](void* ctx, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+    {
+        *reinterpret_cast<bool*>(ctx) = true;
+        return false;
+    }, &dispatchedFlag});
+
+    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart,
+        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0, ImcProtocol::ReceiveErrorReason::Rejected})
+    );
+
+    EXPECT_TRUE(dispatchedFlag);
+
+    checkImcProcessesData();
+}
+
+ADD_TEST_F(ImcModuleTest, whenGotReceiveError_sendsReceiveError)
+{
+    establishCommunication();
+
+    uart.callReceiveError(1);
+
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+
+    // KeepAlive is not sent, as its timer is reset after any sent message
+    EXPECT_SENT_MESSAGES(uart,
+        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0})
+    );
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    checkImcProcessesData();
+}
+
+ADD_TEST_F(ImcModuleTest, whenExpectedAndReceivedMessageFieldsDoesntMatch_sendsReceiveError)
+{
+    establishCommunication();
+
+    std::uint8_t lastOkSequence = 0;
+
+    ImcProtocol::Acknowledge ack{};
+    ack.data.ackId = ImcProtocol::Handshake::myId;
+    ack.data.ackSequence = 0;
+
+    // 0) data smaller than 8bytes
+    uart.callDataReceived({1, 2, 3, 4, 5, 6, 7});
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence}), lastOkSequence)
+    );
+
+    // 1) data size too small compared to received bytes
+    ack.size = ImcProtocol::Acknowledge::dataSize - 1;
+    ack.sequence = getNextReceivedSequence();
+    ack.crc = TestCrc{}.getCrc(ack);
+    uart.callDataReceived(payload(ack));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence, ImcProtocol::ReceiveErrorReason::Rejected}), lastOkSequence)
+    );
+
+    // 1.1) send proper message
+    ack.size = ImcProtocol::Acknowledge::dataSize;
+    ack.sequence = getNextReceivedSequence();
+    ack.crc = TestCrc{}.getCrc(ack);
+    uart.callDataReceived(payload(ack));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    lastOkSequence = ack.sequence;
+
+    // 2) data size too big compared to received bytes
+    ack.size = ImcProtocol::Acknowledge::dataSize + 1;
+    ack.sequence = getNextReceivedSequence();
+    ack.crc = TestCrc{}.getCrc(ack);
+    uart.callDataReceived(payload(ack));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence}), lastOkSequence)
+    );
+
+    // 3) crc doesnt match
+    ack.size = ImcProtocol::Acknowledge::dataSize;
+    ack.sequence = getNextReceivedSequence();
+    ack.crc = TestCrc{}.getCrc(ack) - 1;
+    uart.callDataReceived(payload(ack));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence}), lastOkSequence)
+    );
+
+    checkImcProcessesData();
+}
+
+ADD_TEST_F(ImcModuleTest, whenReceiveErrorReceived_ignoresIt)
+{
+    establishCommunication();
+
+    std::uint16_t s = getNextSentSequence();
+    TestMessage msg = makeMessage<TestMessage>(s, TestMessageContents{1, 2});
+    imc.sendMessage(msg);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, msg);
+
+    ImcProtocol::ReceiveError error = makeMessage<ImcProtocol::ReceiveError>(getNextReceivedSequence(), ImcProtocol::ReceiveErrorContents{0});
+    uart.callDataReceived(payload(error));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    msg = makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{1, 2});
+    imc.sendMessage(msg);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, msg);
+}
+
+ADD_TEST_F(ImcModuleTest, whenMessageIsSentInPlace_sendsSameFrameAsCopiedMessage_andDoesntModifyContents)
+{
+    establishCommunication();
+
+    const TestMessageContents contents{1, 2};
+    int sentCount = 0;
+    EXPECT_TRUE(imc.sendMessageInPlace<TestMessage>(contents, {[](void* ctx) { (*static_cast<int*>(ctx))++; }, &sentCount}));
+    EXPECT_EQUAL(0, sentCount);
+
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(1, sentCount);
+    EXPECT_EQUAL(1u, contents.a);
+    EXPECT_EQUAL(2u, contents.b);
+    EXPECT_SENT_MESSAGES(uart, makeMessage<TestMessage>(getNextSentSequence(), contents));
+
+    TestMessage msg = makeMessage<TestMessage>(getNextSentSequence(), contents);
+    EXPECT_TRUE(imc.sendMessage(msg));
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, msg);
+}
+
+ADD_TEST_F(ImcModuleTest, whenMessageQueueIsAlmostFull_doesntSendUserMessage_stillSendsControlMessage)
+{
+    establishCommunication();
+
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+
+    // Only one space in user data queue
+    EXPECT_TRUE(imc.sendMessage(msg));
+    EXPECT_FALSE(imc.sendMessage(msg));
+
+    uart.sendAllQueuedBytes();
+    uart.sentBytes.clear();
+
+    EXPECT_TRUE(imc.sendMessage(msg));
+    imc.update(1000);
+
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES_ID(uart, msg, makeMessage<ImcProtocol::KeepAlive>(0));
+}
+
+ADD_TEST_F(ImcModuleTest, whenMessageQueueIsFull_doesntSendAnyMessages)
+{
+    establishCommunication();
+
+    imc.update(1000);
+
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    EXPECT_FALSE(imc.sendMessage(msg));
+
+    imc.update(1000);
+    imc.update(1000);
+
+    uart.sendAllQueuedBytes();
+
+    // Only 2 KAs are queued and sent despite 3 updates() which tries to send them
+    EXPECT_SENT_MESSAGES_ID(uart, makeMessage<ImcProtocol::KeepAlive>(0), makeMessage<ImcProtocol::KeepAlive>(0));
+}
+
+struct WordsCrcImcConfig : ImcDefaultConfig
+{
+    static constexpr CrcFeed crcFeed = CrcFeed::Words;
+};
+
+ADD_TEST(ImcCrcFeedTest, withWordsCrcFeed_validatesAndComputesCrcOverWords)
+{
+    TestCrc crc{};
+    TestInterruptTimer timer{};
+    ImcSettings settings{};
+    TestUart uart{timer};
+    InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, true, WordsCrcImcConfig> imc{uart, crc, settings};
+    uart.callIdleLineDetected();
+
+    ImcProtocol::Handshake handshake = makeMessage<ImcProtocol::Handshake>(0);
+    handshake.crc = TestCrc{}.getCrc(handshake, CrcFeed::Words);
+    uart.callDataReceived(payload(handshake));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    auto ack = makeMessage<ImcProtocol::Acknowledge>(0, ImcProtocol::AckMessageContents{ImcProtocol::Handshake::myId, 0});
+    ack.crc = TestCrc{}.getCrc(ack, CrcFeed::Words);
+    EXPECT_NOT_EQUAL(TestCrc{}.getCrc(ack, CrcFeed::Bytes), ack.crc);
+    EXPECT_SENT_MESSAGES(uart, ack);
+}
+
+struct StreamingCrcImcConfig : ImcDefaultConfig
+{
+    static constexpr bool streamingCrc = true;
+};
+
+class ImcStreamingCrcModuleTest : public ImcSlaveTestBase<InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, StreamingCrcImcConfig>>
+{
+};
+
+ADD_TEST_F(ImcStreamingCrcModuleTest, sendsAndReceivesMessagesWithCrcComputedInInterrupts)
+{
+    establishCommunication();
+    checkImcProcessesData();
+
+    const TestMessageContents contents{1, 2};
+    TestMessage msg{};
+    msg.data = contents;
+    EXPECT_TRUE(imc.sendMessage(msg));
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.sendMessageInPlace<TestMessage>(contents));
+    uart.sendAllQueuedBytes();
+
+    std::uint16_t lastReceivedSequence = getNextReceivedSequence() - 1;
+    TestMessage expected = withAckSequence(makeMessage<TestMessage>(getNextSentSequence(), contents), lastReceivedSequence);
+    TestMessage expectedInPlace = withAckSequence(makeMessage<TestMessage>(getNextSentSequence(), contents), lastReceivedSequence);
+    EXPECT_SENT_MESSAGES(uart, expected, expectedInPlace);
+}
+
+ADD_TEST_F(ImcStreamingCrcModuleTest, whenReceivedCrcDiffers_sendsReceiveError)
+{
+    establishCommunication();
+
+    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
+    msg.crc++;
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart,
+        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0})
+    );
+}
+
+struct DeepQueueImcConfig : ImcDefaultConfig
+{
+    static constexpr std::uint8_t sendQueueSize = 4;
+};
+
+ADD_TEST_F(ImcModuleTest, withDeeperSendQueue_acceptsMoreUserMessages_stillReservesSlotForControlMessage)
+{
+    InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, DeepQueueImcConfig> deepImc{uart, crc, settings};
+    uart.callIdleLineDetected();
+    deepImc.update(1);
+    uart.sendAllQueuedBytes();
+    uart.sentBytes.clear();
+    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 0);
+    deepImc.update(1);
+    EXPECT_TRUE(deepImc.hasCommunicationEstablished());
+
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+
+    EXPECT_TRUE(deepImc.sendMessage(msg));
+    EXPECT_TRUE(deepImc.sendMessage(msg));
+    EXPECT_TRUE(deepImc.sendMessage(msg));
+    EXPECT_FALSE(deepImc.canEnqueueMessage());
+    EXPECT_FALSE(deepImc.sendMessage(msg));
+
+    deepImc.update(1000);
+
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES_ID(uart, msg, msg, msg, makeMessage<ImcProtocol::KeepAlive>(0));
+}
+
+struct ReliableImcConfig : ImcDefaultConfig
+{
+    static constexpr std::uint8_t sendQueueSize = 4;
+    static constexpr std::uint8_t retransmitWindowSize = 4;
+};
+
+using TestReliableSlaveIMC = InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, ReliableImcConfig>;
+using TestReliableMasterIMC = InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, true, ReliableImcConfig>;
+
+class ImcReliableTest : public ImcSlaveTestBase<TestReliableSlaveIMC>
+{
+public:
+    ImcReliableTest()
+    {
+        settings.retransmitRequestIntervalUs = 500;
+
+        imc.registerMessageRecipient(
+            testRecipent, {
+            [](void* ctx, auto&, std::uint8_t, std::uint8_t, std::uint8_t* data)
+            {
+                auto& msg = ImcProtocol::decode<TestMessage>(data);
+                static_cast<ImcReliableTest*>(ctx)->dispatched.push_back(msg.data.a);
+                return true;
+            },
+            this
+        });
+    }
+
+    void establishCommunication()
+    {
+        ImcSlaveTestBase::establishCommunication();
+        // Control messages don't consume sequence numbers
+        nextSentSequence = 0;
+        nextReceivedSequence = 0;
+    }
+
+    TestMessage sendUserMessage(std::uint8_t a)
+    {
+        TestMessage msg = makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{a, 0});
+        EXPECT_TRUE(imc.sendMessage(msg));
+        return msg;
+    }
+
+    void receive(std::vector<std::uint8_t> frame)
+    {
+        uart.callDataReceived(frame);
+        uart.callIdleLineDetected();
+        imc.update(1);
+        uart.sendAllQueuedBytes();
+    }
+
+    void receiveUserMessage(std::uint16_t sequence, std::uint8_t a)
+    {
+        receive(payload(makeMessage<TestMessage>(sequence, TestMessageContents{a, 0})));
+    }
+
+    void receiveError(std::uint16_t lastOkSequence)
+    {
+        receive(payload(makeMessage<ImcProtocol::ReceiveError>(0, ImcProtocol::ReceiveErrorContents{lastOkSequence})));
+    }
+
+    std::vector<std::uint8_t> dispatched{};
+};
+
+ADD_TEST_F(ImcReliableTest, controlMessagesDontConsumeSequenceNumbers)
+{
+    establishCommunication();
+
+    TestMessage msg1 = sendUserMessage(1);
+    imc.update(1000);
+    TestMessage msg2 = sendUserMessage(2);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(0u, msg1.sequence);
+    EXPECT_EQUAL(1u, msg2.sequence);
+    // Nothing was received yet
+    EXPECT_SENT_MESSAGES(uart, msg1, withAckSequence(makeMessage<ImcProtocol::KeepAlive>(1), 0xFFFF), msg2);
+}
+
+ADD_TEST_F(ImcReliableTest, whenReceiveErrorReceived_retransmitsFramesSentAfterLastOkSequence)
+{
+    establishCommunication();
+
+    TestMessage msg0 = sendUserMessage(0);
+    TestMessage msg1 = sendUserMessage(1);
+    TestMessage msg2 = sendUserMessage(2);
+    uart.sendAllQueuedBytes();
+    uart.sentBytes.clear();
+
+    receiveError(0);
+
+    EXPECT_SENT_MESSAGES(uart, msg1, msg2);
+
+    // Next message continues sequence
+    TestMessage msg3 = sendUserMessage(3);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(3u, msg3.sequence);
+    EXPECT_SENT_MESSAGES(uart, msg3);
+    (void)msg0;
+}
+
+ADD_TEST_F(ImcReliableTest, whenReceiveErrorReceived_retransmitsMessagesSentInPlace)
+{
+    establishCommunication();
+
+    TestMessage msg0 = sendUserMessage(0);
+    TestMessageContents contents{1, 0};
+    EXPECT_TRUE(imc.sendMessageInPlace<TestMessage>(contents));
+    uart.sendAllQueuedBytes();
+    uart.sentBytes.clear();
+
+    receiveError(0);
+
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<TestMessage>(1, TestMessageContents{1, 0}), 0xFFFF));
+    (void)msg0;
+}
+
+ADD_TEST_F(ImcReliableTest, whenAllFramesWereReceived_receiveErrorDoesntRetransmitAnything)
+{
+    establishCommunication();
+
+    sendUserMessage(0);
+    sendUserMessage(1);
+    uart.sendAllQueuedBytes();
+    uart.sentBytes.clear();
+
+    receiveError(1);
+
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+}
+
+ADD_TEST_F(ImcReliableTest, duringRetransmission_doesntAcceptUserMessages)
+{
+    establishCommunication();
+
+    TestMessage msg0 = sendUserMessage(0);
+    TestMessage msg1 = sendUserMessage(1);
+    TestMessage msg2 = sendUserMessage(2);
+
+    // Sender queue is full, so retransmission waits
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::ReceiveError>(0, ImcProtocol::ReceiveErrorContents{0})));
+    uart.callIdleLineDetected();
+    imc.update(1);
+
+    uart.sendAllQueuedBytes();
+    EXPECT_FALSE(imc.canEnqueueMessage());
+    TestMessage rejected = makeMessage<TestMessage>(0, TestMessageContents{3, 0});
+    EXPECT_FALSE(imc.sendMessage(rejected));
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_TRUE(imc.canEnqueueMessage());
+
+    EXPECT_SENT_MESSAGES(uart, msg0, msg1, msg2, msg1, msg2);
+}
+
+ADD_TEST_F(ImcReliableTest, whenLostFrameIsNoLongerInWindow_resetsCommunication)
+{
+    establishCommunication();
+
+    for(std::uint8_t i = 0; i < 6; ++i)
+    {
+        sendUserMessage(i);
+        uart.sendAllQueuedBytes();
+    }
+    uart.sentBytes.clear();
+
+    receiveError(0);
+
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::Handshake>(6), 0xFFFF));
+}
+
+ADD_TEST_F(ImcReliableTest, whenFrameAfterGapIsReceived_dropsIt_andRequestsRetransmissionOnce)
+{
+    establishCommunication();
+
+    receiveUserMessage(0, 10);
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    receiveUserMessage(2, 12);
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::ReceiveError>(0, ImcProtocol::ReceiveErrorContents{0}));
+
+    receiveUserMessage(3, 13);
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    // Retransmitted frames
+    receiveUserMessage(1, 11);
+    receiveUserMessage(2, 12);
+    receiveUserMessage(3, 13);
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    EXPECT_TRUE((std::vector<std::uint8_t>{10, 11, 12, 13}) == dispatched);
+}
+
+ADD_TEST_F(ImcReliableTest, whenDuplicatedFrameIsReceived_dropsItSilently)
+{
+    establishCommunication();
+
+    receiveUserMessage(0, 10);
+    receiveUserMessage(1, 11);
+    receiveUserMessage(0, 10);
+    receiveUserMessage(2, 12);
+
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    EXPECT_TRUE((std::vector<std::uint8_t>{10, 11, 12}) == dispatched);
+}
+
+ADD_TEST_F(ImcReliableTest, whenRetransmissionDoesntArrive_requestsItAgainAfterInterval)
+{
+    establishCommunication();
+
+    receiveUserMessage(1, 11);
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::ReceiveError>(0, ImcProtocol::ReceiveErrorContents{0xFFFF}), 0xFFFF));
+
+    // Each receive also updates imc by 1us
+    imc.update(400);
+    receiveUserMessage(2, 12);
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    imc.update(98);
+    receiveUserMessage(3, 13);
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::ReceiveError>(0, ImcProtocol::ReceiveErrorContents{0xFFFF}), 0xFFFF));
+
+    EXPECT_EQUAL(0u, dispatched.size());
+}
 
-    std::uint16_t nextSentSequence = 0;
-    std::uint16_t nextReceivedSequence = 0;
-};
+ADD_TEST_F(ImcReliableTest, whenControlMessageRevealsLostFrame_requestsRetransmission)
+{
+    establishCommunication();
 
-// ImcModuleTest tests part of InterMcuCommunicationModule common for slave and master, uses slave control
-class ImcModuleTest : public ImcSlaveTest
+    receiveUserMessage(0, 10);
+
+    // Frame with sequence 1 was lost, Acknowledge carries sequence of next user frame
+    ImcProtocol::Acknowledge ack = makeMessage<ImcProtocol::Acknowledge>(2, ImcProtocol::AckMessageContents{ImcProtocol::KeepAlive::myId, 0});
+    receive(payload(ack));
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::ReceiveError>(0, ImcProtocol::ReceiveErrorContents{0}));
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+}
+
+ADD_TEST_F(ImcReliableTest, whenCorruptedFrameIsReceived_requestsRetransmissionOfIt)
+{
+    establishCommunication();
+
+    receiveUserMessage(0, 10);
+
+    TestMessage msg = makeMessage<TestMessage>(1, TestMessageContents{11, 0});
+    msg.crc += 1;
+    receive(payload(msg));
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::ReceiveError>(0, ImcProtocol::ReceiveErrorContents{0}));
+
+    receiveUserMessage(1, 11);
+    EXPECT_TRUE((std::vector<std::uint8_t>{10, 11}) == dispatched);
+}
+
+namespace detail
+{
+template<typename Message>
+void appendBatchEntry(std::vector<std::uint8_t>& frame, Message msg)
+{
+    auto bytes = payload(msg);
+    frame.insert(frame.end(), bytes.begin(), bytes.end() - ImcProtocol::crcSize);
+}
+}
+
+template<typename... Messages>
+std::vector<std::uint8_t> makeBatch(std::uint16_t sequence, Messages... msgs)
+{
+    ((msgs.sequence = sequence), ...);
+
+    std::vector<std::uint8_t> frame(ImcProtocol::headerSize, 0);
+    (detail::appendBatchEntry(frame, msgs), ...);
+
+    frame[0] = ImcProtocol::batchMessageId;
+    frame[1] = frame.size() - ImcProtocol::headerSize;
+    *reinterpret_cast<std::uint16_t*>(frame.data() + ImcProtocol::sequenceOffset) = sequence;
+
+    TestCrc crc{};
+    crc.reset();
+    crc.add(makeSpan(frame.data(), frame.size()));
+    std::uint32_t crcValue = crc.get();
+    std::uint8_t* crcBytes = reinterpret_cast<std::uint8_t*>(&crcValue);
+    frame.insert(frame.end(), crcBytes, crcBytes + ImcProtocol::crcSize);
+    return frame;
+}
+
+class ImcBatchingTest : public ImcSlaveTest
 {
+public:
+    ImcBatchingTest()
+    {
+        settings.batchMaxSize = 44;
+        settings.batchMaxHoldUs = 0;
+    }
 };
 
-ADD_TEST_F(ImcSlaveTest, onResetState_sendsHandshakesAfterInterval)
+ADD_TEST_F(ImcBatchingTest, sendsMessagesEnqueuedBetweenUpdatesInSingleFrame)
 {
-    // First handshake is sent immediately
+    establishCommunication();
+    std::uint8_t idleLines = uart.idleLines;
+
+    TestMessage msg1 = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    TestMessage msg2 = makeMessage<TestMessage>(0, TestMessageContents{3, 4});
+
+    EXPECT_TRUE(imc.sendMessage(msg1));
+    EXPECT_TRUE(imc.canEnqueueMessage());
+    EXPECT_TRUE(imc.sendMessage(msg2));
+
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
     imc.update(1);
     uart.sendAllQueuedBytes();
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
-    EXPECT_EQUAL(1, uart.idleLines);
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    auto expected = makeBatch(getNextSentSequence(), msg1, msg2);
+    EXPECT_TRUE(expected == uart.sentBytes);
+    EXPECT_EQUAL(idleLines + 1, uart.idleLines);
+}
+
+ADD_TEST_F(ImcBatchingTest, whenBatchHasSingleMessage_sendsItAsOrdinaryMessage)
+{
+    establishCommunication();
+
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    EXPECT_TRUE(imc.sendMessage(msg));
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_SENT_MESSAGES(uart, makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{1, 2}));
+}
+
+ADD_TEST_F(ImcBatchingTest, whenMessageDoesntFitInBatch_sendsBatchAndStartsNextOne)
+{
+    establishCommunication();
+
+    TestMessage msg1 = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    TestMessage msg2 = makeMessage<TestMessage>(0, TestMessageContents{3, 4});
+    TestMessage msg3 = makeMessage<TestMessage>(0, TestMessageContents{5, 6});
+
+    EXPECT_TRUE(imc.sendMessage(msg1));
+    EXPECT_TRUE(imc.sendMessage(msg2));
+    EXPECT_TRUE(imc.sendMessage(msg3));
 
-    // Another one after programmed interval (1000)
-    imc.update(999);
+    uart.sendAllQueuedBytes();
+    auto expected = makeBatch(getNextSentSequence(), msg1, msg2);
+    EXPECT_TRUE(expected == uart.sentBytes);
+    uart.sentBytes.clear();
+
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{5, 6}));
+}
+
+ADD_TEST_F(ImcBatchingTest, whenHoldTimeIsNotExceeded_waitsForMoreMessages)
+{
+    settings.batchMaxHoldUs = 500;
+    establishCommunication();
+
+    TestMessage msg1 = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    TestMessage msg2 = makeMessage<TestMessage>(0, TestMessageContents{3, 4});
+
+    EXPECT_TRUE(imc.sendMessage(msg1));
+    imc.update(250);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    EXPECT_TRUE(imc.sendMessage(msg2));
+    imc.update(250);
+    uart.sendAllQueuedBytes();
+
+    auto expected = makeBatch(getNextSentSequence(), msg1, msg2);
+    EXPECT_TRUE(expected == uart.sentBytes);
+}
+
+ADD_TEST_F(ImcBatchingTest, controlMessagesAreNotBatched)
+{
+    establishCommunication();
+
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    EXPECT_TRUE(imc.sendMessage(msg));
+
+    // KeepAlive is sent immediately, batch after it
+    ImcProtocol::KeepAlive keepAlive{};
+    EXPECT_TRUE(imc.sendMessage(keepAlive));
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES_ID(uart, keepAlive);
+
+    // Sent batch delays next KeepAlive
+    imc.update(1000);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES_ID(uart, msg);
+}
+
+ADD_TEST_F(ImcBatchingTest, whenBatchIsReceived_dispatchesEachMessage)
+{
+    establishCommunication();
+
+    std::vector<std::uint32_t> received{};
+    imc.registerMessageRecipient(
+        testRecipent, {
+        [](void* ctx, auto&, std::uint8_t id, std::uint8_t size, std::uint8_t* data)
+        {
+            EXPECT_EQUAL(TestMessage::myId, id);
+            EXPECT_EQUAL(TestMessage::dataSize, size);
+            reinterpret_cast<std::vector<std::uint32_t>*>(ctx)->push_back(reinterpret_cast<TestMessage*>(data)->data.b);
+            return true;
+        },
+        &received
+    });
+
+    TestMessage msg1 = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    TestMessage msg2 = makeMessage<TestMessage>(0, TestMessageContents{3, 4});
+    uart.callDataReceived(makeBatch(getNextReceivedSequence(), msg1, msg2));
+    uart.callIdleLineDetected();
+
+    imc.update(1);
     uart.sendAllQueuedBytes();
 
     EXPECT_EQUAL(0u, uart.sentBytes.size());
+    ASSERT_EQUAL(2u, received.size());
+    EXPECT_EQUAL(2u, received[0]);
+    EXPECT_EQUAL(4u, received[1]);
+}
+
+ADD_TEST_F(ImcBatchingTest, whenReceivedBatchIsMalformed_sendsReceiveError)
+{
+    establishCommunication();
+
+    imc.registerMessageRecipient(testRecipent, {[](void*, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+    {
+        return true;
+    }, nullptr});
+
+    // Entry declares more data than there is in batch
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    msg.size = 20;
+    uart.callDataReceived(makeBatch(getNextReceivedSequence(), msg));
+    uart.callIdleLineDetected();
 
     imc.update(1);
     uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart,
+        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0, ImcProtocol::ReceiveErrorReason::Rejected})
+    );
+}
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
-    EXPECT_EQUAL(2, uart.idleLines);
+
+struct TestMessageContents2
+{
+    std::uint32_t a = 0;
+    std::uint32_t b = 0;
+    std::uint32_t c = 0;
+    std::uint32_t d = 0;
+};
+using TestMessage2 = ImcProtocol::Message<TestMessageContents2, ImcProtocol::makeMessageId(testRecipent, 2)>;
+
+struct TestRecipient : public ImcRecipent<TestRecipient, testRecipent, TestMessage, TestMessage2>
+{
+    bool handleMessage(TestMessage& m, int&)
+    {
+        m.data.b = 10;
+        return true;
+    }
+
+    bool handleMessage(TestMessage2& m, int&)
+    {
+        m.data.c = 20;
+        return true;
+    }
+};
+
+static_assert(TestRecipient::maxMessageSize == 28, "Expected: TestRecipient::maxMessageSize == 28");
+static_assert(TestRecipient::recipentNumber == 2, "Expected: TestRecipient::recipentNumber == 2");
+
+ADD_TEST(ImcRecipientTest, dispatchValidMessages)
+{
+    TestRecipient r{};
+    int dummy = 0;
+    TestMessage m1{};
+    TestMessage2 m2{};
+
+    bool v1 = r.dispatch(dummy, TestMessage::myId, TestMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1));
+    EXPECT_TRUE(v1);
+    EXPECT_EQUAL(10u, m1.data.b);
+    EXPECT_EQUAL(0u, m2.data.c);
+
+    bool v2 = r.dispatch(dummy, TestMessage2::myId, TestMessage2::dataSize, reinterpret_cast<std::uint8_t*>(&m2));
+    EXPECT_TRUE(v2);
+    EXPECT_EQUAL(10u, m1.data.b);
+    EXPECT_EQUAL(20u, m2.data.c);
+}
+
+ADD_TEST(ImcRecipientTest, dispatchInalidMessages)
+{
+    TestRecipient r{};
+    int dummy = 0;
+    TestMessage m1{};
+    TestMessage2 m2{};
+
+    bool v1 = r.dispatch(dummy, 0, TestMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1));
+    EXPECT_FALSE(v1);
+    EXPECT_EQUAL(0u, m1.data.b);
+    EXPECT_EQUAL(0u, m2.data.c);
+
+    bool v2 = r.dispatch(dummy, TestMessage2::myId, 143, reinterpret_cast<std::uint8_t*>(&m2));
+    EXPECT_FALSE(v2);
+    EXPECT_EQUAL(0u, m1.data.b);
+    EXPECT_EQUAL(0u, m2.data.c);
+}
+
+ADD_TEST(ImcRecipientTest, dispatchRejectsUnknownMessageNumberAndOtherRecipient)
+{
+    TestRecipient r{};
+    int dummy = 0;
+    TestMessage m1{};
+
+    // Same message number, but other recipient
+    constexpr std::uint8_t otherRecipientId = ImcProtocol::makeMessageId(testRecipent + 1, ImcProtocol::getMessageNumber(TestMessage::myId));
+    EXPECT_FALSE(r.dispatch(dummy, otherRecipientId, TestMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1)));
+    // Highest message number, not handled by recipient
+    EXPECT_FALSE(r.dispatch(dummy, ImcProtocol::makeMessageId(testRecipent, 0x3F), TestMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1)));
+    EXPECT_EQUAL(0u, m1.data.b);
+}
+
+template<std::uint8_t recipientNumber>
+struct StaticTestRecipient : public ImcRecipent<StaticTestRecipient<recipientNumber>, recipientNumber,
+    ImcProtocol::Message<TestMessageContents, ImcProtocol::makeMessageId(recipientNumber, 1)>>
+{
+    template<typename Message, typename ImcModule>
+    bool handleMessage(Message& m, ImcModule&)
+    {
+        lastB = m.data.b;
+        return m.data.a != 0;
+    }
+
+    std::uint32_t lastB = 0;
+};
+
+using StaticRecipientsSlaveIMC = InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, ImcDefaultConfig, StaticTestRecipient<testRecipent>>;
+
+static_assert(!StaticRecipientsSlaveIMC::hasStaticRecipientForEachNumber, "Expected: only recipient 2 is static");
+static_assert(InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, ImcDefaultConfig,
+    StaticTestRecipient<3>, StaticTestRecipient<1>, StaticTestRecipient<2>>::hasStaticRecipientForEachNumber,
+    "Expected: all recipients are static");
+
+// Recipient is constructed before module, which keeps reference to it
+struct StaticRecipientHolder
+{
+    StaticTestRecipient<testRecipent> recipient{};
+};
+
+class ImcStaticRecipientsTest : private StaticRecipientHolder, public ImcSlaveTestBase<StaticRecipientsSlaveIMC>
+{
+public:
+    ImcStaticRecipientsTest() :
+        ImcSlaveTestBase{recipient}
+    {
+    }
+
+    StaticTestRecipient<testRecipent>& staticRecipient = recipient;
+};
+
+ADD_TEST_F(ImcStaticRecipientsTest, routesMessagesToStaticRecipient_andToRecipientRegisteredAtRuntime)
+{
+    establishCommunication();
+
+    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 7});
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(7u, staticRecipient.lastB);
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+
+    // Invalid contents reported by static recipient
+    msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{0, 8});
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(8u, staticRecipient.lastB);
+    EXPECT_SENT_MESSAGES_ID(uart, ImcProtocol::ReceiveError{});
+
+    // Other recipient numbers may be still registered at runtime
+    int dispatchedCount = 0;
+    imc.registerMessageRecipient(1, {[](void* ctx, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+    {
+        (*static_cast<int*>(ctx))++;
+        return true;
+    }, &dispatchedCount});
+
+    using OtherMessage = ImcProtocol::Message<TestMessageContents, ImcProtocol::makeMessageId(1, 1)>;
+    auto otherMsg = makeMessage<OtherMessage>(getNextReceivedSequence(), TestMessageContents{1, 9});
+    uart.callDataReceived(payload(otherMsg));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+
+    EXPECT_EQUAL(1, dispatchedCount);
+    EXPECT_EQUAL(8u, staticRecipient.lastB);
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+}
+
+using TestWideIdLayout = ImcProtocol::WideIdLayout<4>;
+constexpr std::uint16_t testWideRecipient = 9;
+using TestWideMessage = ImcProtocol::WideMessage<TestMessageContents, TestWideIdLayout::makeId(testWideRecipient, 1)>;
+using TestWideMessage2 = ImcProtocol::WideMessage<TestMessageContents2, TestWideIdLayout::makeId(testWideRecipient, 300)>;
+
+static_assert(TestWideIdLayout::recipientsCount == 16, "Expected: TestWideIdLayout::recipientsCount == 16");
+static_assert(TestWideMessage::myId == ImcProtocol::wideMessageId, "Expected: wide messages are sent with wideMessageId");
+static_assert(TestWideIdLayout::getMessageNumber(TestWideMessage2::myExtendedId) == 300, "Expected: message number is 300");
+static_assert(!ImcProtocol::isControlMessageId(ImcProtocol::wideMessageId), "Expected: wide message is user message");
+
+struct TestWideRecipient : public ImcWideRecipent<TestWideRecipient, TestWideIdLayout, testWideRecipient, TestWideMessage, TestWideMessage2>
+{
+    template<typename ImcModule>
+    bool handleMessage(TestWideMessage& m, ImcModule&)
+    {
+        lastB = m.data.b;
+        return m.data.a != 0;
+    }
+
+    template<typename ImcModule>
+    bool handleMessage(TestWideMessage2& m, ImcModule&)
+    {
+        lastB = m.data.b;
+        return true;
+    }
+
+    std::uint32_t lastB = 0;
+};
+
+ADD_TEST(ImcRecipientTest, wideRecipientDispatchesMessagesByWideId)
+{
+    TestWideRecipient r{};
+    int dummy = 0;
+    TestWideMessage m1{};
+    m1.data = TestMessageContents{1, 5};
+    TestWideMessage2 m2{};
+    m2.data.b = 6;
+
+    EXPECT_TRUE(r.dispatch(dummy, TestWideMessage::myExtendedId, TestWideMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1)));
+    EXPECT_EQUAL(5u, r.lastB);
+    EXPECT_TRUE(r.dispatch(dummy, TestWideMessage2::myExtendedId, TestWideMessage2::dataSize, reinterpret_cast<std::uint8_t*>(&m2)));
+    EXPECT_EQUAL(6u, r.lastB);
+
+    // Other recipient, message number above largest one and wrong size are rejected
+    EXPECT_FALSE(r.dispatch(dummy, TestWideIdLayout::makeId(testWideRecipient + 1, 1), TestWideMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1)));
+    EXPECT_FALSE(r.dispatch(dummy, TestWideIdLayout::makeId(testWideRecipient, 301), TestWideMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1)));
+    EXPECT_FALSE(r.dispatch(dummy, TestWideMessage::myExtendedId, TestWideMessage2::dataSize, reinterpret_cast<std::uint8_t*>(&m1)));
+    EXPECT_EQUAL(6u, r.lastB);
 }
 
-ADD_TEST_F(ImcSlaveTest, whenHandshakeAcked_sendsKeepAlive)
+struct WideIdImcConfig : ImcDefaultConfig
+{
+    static constexpr std::uint8_t wideIdRecipientBits = 4;
+};
+
+class ImcWideMessagesTest : public ImcSlaveTestBase<InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, WideIdImcConfig>>
 {
-    imc.update(1);
-    uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
+public:
+    ImcWideMessagesTest()
+    {
+        wideRecipient.registerRecipient(imc);
+    }
 
-    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 0);
+    TestWideRecipient wideRecipient{};
+};
 
-    imc.update(1);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+ADD_TEST_F(ImcWideMessagesTest, sendsAndDispatchesWideMessages_alongsideOrdinaryOnes)
+{
+    establishCommunication();
 
-    imc.update(1000);
+    TestWideMessage sent{};
+    sent.data = TestMessageContents{1, 2};
+    std::uint16_t sequence = getNextSentSequence();
+    EXPECT_TRUE(imc.sendMessage(sent));
     uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, makeMessage<TestWideMessage>(sequence, TestMessageContents{1, 2}));
+    EXPECT_EQUAL(TestWideMessage::myExtendedId, sent.extendedId);
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
-
-    imc.update(1000);
+    auto msg = makeMessage<TestWideMessage2>(getNextReceivedSequence(), TestMessageContents2{0, 11});
+    uart.callDataReceived(payload(msg));
+    uart.callIdleLineDetected();
+    imc.update(1);
     uart.sendAllQueuedBytes();
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
-}
+    EXPECT_EQUAL(11u, wideRecipient.lastB);
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
 
-ADD_TEST_F(ImcSlaveTest, whenHandshakeAckedWithWrongId_ignoresIt_acceptsWrongSquenceId)
-{
+    // Wide message to recipient which is not registered
+    using OtherWideMessage = ImcProtocol::WideMessage<TestMessageContents, TestWideIdLayout::makeId(15, 1)>;
+    auto otherMsg = makeMessage<OtherWideMessage>(getNextReceivedSequence(), TestMessageContents{1, 12});
+    uart.callDataReceived(payload(otherMsg));
+    uart.callIdleLineDetected();
     imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
-
-    sendAck(getNextReceivedSequence(), 0x54, 0);
 
-    imc.update(1000);
-    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(11u, wideRecipient.lastB);
+    EXPECT_SENT_MESSAGES_ID(uart, ImcProtocol::ReceiveError{});
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    // Ordinary messages are still dispatched to their recipients
+    checkImcProcessesData();
+}
 
-    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 22);
+template<std::size_t size>
+struct TestFragmentContents
+{
+    ImcProtocol::FragmentHeader header;
+    std::array<std::uint8_t, size> data;
+};
 
-    imc.update(1000);
-    uart.sendAllQueuedBytes();
+template<std::size_t size>
+using TestFragment = ImcProtocol::Message<TestFragmentContents<size>, ImcProtocol::fragmentMessageId>;
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
+template<std::size_t size>
+TestFragment<size> makeFragment(std::uint16_t sequence, std::uint16_t messageId, const std::vector<std::uint8_t>& message, std::uint16_t offset)
+{
+    TestFragmentContents<size> contents{};
+    contents.header.messageId = messageId;
+    contents.header.totalSize = message.size();
+    contents.header.offset = offset;
+    std::copy(message.begin() + offset, message.begin() + offset + size, contents.data.begin());
+    return makeMessage<TestFragment<size>>(sequence, contents);
 }
 
-ADD_TEST_F(ImcSlaveTest, whenKeepAliveNotAckedAfterTimeout_switchesToResetState)
+class ImcFragmentationTest : public ImcSlaveTest
 {
-    establishCommunication();
-
-    imc.update(1000);
-    uart.sendAllQueuedBytes();
-
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
+public:
+    ImcFragmentationTest()
+    {
+        for(std::size_t i = 0; i < message.size(); ++i)
+        {
+            message[i] = i * 3;
+        }
 
-    imc.update(1000);
-    uart.sendAllQueuedBytes();
+        imc.setFragmentedMessageReceiver(makeSpan(receiveBuffer.data(), receiveBuffer.size()), {
+            [](void* ctx, auto&, std::uint16_t messageId, Span<std::uint8_t> data)
+            {
+                auto* self = static_cast<ImcFragmentationTest*>(ctx);
+                self->receivedId = messageId;
+                self->received.assign(data.begin(), data.end());
+                self->receivedCount++;
+                return true;
+            }, this
+        });
+    }
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::KeepAlive>(getNextSentSequence()));
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    void receiveFrame(const std::vector<std::uint8_t>& frame)
+    {
+        uart.callDataReceived(frame);
+        uart.callIdleLineDetected();
+        imc.update(1);
+        uart.sendAllQueuedBytes();
+    }
 
-    imc.update(1000);
-    uart.sendAllQueuedBytes();
+    // 28 bytes of fragment data fit in frame with maxMessageSize
+    std::vector<std::uint8_t> message = std::vector<std::uint8_t>(70);
+    std::array<std::uint8_t, 80> receiveBuffer{};
 
-    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Handshake>(getNextSentSequence()));
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
-}
+    std::uint16_t receivedId = 0;
+    std::vector<std::uint8_t> received{};
+    int receivedCount = 0;
+};
 
-ADD_TEST_F(ImcSlaveTest, whenUserDataIsSent_delaysKeepAlive)
+ADD_TEST_F(ImcFragmentationTest, sendsMessageInFragments_interleavedWithOtherMessages)
 {
     establishCommunication();
 
-    imc.update(600);
-    uart.sendAllQueuedBytes();
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
-
-    TestMessage msg = makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{1, 2});
-    imc.sendMessage(msg);
-    uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart, msg);
+    int sentCount = 0;
+    EXPECT_TRUE(imc.sendFragmentedMessage(5, makeSpan<const std::uint8_t>(message.data(), message.size()), {[](void* ctx)
+    {
+        (*static_cast<int*>(ctx))++;
+    }, &sentCount}));
+    EXPECT_FALSE(imc.sendFragmentedMessage(6, makeSpan<const std::uint8_t>(message.data(), message.size())));
 
-    imc.update(600);
+    std::uint16_t sequence0 = getNextSentSequence();
     uart.sendAllQueuedBytes();
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
-}
+    EXPECT_SENT_MESSAGES(uart, makeFragment<28>(sequence0, 5, message, 0));
 
-ADD_TEST_F(ImcMasterTest, onResetState_doesNothing)
-{
+    // User message sent during transfer waits for at most one fragment
+    TestMessage msg{};
+    EXPECT_TRUE(imc.sendMessage(msg));
+    std::uint16_t sequence1 = getNextSentSequence();
     imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    EXPECT_SENT_MESSAGES(uart, makeMessage<TestMessage>(sequence1));
 
-    imc.update(5000);
+    imc.update(1);
+    std::uint16_t sequence2 = getNextSentSequence();
     uart.sendAllQueuedBytes();
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
-}
-
-ADD_TEST_F(ImcMasterTest, whenReceivesHandshake_sendsAck_establishesCommunication)
-{
-    ImcProtocol::Handshake handshake = makeMessage<ImcProtocol::Handshake>(0);
-    uart.callDataReceived(payload(handshake));
-    uart.callIdleLineDetected();
-
     imc.update(1);
+    std::uint16_t sequence3 = getNextSentSequence();
+    EXPECT_TRUE(imc.isSendingFragmentedMessage());
+    EXPECT_EQUAL(0, sentCount);
     uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
+
     EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::Handshake::myId, 0})
+        makeFragment<28>(sequence2, 5, message, 28),
+        makeFragment<14>(sequence3, 5, message, 56)
     );
+    EXPECT_EQUAL(1, sentCount);
+    EXPECT_FALSE(imc.isSendingFragmentedMessage());
 }
 
-ADD_TEST_F(ImcMasterTest, whenReceivesKeepAlive_sendsAck)
+ADD_TEST_F(ImcFragmentationTest, whenFragmentIsTransmittedBeforeEnqueueingReturns_sendsNextOne)
 {
     establishCommunication();
 
-    ImcProtocol::KeepAlive keepAlive = makeMessage<ImcProtocol::KeepAlive>(1);
-    uart.callDataReceived(payload(keepAlive));
-    uart.callIdleLineDetected();
+    std::uint16_t sequence0 = getNextSentSequence();
+    std::uint16_t sequence1 = getNextSentSequence();
+    std::uint16_t sequence2 = getNextSentSequence();
 
+    int sentCount = 0;
+    uart.isSendingOnResume = true;
+    EXPECT_TRUE(imc.sendFragmentedMessage(5, makeSpan<const std::uint8_t>(message.data(), message.size()), {[](void* ctx)
+    {
+        (*static_cast<int*>(ctx))++;
+    }, &sentCount}));
     imc.update(1);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    imc.update(1);
+    uart.isSendingOnResume = false;
+
     EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::KeepAlive::myId, 1})
+        makeFragment<28>(sequence0, 5, message, 0),
+        makeFragment<28>(sequence1, 5, message, 28),
+        makeFragment<14>(sequence2, 5, message, 56)
     );
+    EXPECT_EQUAL(1, sentCount);
+    EXPECT_FALSE(imc.isSendingFragmentedMessage());
 }
 
-ADD_TEST_F(ImcMasterTest, onResetState_whenReceivesKeepAlive_doesNothing)
+ADD_TEST_F(ImcFragmentationTest, reassemblesReceivedFragments_andPassesWholeMessageToCallback)
 {
-    ImcProtocol::KeepAlive keepAlive = makeMessage<ImcProtocol::KeepAlive>(1);
-    uart.callDataReceived(payload(keepAlive));
-    uart.callIdleLineDetected();
+    establishCommunication();
 
-    imc.update(1);
-    uart.sendAllQueuedBytes();
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    receiveFrame(payload(makeFragment<28>(getNextReceivedSequence(), 5, message, 0)));
+    receiveFrame(payload(makeFragment<28>(getNextReceivedSequence(), 5, message, 28)));
+    EXPECT_EQUAL(0, receivedCount);
+
+    // Other messages are dispatched during transfer
+    checkImcProcessesData();
+
+    receiveFrame(payload(makeFragment<14>(getNextReceivedSequence(), 5, message, 56)));
     EXPECT_EQUAL(0u, uart.sentBytes.size());
+    EXPECT_EQUAL(1, receivedCount);
+    EXPECT_EQUAL(5, receivedId);
+    EXPECT_TRUE(message == received);
 }
 
-ADD_TEST_F(ImcMasterTest, whenNoMessageIsReceivedForLongTime_tearsDownConnection)
+ADD_TEST_F(ImcFragmentationTest, whenFragmentIsMissing_dropsMessage_andReportsErrorOnce)
 {
-    // No message
     establishCommunication();
 
-    imc.update(2000);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    receiveFrame(payload(makeFragment<28>(getNextReceivedSequence(), 5, message, 0)));
+    receiveFrame(payload(makeFragment<14>(getNextReceivedSequence(), 5, message, 56)));
+    EXPECT_SENT_MESSAGES_ID(uart, ImcProtocol::ReceiveError{});
 
-    imc.update(1000);
-    uart.sendAllQueuedBytes();
+    // Following fragments of dropped message are ignored
+    receiveFrame(payload(makeFragment<28>(getNextReceivedSequence(), 5, message, 28)));
     EXPECT_EQUAL(0u, uart.sentBytes.size());
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0, receivedCount);
 
-    // KeepAlive refreshes timer
-    establishCommunication();
+    // Message larger than buffer is rejected
+    std::vector<std::uint8_t> largeMessage(100);
+    receiveFrame(payload(makeFragment<28>(getNextReceivedSequence(), 6, largeMessage, 0)));
+    EXPECT_SENT_MESSAGES_ID(uart, ImcProtocol::ReceiveError{});
+    EXPECT_EQUAL(0, receivedCount);
+}
 
-    imc.update(2000);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+using TestStateMessage = ImcProtocol::Message<TestMessageContents2, ImcProtocol::makeMessageId(testRecipent, 4)>;
+using TestDeltaMessage = ImcProtocol::DeltaMessage<TestStateMessage, ImcProtocol::makeMessageId(testRecipent, 5)>;
 
-    ImcProtocol::KeepAlive keepAlive = makeMessage<ImcProtocol::KeepAlive>(getNextReceivedSequence());
-    uart.callDataReceived(payload(keepAlive));
-    uart.callIdleLineDetected();
+struct TestDeltaRecipient : public ImcRecipent<TestDeltaRecipient, testRecipent, TestDeltaMessage>
+{
+    template<typename ImcModule>
+    bool handleMessage(TestStateMessage& m, ImcModule&)
+    {
+        received.push_back(m.data);
+        return true;
+    }
 
-    imc.update(2000);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::KeepAlive::myId, keepAlive.sequence})
-    );
+    std::vector<TestMessageContents2> received{};
+};
 
-    imc.update(2000);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+// Stores sent frames instead of sending them
+struct TestDeltaSink
+{
+    template<typename MessageT>
+    bool sendMessage(MessageT& msg, std::uint8_t contentsSize)
+    {
+        msg.size = contentsSize;
+        frames.push_back(payload(msg));
+        return isAccepting;
+    }
 
-    imc.update(1000);
-    uart.sendAllQueuedBytes();
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    bool dispatchLastFrame(TestDeltaRecipient& recipient)
+    {
+        auto& frame = frames.back();
+        return recipient.dispatch(*this, frame[0], frame[1], frame.data());
+    }
 
-    // User message refreshes timer
-    establishCommunication();
+    std::vector<std::vector<std::uint8_t>> frames{};
+    bool isAccepting = true;
+};
 
-    imc.update(2000);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+ADD_TEST(ImcDeltaCodecTest, sendsKeyframeThenChangedBytes_andRecipientRebuildsWholeContents)
+{
+    ImcDeltaEncoder<TestDeltaMessage, 10> encoder{};
+    TestDeltaRecipient recipient{};
+    TestDeltaSink sink{};
+
+    TestMessageContents2 state{1, 2, 3, 4};
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+    // Keyframe: whole 16 bytes of contents
+    EXPECT_EQUAL(ImcProtocol::deltaHeaderSize + 16, sink.frames.back()[1]);
+
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+    // Unchanged: only bitmap
+    EXPECT_EQUAL(ImcProtocol::deltaHeaderSize + 2, sink.frames.back()[1]);
+
+    state.c = 0x0305;
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+    // Two bytes of c changed
+    EXPECT_EQUAL(ImcProtocol::deltaHeaderSize + 2 + 2, sink.frames.back()[1]);
+
+    ASSERT_EQUAL(3u, recipient.received.size());
+    EXPECT_EQUAL(1u, recipient.received[1].a);
+    EXPECT_EQUAL(3u, recipient.received[1].c);
+    EXPECT_EQUAL(0x0305u, recipient.received[2].c);
+    EXPECT_EQUAL(4u, recipient.received[2].d);
+
+    // Not enqueued frame doesn't change encoder state
+    sink.isAccepting = false;
+    EXPECT_FALSE(encoder.send(sink, state));
+}
 
-    imc.registerMessageRecipient(testRecipent, {[](void*, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
+ADD_TEST(ImcDeltaCodecTest, whenKeyframeIsLost_dropsDeltasUntilNextKeyframe)
+{
+    ImcDeltaEncoder<TestDeltaMessage, 3> encoder{};
+    TestDeltaRecipient recipient{};
+    TestDeltaSink sink{};
+
+    TestMessageContents2 state{1, 2, 3, 4};
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+
+    // Second keyframe is lost
+    for(std::uint32_t i = 0; i < 3; ++i)
     {
-        return true;
-    }, nullptr});
+        state.a = 10 + i;
+        EXPECT_TRUE(encoder.send(sink, state));
+    }
+    EXPECT_EQUAL(ImcProtocol::deltaHeaderSize + 16, sink.frames.back()[1]);
+
+    state.a = 20;
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+    EXPECT_EQUAL(1u, recipient.received.size());
+
+    state.a = 21;
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+    EXPECT_EQUAL(1u, recipient.received.size());
+
+    // Next keyframe restores decoding
+    state.a = 30;
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+    state.b = 31;
+    EXPECT_TRUE(encoder.send(sink, state));
+    EXPECT_TRUE(sink.dispatchLastFrame(recipient));
+
+    ASSERT_EQUAL(3u, recipient.received.size());
+    EXPECT_EQUAL(30u, recipient.received[2].a);
+    EXPECT_EQUAL(31u, recipient.received[2].b);
+
+    // Delta with bitmap not matching its bytes is invalid
+    sink.frames.back()[1] += 1;
+    EXPECT_FALSE(sink.dispatchLastFrame(recipient));
+}
 
-    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence());
-    uart.callDataReceived(payload(msg));
-    uart.callIdleLineDetected();
+ADD_TEST_F(ImcModuleTest, whenMessageIsSentWithContentsSize_sendsOnlyThosePaddedContents)
+{
+    establishCommunication();
 
-    imc.update(2000);
+    TestDeltaMessage msg{};
+    msg.data.encoded.fill(0xFF);
+    std::uint16_t sequence = getNextSentSequence();
+    EXPECT_TRUE(imc.sendMessage(msg, 5));
     uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
 
-    imc.update(2000);
-    uart.sendAllQueuedBytes();
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    // Header, 5 bytes of contents padded to 8 and crc
+    ASSERT_EQUAL(ImcProtocol::headerSize + 8u + ImcProtocol::crcSize, uart.sentBytes.size());
+    EXPECT_EQUAL(TestDeltaMessage::myId, uart.sentBytes[0]);
+    EXPECT_EQUAL(5, uart.sentBytes[1]);
+    EXPECT_EQUAL(sequence, *reinterpret_cast<std::uint16_t*>(uart.sentBytes.data() + ImcProtocol::sequenceOffset));
+    EXPECT_EQUAL(0xFF, uart.sentBytes[ImcProtocol::headerSize + 4]);
+    EXPECT_EQUAL(0, uart.sentBytes[ImcProtocol::headerSize + 5]);
+
+    TestCrc crc{};
+    crc.add(makeSpan(uart.sentBytes.data(), ImcProtocol::headerSize + 5), CrcFeed::Bytes);
+    EXPECT_EQUAL(crc.get(), *reinterpret_cast<std::uint32_t*>(uart.sentBytes.data() + ImcProtocol::headerSize + 8));
+}
 
-    imc.update(1000);
+using TestHighPriorityMessage = ImcProtocol::PriorityMessage<TestMessageContents, ImcProtocol::makeMessageId(testRecipent, 6), ImcProtocol::Priority::High>;
+
+ADD_TEST_F(ImcModuleTest, highPriorityMessage_isSentBeforeQueuedMessages_andIsNotBatched)
+{
+    InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, DeepQueueImcConfig> deepImc{uart, crc, settings};
+    uart.callIdleLineDetected();
+    deepImc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
-    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    uart.sentBytes.clear();
+    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 0);
+    deepImc.update(1);
+    EXPECT_TRUE(deepImc.hasCommunicationEstablished());
+
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    EXPECT_TRUE(deepImc.sendMessage(msg));
+    EXPECT_TRUE(deepImc.sendMessage(msg));
 
+    settings.batchMaxSize = 44;
+    TestHighPriorityMessage highMsg{};
+    EXPECT_TRUE(deepImc.sendMessage(highMsg));
+
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES_ID(uart, msg, highMsg, msg);
+    EXPECT_EQUAL(sizeof(TestMessage), deepImc.getMaxQueueingDelay(ImcProtocol::Priority::High));
 }
 
-ADD_TEST_F(ImcModuleTest, whenUserDataIsReceived_dispatchesToRecipient)
+struct PublishingImcConfig : ImcDefaultConfig
 {
-    establishCommunication();
+    static constexpr std::uint8_t publishSourcesCount = 2;
+};
 
-    bool dispatchedFlag = false;
+using TestPublishingSlaveIMC = InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, PublishingImcConfig>;
 
-    imc.registerMessageRecipient(
-        testRecipent, {
-        [](void* ctx, auto&, std::uint8_t id, std::uint8_t size, std::uint8_t* data)
+class ImcPublishTest : public ImcSlaveTestBase<TestPublishingSlaveIMC>
+{
+public:
+    ImcPublishTest()
+    {
+        // Keep only published messages on the link
+        settings.slaveKeepAliveIntervalUs = 100 * 1000;
+        settings.slaveAckTimeoutUs = 300 * 1000;
+    }
+
+    template<std::uint8_t source>
+    static bool publish(void* ctx, TestPublishingSlaveIMC& imc)
+    {
+        TestMessage msg{};
+        msg.data.a = source;
+        bool isSent = imc.sendMessage(msg);
+        static_cast<ImcPublishTest*>(ctx)->publishedCount[source] += isSent;
+        return isSent;
+    }
+
+    void advance(std::uint32_t timeUs, bool sendBytes)
+    {
+        for(std::uint32_t t = 0; t < timeUs; t += 100)
         {
-            ASSERT_EQUAL(TestMessage::myId, id);
-            ASSERT_EQUAL(TestMessage::dataSize, size);
+            imc.update(100);
+            if(sendBytes)
+            {
+                uart.sendAllQueuedBytes();
+            }
+        }
+    }
 
-            TestMessageContents& message = reinterpret_cast<TestMessage*>(data)->data;
-            EXPECT_EQUAL(1u, message.a);
-            EXPECT_EQUAL(2u, message.b);
-            *reinterpret_cast<bool*>(ctx) = true;
+    std::array<int, 2> publishedCount{};
+};
 
-            return true;
-        },
-        &dispatchedFlag
-    });
+ADD_TEST_F(ImcPublishTest, publishesSourcesWithTheirPeriodAndPhase_andCountsMissedPeriods)
+{
+    establishCommunication();
 
-    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
-    uart.callDataReceived(payload(msg));
-    uart.callIdleLineDetected();
+    EXPECT_TRUE(imc.registerPublisher<TestMessage>(1000, 0, {&publish<0>, this}));
+    EXPECT_TRUE(imc.registerPublisher<TestMessage>(1000, 500, {&publish<1>, this}));
+    EXPECT_FALSE(imc.registerPublisher<TestMessage>(1000, 0, {&publish<0>, this}));
+    EXPECT_EQUAL(2 * sizeof(TestMessage) * 1000, imc.getScheduledLinkLoad());
 
-    imc.update(1);
-    uart.sendAllQueuedBytes();
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    advance(400, true);
+    EXPECT_EQUAL(1, publishedCount[0]);
+    EXPECT_EQUAL(0, publishedCount[1]);
+
+    advance(600, true);
+    EXPECT_EQUAL(2, publishedCount[0]);
+    EXPECT_EQUAL(1, publishedCount[1]);
+
+    // Second source takes the only user slot, so first one can't publish in its period
+    advance(1900, false);
+    EXPECT_EQUAL(2, publishedCount[0]);
+    EXPECT_EQUAL(2, publishedCount[1]);
+    EXPECT_EQUAL(0u, imc.getMissedPublishPeriods(0));
+
+    advance(100, false);
+    EXPECT_EQUAL(1u, imc.getMissedPublishPeriods(0));
+    EXPECT_EQUAL(0u, imc.getMissedPublishPeriods(1));
 
-    EXPECT_TRUE(dispatchedFlag);
+    uart.sendAllQueuedBytes();
+    advance(100, true);
+    EXPECT_EQUAL(3, publishedCount[0]);
 }
 
-ADD_TEST_F(ImcModuleTest, whenNoRecipentIsRegistred_sendsRecieveError)
+ADD_TEST_F(ImcPublishTest, whenUpdateSpansSeveralPeriods_publishesOnce_andCountsSkippedPeriodsAsMissed)
 {
     establishCommunication();
-
-    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
-    uart.callDataReceived(payload(msg));
-    uart.callIdleLineDetected();
+    EXPECT_TRUE(imc.registerPublisher<TestMessage>(1000, 0, {&publish<0>, this}));
 
     imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0})
-    );
-
-    // After error is sent further data should be processed normally
-    checkImcProcessesData();
-}
+    EXPECT_EQUAL(1, publishedCount[0]);
 
-ADD_TEST_F(ImcModuleTest, whenRecipentReturnsFalse_sendsRecieveError)
-{
-    establishCommunication();
+    // Main loop stalls for 3.5 periods
+    imc.update(3500);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(2, publishedCount[0]);
+    EXPECT_EQUAL(2u, imc.getMissedPublishPeriods(0));
 
-    bool dispatchedFlag = false;
+    // Schedule still follows period
+    imc.update(498);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(2, publishedCount[0]);
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(3, publishedCount[0]);
+    EXPECT_EQUAL(2u, imc.getMissedPublishPeriods(0));
+}
 
-    imc.registerMessageRecipient(testRecipent, {[](void* ctx, auto&, std::uint8_t, std::uint8_t, std::uint8_t*)
-    {
-        *reinterpret_cast<bool*>(ctx) = true;
-        return false;
-    }, &dispatchedFlag});
+using TestLatestValueMessage = ImcProtocol::StateMessage<TestMessageContents, ImcProtocol::makeMessageId(testRecipent, 7)>;
 
-    TestMessage msg = makeMessage<TestMessage>(getNextReceivedSequence(), TestMessageContents{1, 2});
-    uart.callDataReceived(payload(msg));
+ADD_TEST_F(ImcModuleTest, stateMessage_overwritesItsUnsentInstance)
+{
+    InterMcuCommunicationModule<TestUart, TestCrc, maxMessageSize, false, DeepQueueImcConfig> deepImc{uart, crc, settings};
     uart.callIdleLineDetected();
+    deepImc.update(1);
+    uart.sendAllQueuedBytes();
+    uart.sentBytes.clear();
+    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 0);
+    deepImc.update(1);
+    EXPECT_TRUE(deepImc.hasCommunicationEstablished());
+
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    TestLatestValueMessage state1 = makeMessage<TestLatestValueMessage>(0, TestMessageContents{3, 4});
+    TestLatestValueMessage state2 = makeMessage<TestLatestValueMessage>(0, TestMessageContents{5, 6});
+    TestLatestValueMessage state3 = makeMessage<TestLatestValueMessage>(0, TestMessageContents{7, 8});
+    EXPECT_TRUE(deepImc.sendMessage(msg));
+    EXPECT_TRUE(deepImc.sendMessage(state1));
+    EXPECT_TRUE(deepImc.sendMessage(msg));
+    EXPECT_FALSE(deepImc.canEnqueueMessage());
+    EXPECT_TRUE(deepImc.sendMessage(state2));
 
-    imc.update(1);
     uart.sendAllQueuedBytes();
     EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0})
+        makeMessage<TestMessage>(1, TestMessageContents{1, 2}),
+        makeMessage<TestLatestValueMessage>(2, TestMessageContents{5, 6}),
+        makeMessage<TestMessage>(3, TestMessageContents{1, 2})
     );
 
-    EXPECT_TRUE(dispatchedFlag);
+    // Batched instance is overwritten as well
+    settings.batchMaxSize = 44;
+    EXPECT_TRUE(deepImc.sendMessage(state2));
+    EXPECT_TRUE(deepImc.sendMessage(msg));
+    EXPECT_TRUE(deepImc.sendMessage(state3));
+    deepImc.update(1);
 
-    checkImcProcessesData();
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(ImcProtocol::batchMessageId, uart.sentBytes[0]);
+    EXPECT_EQUAL(7, uart.sentBytes[ImcProtocol::headerSize + ImcProtocol::headerSize]);
 }
 
-ADD_TEST_F(ImcModuleTest, whenGotReceiveError_sendsReceiveError)
+struct TestTransmitEvent
+{
+    TransmitEvent event;
+    std::uint16_t sequence;
+    std::uint32_t timestampUs;
+};
+
+void recordTransmitEvent(void* ctx, TransmitEvent event, std::uint16_t sequence, std::uint32_t timestampUs)
+{
+    static_cast<std::vector<TestTransmitEvent>*>(ctx)->push_back({event, sequence, timestampUs});
+}
+
+ADD_TEST_F(ImcModuleTest, reportsTransmitEventsOfUserFrames_withTimestamps)
 {
     establishCommunication();
 
-    uart.callReceiveError(1);
+    TestUsTimer usTimer{};
+    std::vector<TestTransmitEvent> events{};
+    imc.setTransmitCallback(usTimer, 0, {&recordTransmitEvent, &events});
 
-    imc.update(1000);
+    usTimer.us = 10;
+    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
+    EXPECT_TRUE(imc.sendMessage(msg));
+    usTimer.us = 20;
     uart.sendAllQueuedBytes();
 
-    // KeepAlive is not sent, as its timer is reset after any sent message
-    EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{0})
-    );
-    EXPECT_TRUE(imc.hasCommunicationEstablished());
-
-    imc.update(1);
+    // Control messages are not reported
+    imc.update(1000);
     uart.sendAllQueuedBytes();
 
-    checkImcProcessesData();
+    ASSERT_EQUAL(3u, events.size());
+    EXPECT_TRUE(events[0].event == TransmitEvent::Queued);
+    EXPECT_TRUE(events[1].event == TransmitEvent::Started);
+    EXPECT_TRUE(events[2].event == TransmitEvent::Sent);
+    for(auto& e: events)
+    {
+        EXPECT_EQUAL(msg.sequence, e.sequence);
+    }
+    EXPECT_EQUAL(10u, events[1].timestampUs);
+    EXPECT_EQUAL(20u, events[2].timestampUs);
 }
 
-ADD_TEST_F(ImcModuleTest, whenExpectedAndReceivedMessageFieldsDoesntMatch_sendsReceiveError)
+ADD_TEST_F(ImcReliableTest, reportsAcknowledgedFrames)
 {
     establishCommunication();
 
-    std::uint8_t lastOkSequence = 0;
-
-    ImcProtocol::Acknowledge ack{};
-    ack.data.ackId = ImcProtocol::Handshake::myId;
-    ack.data.ackSequence = 0;
+    TestUsTimer usTimer{};
+    std::vector<TestTransmitEvent> events{};
+    imc.setTransmitCallback(usTimer, 0, {&recordTransmitEvent, &events});
 
-    // 0) data smaller than 8bytes
-    uart.callDataReceived({1, 2, 3, 4, 5, 6, 7});
-    uart.callIdleLineDetected();
-    imc.update(1);
+    sendUserMessage(1);
+    sendUserMessage(2);
+    sendUserMessage(3);
     uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence})
-    );
-
-    // 1) data size too small compared to received bytes
-    ack.size = ImcProtocol::Acknowledge::dataSize - 1;
-    ack.sequence = getNextReceivedSequence();
-    ack.crc = TestCrc{}.getCrc(ack);
-    uart.callDataReceived(payload(ack));
-    uart.callIdleLineDetected();
+    events.clear();
+
+    usTimer.us = 100;
+    receive(payload(withAckSequence(makeMessage<TestMessage>(0, TestMessageContents{1, 0}), 1)));
+    ASSERT_EQUAL(2u, events.size());
+    EXPECT_TRUE(events[0].event == TransmitEvent::Acknowledged);
+    EXPECT_EQUAL(0u, events[0].sequence);
+    EXPECT_TRUE(events[1].event == TransmitEvent::Acknowledged);
+    EXPECT_EQUAL(1u, events[1].sequence);
+    EXPECT_EQUAL(100u, events[1].timestampUs);
+
+    // Acknowledgement of frames which weren't sent is ignored
+    receive(payload(withAckSequence(makeMessage<TestMessage>(1, TestMessageContents{2, 0}), 5)));
+    EXPECT_EQUAL(2u, events.size());
+
+    receive(payload(withAckSequence(makeMessage<TestMessage>(2, TestMessageContents{3, 0}), 2)));
+    ASSERT_EQUAL(3u, events.size());
+    EXPECT_EQUAL(2u, events[2].sequence);
+}
 
-    imc.update(1);
-    uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence})
-    );
+ImcProtocol::CapabilitiesContents makeTestCapabilities(std::uint8_t baudRates, std::uint8_t selectedBaudRate = ImcProtocol::baseBaudRateIndex)
+{
+    ImcProtocol::CapabilitiesContents capabilities{};
+    capabilities.baudRates = baudRates;
+    capabilities.maxMessageSize = maxMessageSize;
+    capabilities.receiveQueueSize = ImcDefaultConfig::receiveQueueSize;
+    capabilities.framing = static_cast<std::uint8_t>(UartFraming::IdleLine);
+    capabilities.crcFeed = static_cast<std::uint8_t>(CrcFeed::Bytes);
+    capabilities.selectedBaudRate = selectedBaudRate;
+    return capabilities;
+}
 
-    // 1.1) send proper message
-    ack.size = ImcProtocol::Acknowledge::dataSize;
-    ack.sequence = getNextReceivedSequence();
-    ack.crc = TestCrc{}.getCrc(ack);
-    uart.callDataReceived(payload(ack));
-    uart.callIdleLineDetected();
+ADD_TEST_F(ImcSlaveTest, negotiatesBaudRate_andEstablishesCommunicationAgainAtIt)
+{
+    establishCommunication();
+    settings.supportedBaudRates = 0x0F;
 
     imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
-
-    lastOkSequence = ack.sequence;
+    EXPECT_SENT_MESSAGES(uart, makeMessage<ImcProtocol::Capabilities>(getNextSentSequence(), makeTestCapabilities(0x0F)));
 
-    // 2) data size too big compared to received bytes
-    ack.size = ImcProtocol::Acknowledge::dataSize + 1;
-    ack.sequence = getNextReceivedSequence();
-    ack.crc = TestCrc{}.getCrc(ack);
-    uart.callDataReceived(payload(ack));
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::Capabilities>(getNextReceivedSequence(), makeTestCapabilities(0xFF, 3))));
     uart.callIdleLineDetected();
+    imc.update(1);
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(921600u, uart.baudRate);
+    EXPECT_EQUAL(921600u, imc.getBaudRate());
+    EXPECT_EQUAL(12u, uart.getGenerateIdleTimeUs());
+    EXPECT_EQUAL(0xFF, imc.getPeerCapabilities().baudRates);
 
     imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence})
-    );
-
-    // 3) crc doesnt match
-    ack.size = ImcProtocol::Acknowledge::dataSize;
-    ack.sequence = getNextReceivedSequence();
-    ack.crc = TestCrc{}.getCrc(ack) - 1;
-    uart.callDataReceived(payload(ack));
-    uart.callIdleLineDetected();
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::Handshake>(getNextSentSequence()), 1));
+    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 0);
 
+    // Link is not negotiated again
     imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart,
-        makeMessage<ImcProtocol::ReceiveError>(getNextSentSequence(), ImcProtocol::ReceiveErrorContents{lastOkSequence})
-    );
-
-    checkImcProcessesData();
+    EXPECT_TRUE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    EXPECT_EQUAL(921600u, uart.baudRate);
 }
 
-ADD_TEST_F(ImcModuleTest, whenReceiveErrorReceived_ignoresIt)
+ADD_TEST_F(ImcSlaveTest, whenCommunicationIsNotEstablishedAfterBaudRateSwitch_restoresBaseRate_andExcludesFailedOne)
 {
     establishCommunication();
+    settings.supportedBaudRates = 0x0F;
+    settings.baudSwitchTimeoutUs = 2500;
 
-    std::uint16_t s = getNextSentSequence();
-    TestMessage msg = makeMessage<TestMessage>(s, TestMessageContents{1, 2});
-    imc.sendMessage(msg);
+    imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart, msg);
-
-    ImcProtocol::ReceiveError error = makeMessage<ImcProtocol::ReceiveError>(getNextReceivedSequence(), ImcProtocol::ReceiveErrorContents{0});
-    uart.callDataReceived(payload(error));
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::Capabilities>(getNextReceivedSequence(), makeTestCapabilities(0xFF, 3))));
     uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(921600u, uart.baudRate);
 
+    imc.update(2500);
+    uart.sendAllQueuedBytes();
     imc.update(1);
+    EXPECT_EQUAL(115200u, uart.baudRate);
+    EXPECT_EQUAL(100u, uart.getGenerateIdleTimeUs());
+    uart.sentBytes.clear();
+
+    imc.update(1000);
     uart.sendAllQueuedBytes();
-    EXPECT_EQUAL(0u, uart.sentBytes.size());
+    ASSERT_EQUAL(ImcProtocol::Handshake::myId, uart.sentBytes[0]);
+    uart.sentBytes.clear();
+    sendAck(getNextReceivedSequence(), ImcProtocol::Handshake::myId, 0);
 
-    msg = makeMessage<TestMessage>(getNextSentSequence(), TestMessageContents{1, 2});
-    imc.sendMessage(msg);
+    imc.update(1);
     uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES(uart, msg);
+    ASSERT_EQUAL(ImcProtocol::Capabilities::myId, uart.sentBytes[0]);
+    EXPECT_EQUAL(0x07, uart.sentBytes[ImcProtocol::headerSize]);
 }
 
-ADD_TEST_F(ImcModuleTest, actualErrorHandlingNeedsImplementation)
+ADD_TEST_F(ImcSlaveTest, baseBaudRate_isTheOneUartIsInitializedWith)
 {
-    // For now errors are just ignored as its not problem to have skipped packets in current application which uses IMC.
-    // On error few things may happen:
-    // - last message (or lastOkSequence + 1) is re-send if reason is transmission error
-    //      (for this we need error type in ReceiveError)
-    // - if reason is unsupported message then probably do nothing - however it may indicate that
-    //      there is some problem with program on slave or master
-    // - some diagnostic info is saved and may be available for inspection from PC application
-
-    bool TODO_implementActualErrorHandling = false;
-    EXPECT_TRUE(TODO_implementActualErrorHandling);
+    TestUart fastUart{timer};
+    fastUart.baudRate = 921600;
+    TestSlaveIMC fastImc{fastUart, crc, settings};
+    settings.supportedBaudRates = 0xFF;
+    settings.baudSwitchTimeoutUs = 2500;
+    EXPECT_EQUAL(921600u, fastImc.getBaudRate());
+
+    fastUart.callIdleLineDetected();
+    fastImc.update(1);
+    fastUart.sendAllQueuedBytes();
+    ImcProtocol::Acknowledge ack = makeMessage<ImcProtocol::Acknowledge>(0, ImcProtocol::AckMessageContents{ImcProtocol::Handshake::myId, 0});
+    fastUart.callDataReceived(payload(ack));
+    fastUart.callIdleLineDetected();
+    fastImc.update(1);
+    fastUart.sendAllQueuedBytes();
+    EXPECT_TRUE(fastImc.hasCommunicationEstablished());
+
+    fastUart.callDataReceived(payload(makeMessage<ImcProtocol::Capabilities>(1, makeTestCapabilities(0xFF, 7))));
+    fastUart.callIdleLineDetected();
+    fastImc.update(1);
+    EXPECT_EQUAL(2250000u, fastUart.baudRate);
+    EXPECT_EQUAL(40u, fastUart.getGenerateIdleTimeUs());
+
+    fastImc.update(2500);
+    fastUart.sendAllQueuedBytes();
+    fastImc.update(1);
+    EXPECT_EQUAL(921600u, fastUart.baudRate);
+    EXPECT_EQUAL(100u, fastUart.getGenerateIdleTimeUs());
 }
 
-ADD_TEST_F(ImcModuleTest, whenMessageQueueIsAlmostFull_doesntSendUserMessage_stillSendsControlMessage)
+ADD_TEST_F(ImcMasterTest, respondsToCapabilities_withHighestCommonBaudRate_andSwitchesAfterResponseIsSent)
 {
+    settings.supportedBaudRates = 0x3F;
     establishCommunication();
 
-    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
-
-    // Only one space in user data queue
-    EXPECT_TRUE(imc.sendMessage(msg));
-    EXPECT_FALSE(imc.sendMessage(msg));
+    std::uint16_t s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::Capabilities>(s, makeTestCapabilities(0x0F))));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    EXPECT_EQUAL(115200u, uart.baudRate);
 
     uart.sendAllQueuedBytes();
-    uart.sentBytes.clear();
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::Capabilities>(getNextSentSequence(), makeTestCapabilities(0x3F, 3)), s));
 
-    EXPECT_TRUE(imc.sendMessage(msg));
-    imc.update(1000);
+    imc.update(1);
+    EXPECT_EQUAL(921600u, uart.baudRate);
+    EXPECT_FALSE(imc.hasCommunicationEstablished());
+    EXPECT_EQUAL(0x0F, imc.getPeerCapabilities().baudRates);
 
-    uart.sendAllQueuedBytes();
-    EXPECT_SENT_MESSAGES_ID(uart, msg, makeMessage<ImcProtocol::KeepAlive>(0));
+    establishCommunication();
+    EXPECT_EQUAL(921600u, uart.baudRate);
 }
 
-ADD_TEST_F(ImcModuleTest, whenMessageQueueIsFull_doesntSendAnyMessages)
+ADD_TEST_F(ImcMasterTest, whenLinkErrorRateIsExceeded_stepsDownBaudRate_andStepsUpAfterCleanWindows)
 {
+    settings.supportedBaudRates = 0x0F;
+    settings.linkQualityWindowUs = 2000;
+    settings.cleanWindowsToStepUp = 1;
     establishCommunication();
 
-    imc.update(1000);
+    std::uint16_t s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::Capabilities>(s, makeTestCapabilities(0x0F))));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::Capabilities>(getNextSentSequence(), makeTestCapabilities(0x0F, 3)), s));
+    imc.update(1);
+    establishCommunication();
+    EXPECT_EQUAL(921600u, uart.baudRate);
 
-    TestMessage msg = makeMessage<TestMessage>(0, TestMessageContents{1, 2});
-    EXPECT_FALSE(imc.sendMessage(msg));
+    // Slave reports dropped frame
+    s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::ReceiveError>(s, ImcProtocol::ReceiveErrorContents{0})));
+    uart.callIdleLineDetected();
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::Capabilities>(getNextSentSequence(), makeTestCapabilities(0x0F, 2)), s));
+    EXPECT_EQUAL(333u, imc.getLinkErrorPermille());
 
-    imc.update(1000);
-    imc.update(1000);
+    imc.update(1);
+    EXPECT_EQUAL(460800u, uart.baudRate);
+    establishCommunication();
 
+    // After step down twice as many clean windows are required
+    s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::KeepAlive>(s)));
+    uart.callIdleLineDetected();
+    imc.update(2000);
     uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(460800u, uart.baudRate);
+    EXPECT_EQUAL(0u, imc.getLinkErrorPermille());
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::Acknowledge>(getNextSentSequence(), ImcProtocol::AckMessageContents{ImcProtocol::KeepAlive::myId, s}), s)
+    );
 
-    // Only 2 KAs are queued and sent despite 3 updates() which tries to send them
-    EXPECT_SENT_MESSAGES_ID(uart, makeMessage<ImcProtocol::KeepAlive>(0), makeMessage<ImcProtocol::KeepAlive>(0));
+    s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::KeepAlive>(s)));
+    uart.callIdleLineDetected();
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    std::uint16_t ackSequence = getNextSentSequence();
+    EXPECT_SENT_MESSAGES(uart,
+        withAckSequence(makeMessage<ImcProtocol::Acknowledge>(ackSequence, ImcProtocol::AckMessageContents{ImcProtocol::KeepAlive::myId, s}), s),
+        withAckSequence(makeMessage<ImcProtocol::Capabilities>(getNextSentSequence(), makeTestCapabilities(0x0F, 3)), s)
+    );
+    imc.update(1);
+    EXPECT_EQUAL(921600u, uart.baudRate);
 }
 
-
-struct TestMessageContents2
-{
-    std::uint32_t a = 0;
-    std::uint32_t b = 0;
-    std::uint32_t c = 0;
-    std::uint32_t d = 0;
-};
-using TestMessage2 = ImcProtocol::Message<TestMessageContents2, ImcProtocol::makeMessageId(testRecipent, 2)>;
-
-struct TestRecipient : public ImcRecipent<TestRecipient, testRecipent, TestMessage, TestMessage2>
+ADD_TEST_F(ImcMasterTest, receiveErrorForRejectedMessage_isNotCountedAsLinkError)
 {
-    bool handleMessage(TestMessage& m, int&)
-    {
-        m.data.b = 10;
-        return true;
-    }
-
-    bool handleMessage(TestMessage2& m, int&)
-    {
-        m.data.c = 20;
-        return true;
-    }
-};
-
-static_assert(TestRecipient::maxMessageSize == 24, "Expected: TestRecipient::maxMessageSize == 24");
-static_assert(TestRecipient::recipentNumber == 2, "Expected: TestRecipient::recipentNumber == 2");
+    settings.supportedBaudRates = 0x0F;
+    settings.linkQualityWindowUs = 2000;
+    establishCommunication();
 
-ADD_TEST(ImcRecipientTest, dispatchValidMessages)
-{
-    TestRecipient r{};
-    int dummy = 0;
-    TestMessage m1{};
-    TestMessage2 m2{};
+    std::uint16_t s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::Capabilities>(s, makeTestCapabilities(0x0F))));
+    uart.callIdleLineDetected();
+    imc.update(1);
+    uart.sendAllQueuedBytes();
+    EXPECT_SENT_MESSAGES(uart, withAckSequence(makeMessage<ImcProtocol::Capabilities>(getNextSentSequence(), makeTestCapabilities(0x0F, 3)), s));
+    imc.update(1);
+    establishCommunication();
+    EXPECT_EQUAL(921600u, uart.baudRate);
 
-    bool v1 = r.dispatch(dummy, TestMessage::myId, TestMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1));
-    EXPECT_TRUE(v1);
-    EXPECT_EQUAL(10u, m1.data.b);
-    EXPECT_EQUAL(0u, m2.data.c);
+    // Slave reports frame rejected by its recipient
+    s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::ReceiveError>(s, ImcProtocol::ReceiveErrorContents{0, ImcProtocol::ReceiveErrorReason::Rejected})));
+    uart.callIdleLineDetected();
+    imc.update(2000);
+    uart.sendAllQueuedBytes();
+    EXPECT_EQUAL(0u, imc.getLinkErrorPermille());
 
-    bool v2 = r.dispatch(dummy, TestMessage2::myId, TestMessage2::dataSize, reinterpret_cast<std::uint8_t*>(&m2));
-    EXPECT_TRUE(v2);
-    EXPECT_EQUAL(10u, m1.data.b);
-    EXPECT_EQUAL(20u, m2.data.c);
+    // Slave reports dropped frame
+    s = getNextReceivedSequence();
+    uart.callDataReceived(payload(makeMessage<ImcProtocol::ReceiveError>(s, ImcProtocol::ReceiveErrorContents{0, ImcProtocol::ReceiveErrorReason::LinkError})));
+    uart.callIdleLineDetected();
+    imc.update(2000);
+    EXPECT_EQUAL(500u, imc.getLinkErrorPermille());
 }
 
-ADD_TEST(ImcRecipientTest, dispatchInalidMessages)
+ADD_TEST_F(ImcMasterTest, inReliableMode_framesLostAfterCorruptedOne_countAsSingleLinkError)
 {
-    TestRecipient r{};
-    int dummy = 0;
-    TestMessage m1{};
-    TestMessage2 m2{};
+    TestUart reliableUart{timer};
+    TestReliableMasterIMC reliableImc{reliableUart, crc, settings};
+    reliableImc.registerMessageRecipient(testRecipent, {
+        [](void*, auto&, std::uint8_t, std::uint8_t, std::uint8_t*) { return true; },
+        nullptr
+    });
+    settings.supportedBaudRates = 0x0F;
+    settings.linkQualityWindowUs = 2000;
+    settings.maxLinkErrorPermille = 200;
 
-    bool v1 = r.dispatch(dummy, 0, TestMessage::dataSize, reinterpret_cast<std::uint8_t*>(&m1));
-    EXPECT_FALSE(v1);
-    EXPECT_EQUAL(0u, m1.data.b);
-    EXPECT_EQUAL(0u, m2.data.c);
+    auto receive = [&](std::vector<std::uint8_t> frame)
+    {
+        reliableUart.callDataReceived(frame);
+        reliableUart.callIdleLineDetected();
+        reliableImc.update(1);
+        reliableUart.sendAllQueuedBytes();
+    };
 
-    bool v2 = r.dispatch(dummy, TestMessage2::myId, 143, reinterpret_cast<std::uint8_t*>(&m2));
-    EXPECT_FALSE(v2);
-    EXPECT_EQUAL(0u, m1.data.b);
-    EXPECT_EQUAL(0u, m2.data.c);
+    reliableUart.callIdleLineDetected();
+    receive(payload(makeMessage<ImcProtocol::Handshake>(0)));
+    receive(payload(makeMessage<ImcProtocol::Capabilities>(0, makeTestCapabilities(0x0F))));
+    reliableImc.update(1);
+    EXPECT_EQUAL(921600u, reliableUart.baudRate);
+    receive(payload(makeMessage<ImcProtocol::Handshake>(0)));
+    EXPECT_TRUE(reliableImc.hasCommunicationEstablished());
+
+    // Frames in flight after corrupted one are dropped too, but retransmission is requested once
+    receive(payload(makeMessage<TestMessage>(0, TestMessageContents{10, 0})));
+    TestMessage corrupted = makeMessage<TestMessage>(1, TestMessageContents{11, 0});
+    corrupted.crc += 1;
+    receive(payload(corrupted));
+    receive(payload(makeMessage<TestMessage>(2, TestMessageContents{12, 0})));
+    receive(payload(makeMessage<TestMessage>(3, TestMessageContents{13, 0})));
+    receive(payload(makeMessage<TestMessage>(4, TestMessageContents{14, 0})));
+
+    reliableImc.update(2000);
+    // 1 error per 5 valid frames (including Handshake)
+    EXPECT_EQUAL(166u, reliableImc.getLinkErrorPermille());
+    EXPECT_EQUAL(921600u, reliableUart.baudRate);
 }
@@ -48,7 +48,7 @@ bool TestRunner::run(const std::string& filter)
             std::cout << "[" << t.name << "] FAILED\n";
         }
     }
-    return std::any_of(allTests.begin(), allTests.end(), [](auto& t) { return !t.test->isSuccess(); });
+    return std::all_of(allTests.begin(), allTests.end(), [](auto& t) { return t.test->isSuccess(); });
 }
 
 }